@@ -41,6 +41,7 @@
 #include <stdarg.h>
 #include <stdlib.h>
 #include <unistd.h>
+#include <ctype.h>
 #include <errno.h>
 #include <string.h>
 #include <limits.h>
@@ -56,6 +57,7 @@
 
 #include <libxml/tree.h>
 #include <libxml/parser.h>
+#include <libxml/hash.h>
 #include <libxml/xpath.h>
 #include <libxml/xpathInternals.h>
 
@@ -143,10 +145,18 @@ struct ncds {
 struct ncds_ds *nacm_ds = NULL; /* for NACM subsystem */
 static struct ncds ncds = {NULL, NULL, 0, 0};
 static struct model_list *models_list = NULL;
+/* datastores indexed by their id */
+static xmlHashTablePtr datastores_index = NULL;
+/* models indexed by namespace and by the names of their operations and notifications with the namespace */
+static xmlHashTablePtr models_index = NULL;
+static xmlHashTablePtr models_ops_index = NULL;
+static xmlHashTablePtr models_notifs_index = NULL;
+/* number of threads applying read operations in ncds_apply_rpc2all() */
+static unsigned int rpc2all_workers = 0;
 static struct transapi_list* augment_tapi_list = NULL;
 static char** models_dirs = NULL;
 
-static nc_reply* ncds_apply_rpc(ncds_id id, const struct nc_session* session, const nc_rpc* rpc, struct nc_filter* shared_filter);
+static nc_reply* ncds_apply_rpc(ncds_id id, const struct nc_session* session, const nc_rpc* rpc, struct nc_filter* shared_filter, int locked);
 static char* get_state_nacm(const char* UNUSED(model), const char* UNUSED(running), struct nc_err ** UNUSED(e));
 static char* get_state_monitoring(const char* UNUSED(model), const char* UNUSED(running), struct nc_err ** UNUSED(e));
 static int get_model_info(xmlXPathContextPtr model_ctxt, char **name, char **version, char **ns, char **prefix, char ***rpcs, char ***notifs);
@@ -155,7 +165,7 @@ static int ncds_features_parse(struct data_model* model);
 static int ncds_update_uses_groupings(struct data_model* model);
 static int ncds_update_uses_augments(struct data_model* model);
 static void ncds_ds_model_free(struct data_model* model);
-static xmlDocPtr ncxml_merge(const xmlDocPtr first, const xmlDocPtr second, const xmlDocPtr data_model);
+static xmlDocPtr ncxml_merge(const xmlDocPtr first, const xmlDocPtr second, const xmlDocPtr data_model, keyList keys);
 extern int first_after_close;
 
 static int ncds_update_features();
@@ -167,6 +177,8 @@ static char* get_state_notifications(const char* UNUSED(model), const char* UNUS
 #endif
 
 static struct ncds_ds *datastores_get_ds(ncds_id id);
+static void datastores_index_set(ncds_id id, struct ncds_ds* ds);
+static void models_index_update(const char* ns);
 
 #ifndef DISABLE_YANGFORMAT
 /* XSL stylesheet for transformation from YIN to YANG format */
@@ -192,6 +204,7 @@ static struct ncds_ds* ncds_fill_func(NCDS_TYPE type)
 		ds->func.lock = ncds_custom_lock;
 		ds->func.unlock = ncds_custom_unlock;
 		ds->func.getconfig = ncds_custom_getconfig;
+		ds->func.getconfig_xml = NULL;
 		ds->func.copyconfig = ncds_custom_copyconfig;
 		ds->func.deleteconfig = ncds_custom_deleteconfig;
 		ds->func.editconfig = ncds_custom_editconfig;
@@ -209,6 +222,7 @@ static struct ncds_ds* ncds_fill_func(NCDS_TYPE type)
 		ds->func.lock = ncds_file_lock;
 		ds->func.unlock = ncds_file_unlock;
 		ds->func.getconfig = ncds_file_getconfig;
+		ds->func.getconfig_xml = ncds_file_getconfig_xml;
 		ds->func.copyconfig = ncds_file_copyconfig;
 		ds->func.deleteconfig = ncds_file_deleteconfig;
 		ds->func.editconfig = ncds_file_editconfig;
@@ -226,6 +240,7 @@ static struct ncds_ds* ncds_fill_func(NCDS_TYPE type)
 		ds->func.lock = ncds_empty_lock;
 		ds->func.unlock = ncds_empty_unlock;
 		ds->func.getconfig = ncds_empty_getconfig;
+		ds->func.getconfig_xml = NULL;
 		ds->func.copyconfig = ncds_empty_copyconfig;
 		ds->func.deleteconfig = ncds_empty_deleteconfig;
 		ds->func.editconfig = ncds_empty_editconfig;
@@ -433,6 +448,7 @@ int ncds_sysinit(int flags)
 		ncds_features_parse(ds->data_model);
 		ds->ext_model = ds->data_model->xml;
 		ds->ext_model_tree = NULL;
+		ds->ext_model_keys = NULL;
 
 		/* resolve uses statements in groupings and augments definitions */
 		ncds_update_uses_groupings(ds->data_model);
@@ -452,6 +468,7 @@ int ncds_sysinit(int flags)
 		list_item->model = ds->data_model;
 		list_item->next = models_list;
 		models_list = list_item;
+		models_index_update(ds->data_model->ns);
 
 #ifndef DISABLE_VALIDATION
 		/* set validation */
@@ -479,6 +496,7 @@ int ncds_sysinit(int flags)
 		dsitem->next = ncds.datastores;
 		ncds.datastores = dsitem;
 		ncds.count++;
+		datastores_index_set(ds->id, ds);
 		if (ncds.count >= ncds.array_size) {
 			void *tmp = realloc(ncds.datastores_ids, (ncds.array_size + 10) * sizeof(ncds_id));
 			if (tmp == NULL) {
@@ -522,6 +540,31 @@ void ncds_startup_internal(void)
 	}
 }
 
+/**
+ * @brief Add the datastore into the index of the datastores list or remove it.
+ *
+ * @param[in] id ID of the storage.
+ * @param[in] ds Datastore with the id, NULL to remove the id from the index.
+ */
+static void datastores_index_set(ncds_id id, struct ncds_ds* ds)
+{
+	char key[16];
+
+	snprintf(key, sizeof(key), "%d", id);
+	if (ds == NULL) {
+		xmlHashRemoveEntry(datastores_index, BAD_CAST key, NULL);
+		return;
+	}
+
+	if (datastores_index == NULL && (datastores_index = xmlHashCreate(16)) == NULL) {
+		ERROR("%s: xmlHashCreate failed (%s:%d).", __func__, __FILE__, __LINE__);
+		return;
+	}
+	if (xmlHashUpdateEntry(datastores_index, BAD_CAST key, ds, NULL) != 0) {
+		ERROR("%s: adding datastore %d into the index failed.", __func__, id);
+	}
+}
+
 /**
  * @brief Get ncds_ds structure from the datastore list containing storage
  * information with the specified ID.
@@ -532,19 +575,14 @@ void ncds_startup_internal(void)
  */
 static struct ncds_ds *datastores_get_ds(ncds_id id)
 {
-	struct ncds_ds_list *ds_iter;
+	char key[16];
 
-	for (ds_iter = ncds.datastores; ds_iter != NULL; ds_iter = ds_iter->next) {
-		if (ds_iter->datastore != NULL && ds_iter->datastore->id == id) {
-			break;
-		}
-	}
-
-	if (ds_iter == NULL) {
-		return NULL;
+	if (datastores_index == NULL) {
+		return (NULL);
 	}
 
-	return (ds_iter->datastore);
+	snprintf(key, sizeof(key), "%d", id);
+	return ((struct ncds_ds*) xmlHashLookup(datastores_index, BAD_CAST key));
 }
 
 /**
@@ -582,6 +620,7 @@ static struct ncds_ds *datastores_detach_ds(ncds_id id)
 		retval = ds_iter->datastore;
 		free(ds_iter);
 		ncds.count--;
+		datastores_index_set(id, NULL);
 	}
 
 	return retval;
@@ -976,7 +1015,7 @@ API int ncds_device_init(ncds_id *id, struct nc_cpblts *cpblts, int force)
 					running_doc = aux_doc1;
 				} else {
 					aux_doc2 = running_doc;
-					running_doc = ncxml_merge(aux_doc2, aux_doc1, ds_iter->datastore->ext_model);
+					running_doc = ncxml_merge(aux_doc2, aux_doc1, ds_iter->datastore->ext_model, ds_iter->datastore->ext_model_keys);
 					xmlFreeDoc(aux_doc1);
 					xmlFreeDoc(aux_doc2);
 				}
@@ -1020,7 +1059,7 @@ API int ncds_device_init(ncds_id *id, struct nc_cpblts *cpblts, int force)
 
 			/* initial copy of startup to running will cause full (re)configuration of module */
 			/* Here is used high level function ncds_apply_rpc to apply startup configuration and use transAPI */
-			reply_msg = ncds_apply_rpc(ds_iter->datastore->id, dummy_session, rpc_msg, NULL);
+			reply_msg = ncds_apply_rpc(ds_iter->datastore->id, dummy_session, rpc_msg, NULL, 0);
 			if (reply_msg == NULL || (reply_msg != NCDS_RPC_NOT_APPLICABLE && nc_reply_get_type (reply_msg) != NC_REPLY_OK)) {
 				ERROR("Failed perform initial copy of startup to running.");
 				nc_reply_free(reply_msg);
@@ -2205,6 +2244,62 @@ static struct data_model* data_model_new(const char* model_path)
 	return (model);
 }
 
+/**
+ * @brief Update the model indexes after a model with the namespace was added
+ * to or removed from the models list. The namespace is indexed to the first
+ * model in the list with the namespace.
+ *
+ * @param[in] ns Namespace of the added or removed model.
+ */
+static void models_index_update(const char* ns)
+{
+	struct model_list *listitem;
+	struct data_model *old, *new = NULL;
+	int i;
+
+	if (ns == NULL) {
+		return;
+	}
+
+	for (listitem = models_list; listitem != NULL; listitem = listitem->next) {
+		if (listitem->model->ns != NULL && strcmp(listitem->model->ns, ns) == 0) {
+			new = listitem->model;
+			break;
+		}
+	}
+	if ((old = xmlHashLookup(models_index, BAD_CAST ns)) == new) {
+		return;
+	}
+
+	if (old != NULL) {
+		for (i = 0; old->rpcs != NULL && old->rpcs[i] != NULL; i++) {
+			xmlHashRemoveEntry2(models_ops_index, BAD_CAST old->rpcs[i], BAD_CAST ns, NULL);
+		}
+		for (i = 0; old->notifs != NULL && old->notifs[i] != NULL; i++) {
+			xmlHashRemoveEntry2(models_notifs_index, BAD_CAST old->notifs[i], BAD_CAST ns, NULL);
+		}
+	}
+
+	if (new == NULL) {
+		xmlHashRemoveEntry(models_index, BAD_CAST ns, NULL);
+		return;
+	}
+
+	if ((models_index == NULL && (models_index = xmlHashCreate(64)) == NULL) ||
+			(models_ops_index == NULL && (models_ops_index = xmlHashCreate(64)) == NULL) ||
+			(models_notifs_index == NULL && (models_notifs_index = xmlHashCreate(64)) == NULL)) {
+		ERROR("%s: xmlHashCreate failed (%s:%d).", __func__, __FILE__, __LINE__);
+		return;
+	}
+	xmlHashUpdateEntry(models_index, BAD_CAST ns, new, NULL);
+	for (i = 0; new->rpcs != NULL && new->rpcs[i] != NULL; i++) {
+		xmlHashUpdateEntry2(models_ops_index, BAD_CAST new->rpcs[i], BAD_CAST ns, new, NULL);
+	}
+	for (i = 0; new->notifs != NULL && new->notifs[i] != NULL; i++) {
+		xmlHashUpdateEntry2(models_notifs_index, BAD_CAST new->notifs[i], BAD_CAST ns, new, NULL);
+	}
+}
+
 static int data_model_enlink(struct data_model** model)
 {
 	struct model_list *listitem;
@@ -2236,6 +2331,7 @@ static int data_model_enlink(struct data_model** model)
 	listitem->model = *model;
 	listitem->next = models_list;
 	models_list = listitem;
+	models_index_update((*model)->ns);
 
 	return (EXIT_SUCCESS);
 }
@@ -3858,6 +3954,8 @@ API int ncds_consolidate(void)
 
 		yinmodel_free(ds_iter->datastore->ext_model_tree);
 		ds_iter->datastore->ext_model_tree = NULL;
+		keyListFree(ds_iter->datastore->ext_model_keys);
+		ds_iter->datastore->ext_model_keys = NULL;
 	}
 	/* set ref_count of all transAPIs to 0 to recount it in ncds_update_augment() */
 	for (tapi_iter = augment_tapi_list; tapi_iter != NULL; tapi_iter = tapi_iter->next) {
@@ -3903,8 +4001,11 @@ API int ncds_consolidate(void)
 		ncds_update_refine(ds_iter->datastore);
 	}
 
-	/* parse models to get aux structure for TransAPI's internal purposes */
+	/* parse models to get aux structures for key lookups and TransAPI's internal purposes */
 	for (ds_iter = ncds.datastores; ds_iter != NULL; ds_iter = ds_iter->next) {
+		/* extended model is final now, compile its list keys */
+		ds_iter->datastore->ext_model_keys = get_keynode_list(ds_iter->datastore->ext_model);
+
 		/* when using transapi */
 		if (ds_iter->datastore->transapis != NULL) {
 			if (ncds_update_callbacks(ds_iter->datastore) != EXIT_SUCCESS) {
@@ -4004,6 +4105,40 @@ static xmlDocPtr read_datastore_data(ncds_id id, const char *data)
 	}
 }
 
+/**
+ * @brief Get the configuration data of the datastore as an XML document in the
+ * form returned by read_datastore_data(). The datastore implementation provides
+ * the document directly if it can, so the data need not be serialized and parsed
+ * again.
+ *
+ * @return NULL on error with e filled, document to be freed by the caller on success.
+ */
+static xmlDocPtr ncds_getconfig_doc(struct ncds_ds* ds, const struct nc_session* session, NC_DATASTORE source, struct nc_err** e)
+{
+	char *data;
+	xmlDocPtr doc;
+
+	if (ds->func.getconfig_xml != NULL) {
+		doc = ds->func.getconfig_xml(ds, session, source, e);
+	} else if ((data = ds->func.getconfig(ds, session, source, e)) == NULL) {
+		doc = NULL;
+	} else {
+		doc = read_datastore_data(ds->id, data);
+		free(data);
+		if (doc == NULL && *e == NULL) {
+			*e = nc_err_new(NC_ERR_OP_FAILED);
+			nc_err_set(*e, NC_ERR_PARAM_MSG, "Invalid datastore content.");
+		}
+	}
+
+	if (doc == NULL && *e == NULL) {
+		ERROR("%s: Failed to get data from the datastore (%s:%d).", __func__, __FILE__, __LINE__);
+		*e = nc_err_new(NC_ERR_OP_FAILED);
+	}
+
+	return (doc);
+}
+
 #ifndef DISABLE_VALIDATION
 static void relaxng_error_callback(void *error, const char * msg, ...)
 {
@@ -4188,7 +4323,6 @@ static int validate_ds(struct ncds_ds *ds, xmlDocPtr doc, struct nc_err **error)
 static int apply_rpc_validate_(struct ncds_ds* ds, const struct nc_session* session, NC_DATASTORE source, const char* config, struct nc_err** e)
 {
 	int ret = EXIT_FAILURE;
-	char *data_cfg = NULL;
 	xmlDocPtr doc = NULL;
 	xmlNodePtr root, node;
 	xmlNsPtr ns;
@@ -4205,11 +4339,7 @@ static int apply_rpc_validate_(struct ncds_ds* ds, const struct nc_session* sess
 	case NC_DATASTORE_RUNNING:
 	case NC_DATASTORE_STARTUP:
 	case NC_DATASTORE_CANDIDATE:
-		if ((data_cfg = ds->func.getconfig(ds, session, source, e)) == NULL ) {
-			if (*e == NULL ) {
-				ERROR("%s: Failed to get data from the datastore (%s:%d).", __func__, __FILE__, __LINE__);
-				*e = nc_err_new(NC_ERR_OP_FAILED);
-			}
+		if ((doc = ncds_getconfig_doc(ds, session, source, e)) == NULL) {
 			return (EXIT_FAILURE);
 		}
 		break;
@@ -4219,7 +4349,7 @@ static int apply_rpc_validate_(struct ncds_ds* ds, const struct nc_session* sess
 		 * cover it with the <config> element to allow the creation of xml
 		 * document
 		 */
-		data_cfg = (char*)config;
+		doc = read_datastore_data(ds->id, config);
 		break;
 	default:
 		*e = nc_err_new(NC_ERR_BAD_ELEM);
@@ -4227,15 +4357,11 @@ static int apply_rpc_validate_(struct ncds_ds* ds, const struct nc_session* sess
 		return (EXIT_FAILURE);
 	}
 
-	doc = read_datastore_data(ds->id, data_cfg);
 	if (doc == NULL || doc->children == NULL) {
 		/* config is empty */
 		xmlFreeDoc(doc);
 		doc = NULL;
 	}
-	if (source != NC_DATASTORE_CONFIG) {
-		free(data_cfg);
-	}
 
 	if (!doc) {
 		/*
@@ -4434,7 +4560,7 @@ API int ncds_set_validation2(struct ncds_ds* ds, int enable, const char* relaxng
 
 static struct ncds_ds* ncds_new_internal(NCDS_TYPE type, const char * model_path)
 {
-	int ret;
+	int ret, i;
 	struct ncds_ds* ds = NULL;
 	struct ncds_ds_list *ds_iter;
 	char *basename, *path_yin;
@@ -4492,6 +4618,7 @@ static struct ncds_ds* ncds_new_internal(NCDS_TYPE type, const char * model_path
 	}
 	ds->ext_model = ds->data_model->xml;
 	ds->ext_model_tree = NULL;
+	ds->ext_model_keys = NULL;
 
 	/* check if there is already datastore with this model */
 	for (ds_iter = ncds.datastores; ds_iter != NULL; ds_iter = ds_iter->next) {
@@ -4538,12 +4665,16 @@ static struct ncds_ds* ncds_new_internal(NCDS_TYPE type, const char * model_path
 
 	/* TransAPI structure is set to NULLs */
 
-	ret = pthread_mutex_init(&ds->lock, NULL);
-	if (ret != 0) {
-		free(ds);
-		ds = NULL;
-		ERROR("Initialization of a mutex failed (%s).", strerror(errno));
-		goto cleanup;
+	for (i = 0; i < 3; i++) {
+		if ((ret = pthread_rwlock_init(&ds->lock[i], NULL)) != 0) {
+			while (--i >= 0) {
+				pthread_rwlock_destroy(&ds->lock[i]);
+			}
+			free(ds);
+			ds = NULL;
+			ERROR("Initialization of a rwlock failed (%s).", strerror(ret));
+			goto cleanup;
+		}
 	}
 
 	ds->last_access = 0;
@@ -4619,6 +4750,7 @@ static void ncds_ds_model_free(struct data_model* model)
 				models_list = listitem->next;
 			}
 			free(listitem);
+			models_index_update(model->ns);
 			break;
 		}
 		listprev = listitem;
@@ -4702,6 +4834,7 @@ API ncds_id ncds_init(struct ncds_ds* datastore)
 	item->next = ncds.datastores;
 	ncds.datastores = item;
 	ncds.count++;
+	datastores_index_set(datastore->id, datastore);
 
 	return datastore->id;
 }
@@ -4725,6 +4858,8 @@ void ncds_cleanall()
 	ncds.datastores_ids = NULL;
 	ncds.count = 0;
 	ncds.array_size = 0;
+	xmlHashFree(datastores_index, NULL);
+	datastores_index = NULL;
 
 	for (listitem = models_list; listitem != NULL; ) {
 		listnext = listitem->next;
@@ -4732,6 +4867,12 @@ void ncds_cleanall()
 		/* listitem is actually also freed by ncds_ds_model_free() */
 		listitem = listnext;
 	}
+	xmlHashFree(models_index, NULL);
+	models_index = NULL;
+	xmlHashFree(models_ops_index, NULL);
+	models_ops_index = NULL;
+	xmlHashFree(models_notifs_index, NULL);
+	models_notifs_index = NULL;
 
 	for (i = 0; models_dirs != NULL && models_dirs[i] != NULL; i++) {
 		free(models_dirs[i]);
@@ -4805,6 +4946,7 @@ API void ncds_free(struct ncds_ds* datastore)
 		}
 		ncds_ds_model_free(ds->data_model);
 		yinmodel_free(ds->ext_model_tree);
+		keyListFree(ds->ext_model_keys);
 
 		free (ds);
 	}
@@ -4844,97 +4986,35 @@ API void ncds_free2(ncds_id datastore_id)
  *
  * \param[in] parent Parent element which key node is checked.
  * \param[in] child Element to decide if it is a key element of the parent
- * \param[in] keys List of key elements from the configuration data model.
+ * \param[in] keys Compiled list keys of the configuration data model.
  * \return Zero if the given child is NOT the key element of the parent.
  */
 int is_key(xmlNodePtr parent, xmlNodePtr child, keyList keys)
 {
-	xmlChar *str = NULL;
-	char *s, *token;
-	int i, match;
-	xmlNodePtr key_parent, node_parent;
+	const struct model_list_keys* list;
+	int i;
 
 	assert(parent != NULL);
 	assert(child != NULL);
 
-	if (keys == NULL) {
+	if ((list = get_list_keys(keys, parent)) == NULL) {
 		/* there are no keys */
 		return 0;
 	}
 
-	for (i = 0; i < keys->nodesetval->nodeNr; i++) {
-		match = 1;
-		key_parent = keys->nodesetval->nodeTab[i]->parent;
-		node_parent = parent;
-
-		while (1) {
-			if ((str = xmlGetProp(key_parent, BAD_CAST "name")) == NULL) {
-				match = 0;
-				break;
-			}
-			if (xmlStrcmp(str, node_parent->name)) {
-				xmlFree(str);
-				match = 0;
-				break;
-			}
-			xmlFree(str);
-
-			do {
-				key_parent = key_parent->parent;
-			} while (key_parent && ((xmlStrcmp(key_parent->name, BAD_CAST "augment") == 0)
-					|| (xmlStrcmp(key_parent->name, BAD_CAST "choice") == 0)
-					|| (xmlStrcmp(key_parent->name, BAD_CAST "case") == 0)));
-			node_parent = node_parent->parent;
-
-			if ((!key_parent && node_parent) || (key_parent && !node_parent)) {
-				match = 0;
-				break;
-			}
-
-			if (!xmlStrcmp(key_parent->name, BAD_CAST "module") && (node_parent->type == XML_DOCUMENT_NODE)) {
-				/* we have match */
-				break;
-			}
-		}
-
-		if (!match) {
-			continue;
-		}
-
-		/* so the node is in a key's place (list), but is it a key?
-		 * btw, now we don't want to iterate through next key specs,
-		 * so do not use continue from here
-		 */
-
-		/* get the name of the key node(s) from the 'value' attribute in key element in data model */
-		if ((str = xmlGetProp(keys->nodesetval->nodeTab[i], BAD_CAST "value")) == NULL) {
-			continue;
-		}
-
-		/* attribute have the form of space-separated list of key nodes */
-		/* compare all the key node names with the specified child */
-		for (token = s = (char*)str; token != NULL ; s = NULL) {
-			token = strtok(s, " ");
-			if (token == NULL) {
-				break;
-			}
-
-			if (xmlStrcmp(BAD_CAST token, child->name) == 0) {
-				xmlFree(str);
-				return 1;
-			}
+	/* compare all the key node names with the specified child */
+	for (i = 0; i < list->count; i++) {
+		if (xmlStrcmp(BAD_CAST list->names[i], child->name) == 0) {
+			return 1;
 		}
-		xmlFree(str);
-		break;
 	}
 
 	return 0;
 }
 
-static xmlDocPtr ncxml_merge(const xmlDocPtr first, const xmlDocPtr second, const xmlDocPtr data_model)
+static xmlDocPtr ncxml_merge(const xmlDocPtr first, const xmlDocPtr second, const xmlDocPtr data_model, keyList keys)
 {
 	int ret = EXIT_FAILURE;
-	keyList keys;
 	xmlDocPtr result;
 	xmlNodePtr node;
 
@@ -4950,9 +5030,6 @@ static xmlDocPtr ncxml_merge(const xmlDocPtr first, const xmlDocPtr second, cons
 		return (NULL);
 	}
 
-	/* get all keys from data model */
-	keys = get_keynode_list(data_model);
-
 	/* merge the documents */
 	for (node = second->children; node != NULL; node = second->children) {
 		if ((ret = edit_merge(result, second->children, NC_EDIT_DEFOP_MERGE, data_model, keys, NULL, NULL)) != EXIT_SUCCESS) {
@@ -4960,10 +5037,6 @@ static xmlDocPtr ncxml_merge(const xmlDocPtr first, const xmlDocPtr second, cons
 		}
 	}
 
-	if (keys != NULL) {
-		keyListFree(keys);
-	}
-
 	if (ret != EXIT_SUCCESS) {
 		xmlFreeDoc(result);
 		return (NULL);
@@ -4973,354 +5046,482 @@ static xmlDocPtr ncxml_merge(const xmlDocPtr first, const xmlDocPtr second, cons
 }
 
 /**
- * \brief compare the node properties against the reference node properties
- *
- * \param reference     reference node, compared node must have all the
- *                      properties (and the same values) as reference node
- * \param node          compared node
- *
- * \return              0 if compared node contains all the properties (with
- *						the same values) as reference node, 1 otherwise
+ * \brief Subtree filter element compiled by ncxml_filter_compile()
  */
-static int attrcmp(xmlNodePtr reference, xmlNodePtr node)
-{
-	xmlAttrPtr attr = reference->properties;
-	xmlChar *value = NULL, *refvalue = NULL;
-
-	while (attr != NULL) {
-		if ((value = xmlGetProp(node, attr->name)) == NULL) {
-			return 1;
-		} else {
-			refvalue = xmlGetProp(reference, attr->name);
-			if (strcmp((char *) refvalue, (char *) value)) {
-				free(refvalue);
-				free(value);
-				return 1;
-			}
-			free(refvalue);
-			free(value);
-		}
-		attr = attr->next;
-	}
-
-	return 0;
-}
+struct nc_filter_node {
+	const char* name;                /**< element name */
+	const char* ns;                  /**< namespace to match, NULL for the namespace wildcard */
+	const char** attrs;              /**< names and values of the attributes to match */
+	int attr_count;
+	const char* content;             /**< content of a content match node without surrounding whitespaces, NULL otherwise */
+	struct nc_filter_level {
+		struct nc_filter_node* nodes;
+		int count;
+		int content;             /**< index of the first content match node, -1 if there is none */
+		int content_only;        /**< all the nodes are content match nodes */
+	} children;                      /**< child elements of the containment nodes */
+};
 
 /**
- * \brief NETCONF subtree filtering, stolen from old old netopeer
- *
- * \param config        pointer to xmlNode tree to filter
- * \param filter        pointer to NETCONF filter xml tree
- *
- * \return              1 if config satisfies the output filter, 0 otherwise
+ * \brief Subtree filter compiled once per request, the strings are interned
+ * in the dictionary. Comments and other non-element nodes of the filter are
+ * omitted.
  */
+struct nc_filter_compiled {
+	xmlDictPtr dict;
+	struct nc_filter_level top;
+};
 
-static int ncxml_subtree_filter(xmlNodePtr config, xmlNodePtr filter, keyList keys)
+static void filter_level_free(struct nc_filter_level* level)
 {
-	xmlNodePtr config_node;
-	xmlNodePtr filter_node;
-	xmlNodePtr delete = NULL, delete2 = NULL;
-	char *content1 = NULL, *content2 = NULL;
-	int nomatch = 0;
-	int filter_in = 0, sibling_in = 0, end_node = 0, sibling_selection = 0;
-
-	/* normalize filter */
-	if (!config->prev) {
-		for (filter_node = filter; filter_node; ) {
-			delete = filter_node;
-			filter_node = filter_node->next;
-
-			/* remove comments from filter */
-			if (delete->type != XML_ELEMENT_NODE) {
-				if (delete == filter) {
-					filter = filter_node;
-				}
-				xmlUnlinkNode(delete);
-				xmlFreeNode(delete);
-				continue;
-			}
-		}
+	int i;
+
+	for (i = 0; i < level->count; i++) {
+		free(level->nodes[i].attrs);
+		filter_level_free(&level->nodes[i].children);
 	}
+	free(level->nodes);
+}
 
-	/* check if this filter level is last */
-	filter_node = filter;
-	while (filter_node) {
-		if ((filter_node->children) && (filter_node->children->type == XML_TEXT_NODE) &&
-				!xmlIsBlankNode(filter_node->children)) {
-			end_node = 1;
-			break;
-		}
-		filter_node = filter_node->next;
+void ncxml_filter_compiled_free(struct nc_filter_compiled* compiled)
+{
+	if (compiled == NULL) {
+		return;
 	}
 
-	if (end_node) {
+	filter_level_free(&compiled->top);
+	xmlDictFree(compiled->dict);
+	free(compiled);
+}
 
-		/* 0 means that all the sibling nodes will be in the filter result - this is a default
-		 * behavior when there are no selection or containment nodes in the filter sibling set.
-		 * If 1 is set, sibling nodes for the filter result will be selected according to the
-		 * rules in RFC 6241, sec. 6.2.5
-		 */
-		sibling_selection = 0;
+/* intern the string without the surrounding whitespaces */
+static const char* filter_dict_trim(xmlDictPtr dict, const char* str)
+{
+	int len;
 
-		/* init */
-		if ((content1 = nc_clrwspace((char *) filter_node->children->content)) == NULL) {
-			/* internal error - memory allocation failed, do not continue! */
-			return 0;
-		}
+	while (isspace(str[0])) {
+		++str;
+	}
+	for (len = strlen(str); len && isspace(str[len - 1]); --len);
 
-		/* try to find required node */
-		config_node = config;
-		while (config_node && config_node->children) {
-			if (!strcmp((char *) filter_node->name, (char *) config_node->name) &&
-					!nc_nscmp(filter_node, config_node) &&
-					!attrcmp(filter_node, config_node)) {
-				/* init */
-				content2 = NULL;
-				/* get node's content without leading and trailing spaces */
-				if ((content2 = nc_clrwspace((char *) config_node->children->content)) == NULL) {
-					free(content1);
-					free(content2);
-					/* internal error - memory allocation failed, do not continue! */
-					return 0;
-				}
+	return ((const char*) xmlDictLookup(dict, BAD_CAST str, len));
+}
 
-				if (strisempty(content1)) {
-					/* we have an empty content match node, so interpret it as a selection node,
-					 * which means that we will be selecting sibling nodes that will be in the
-					 * filter result
-					 */
-					filter_in = 1;
-					sibling_selection = 1;
-				} else if (strcmp(content1, content2) == 0) {
-					filter_in = 1;
-				}
-				free(content2);
-
-				if (filter_in) {
-					free(content1);
-					content1 = NULL;
-
-					/* we have the matching node, now decide what to do */
-					if (filter_node->next || filter_node->prev || sibling_selection == 1) {
-						/* check if all filter sibling nodes are content match nodes -> then no config sibling node will be removed */
-						/*go to the first filter sibling node */
-						filter_node = filter;
-						/* pass all filter sibling nodes */
-						while (sibling_selection == 0 && filter_node) {
-							if (!filter_node->children || (filter_node->children->type != XML_TEXT_NODE) ||
-									xmlIsBlankNode(filter_node->children)) {
-								sibling_selection = 1; /* filter result will be selected */
-								break;
-							}
-							filter_node = filter_node->next;
-						}
+static int filter_compile_level(xmlDictPtr dict, xmlNodePtr first, struct nc_filter_level* level)
+{
+	struct nc_filter_node* fnode;
+	xmlNodePtr node, child;
+	xmlAttrPtr attr;
+	xmlChar* value;
+	char* s;
+	int i;
 
-						/* select and remove all unwanted nodes */
-						config_node = config;
-						while (config_node) {
-							/* init */
-							sibling_in = 0;
+	level->nodes = NULL;
+	level->count = 0;
+	level->content = -1;
+	level->content_only = 1;
 
-							/* go to the first filter sibing node */
-							filter_node = filter;
+	for (node = first; node != NULL; node = node->next) {
+		if (node->type == XML_ELEMENT_NODE) {
+			level->count++;
+		}
+	}
+	if (level->count == 0) {
+		return (EXIT_SUCCESS);
+	}
+	if ((level->nodes = calloc(level->count, sizeof(struct nc_filter_node))) == NULL) {
+		ERROR("Memory allocation failed (%s:%d).", __FILE__, __LINE__);
+		level->count = 0;
+		return (EXIT_FAILURE);
+	}
 
-filter:
-							/* pass all filter sibling nodes */
-							while (filter_node) {
-								if (!strcmp((char *) filter_node->name, (char *) config_node->name) &&
-										!nc_nscmp(filter_node, config_node) && !attrcmp(filter_node, config_node)) {
-									/* content match node check */
-									if (filter_node->children && (filter_node->children->type == XML_TEXT_NODE) && !xmlIsBlankNode(filter_node->children) &&
-											config_node->children && (config_node->children->type == XML_TEXT_NODE) && !xmlIsBlankNode(config_node->children)) {
-										/* get filter's text node content ignoring whitespaces */
-										if ((content2 = nc_clrwspace((char *) filter_node->children->content)) == NULL ||
-												(content1 = nc_clrwspace((char *) config_node->children->content)) == NULL) {
-											free(content1);
-											free(content2);
-											/* internal error - memory allocation failed, do not continue! */
-											return 0;
-										}
-										if (strcmp(content1, content2) != 0) {
-											free(content1);
-											free(content2);
-											filter_node = filter_node->next;
-											nomatch = 1;
-											continue;
-										}
-										free(content1);
-										free(content2);
-									}
-									sibling_in = 1;
-									break;
-								}
-								filter_node = filter_node->next;
-							}
-							content1 = NULL;
-
-							if (!filter_node) {
-								if (nomatch) {
-									/* instance does not follow restrictions */
-									return 0;
-								} else if (is_key(config_node->parent, config_node, keys)) {
-									/* go to the next sibling */
-									config_node = config_node->next;
-									continue;
-								}
-							}
+	for (node = first, fnode = level->nodes; node != NULL; node = node->next) {
+		if (node->type != XML_ELEMENT_NODE) {
+			/* comments are not part of the filter */
+			continue;
+		}
 
-							/* if this config node is not in filter, remove it */
-							if (sibling_selection && !sibling_in) {
-								if (filter_node) {
-									/* try another filter node */
-									filter_node = filter_node->next;
-									goto filter;
-								}
+		if ((fnode->name = (const char*) xmlDictLookup(dict, node->name, -1)) == NULL) {
+			return (EXIT_FAILURE);
+		}
 
-								delete = config_node;
-								config_node = config_node->next;
-								xmlUnlinkNode(delete);
-								xmlFreeNode(delete);
-							} else {
-								/* recursively process subtree filter */
-								if (filter_node && filter_node->children && (filter_node->children->type == XML_ELEMENT_NODE) && config_node->children && (config_node->children->type == XML_ELEMENT_NODE)) {
-									sibling_in = ncxml_subtree_filter(config_node->children, filter_node->children, keys);
-								}
-								if (sibling_selection && sibling_in == 0) {
-									if (filter_node) {
-										/* try another filter node */
-										filter_node = filter_node->next;
-										goto filter;
-									}
-
-									/* subtree is not a content of the filter output */
-									delete = config_node;
-
-									/* remeber where to go next */
-									config_node = config_node->next;
-
-									/* and remove unwanted subtree */
-									xmlUnlinkNode(delete);
-									xmlFreeNode(delete);
-								} else {
-									/* go to the next sibling */
-									config_node = config_node->next;
-								}
-							}
-						}
-					} else {
-						/* only content match node present - all sibling nodes stays */
-					}
-					break;
+		/* XML namespace wildcard mechanism:
+		 * 1) no namespace defined and namespace is inherited from message so it
+		 *    is NETCONF base namespace
+		 * 2) namespace is empty: xmlns=""
+		 */
+		if (node->ns != NULL && node->ns->href != NULL && strcmp((char*) node->ns->href, NC_NS_BASE10) != 0) {
+			for (s = (char*) node->ns->href; isspace(s[0]); ++s);
+			if (!strisempty(s) && (fnode->ns = (const char*) xmlDictLookup(dict, node->ns->href, -1)) == NULL) {
+				return (EXIT_FAILURE);
+			}
+		}
+
+		/* attribute match expressions */
+		for (attr = node->properties; attr != NULL; attr = attr->next) {
+			fnode->attr_count++;
+		}
+		if (fnode->attr_count) {
+			if ((fnode->attrs = malloc(2 * fnode->attr_count * sizeof(char*))) == NULL) {
+				ERROR("Memory allocation failed (%s:%d).", __FILE__, __LINE__);
+				fnode->attr_count = 0;
+				return (EXIT_FAILURE);
+			}
+			for (attr = node->properties, i = 0; attr != NULL; attr = attr->next, i += 2) {
+				value = xmlGetProp(node, attr->name);
+				fnode->attrs[i] = (const char*) xmlDictLookup(dict, attr->name, -1);
+				fnode->attrs[i + 1] = (const char*) xmlDictLookup(dict, value ? value : BAD_CAST "", -1);
+				xmlFree(value);
+				if (fnode->attrs[i] == NULL || fnode->attrs[i + 1] == NULL) {
+					return (EXIT_FAILURE);
 				}
 			}
-			config_node = config_node->next;
 		}
-		free(content1);
-	} else {
-		/* this is containment node (no sibling node is content match node */
-		filter_node = filter;
-		while (filter_node) {
-			if (!strcmp((char *)filter_node->name, (char *)config->name) &&
-					!nc_nscmp(filter_node, config) &&
-					!attrcmp(filter_node, config)) {
-				filter_in = 1;
+
+		/* the first significant child decides between content match and containment (selection) node */
+		for (child = node->children; child != NULL; child = child->next) {
+			if ((child->type == XML_TEXT_NODE && !xmlIsBlankNode(child)) || child->type == XML_ELEMENT_NODE) {
 				break;
 			}
-			filter_node = filter_node->next;
 		}
-
-		if (filter_in == 1) {
-			while (config->children && filter_node && filter_node->children && !xmlIsBlankNode(filter_node->children) &&
-					((filter_in = ncxml_subtree_filter(config->children, filter_node->children, keys)) == 0)) {
-				filter_node = filter_node->next;
-				while (filter_node) {
-					if (!strcmp((char *)filter_node->name, (char *)config->name) &&
-							!nc_nscmp(filter_node, config) &&
-							!attrcmp(filter_node, config)) {
-						filter_in = 1;
-						break;
-					}
-					filter_node = filter_node->next;
-				}
+		if (child != NULL && child->type == XML_TEXT_NODE) {
+			if ((fnode->content = filter_dict_trim(dict, (char*) child->content)) == NULL) {
+				return (EXIT_FAILURE);
 			}
-			if (filter_in == 0) {
-				/* subtree is not a content of the filter output */
-				delete = config->children;
-				xmlUnlinkNode(delete);
-				xmlFreeNode(delete);
-				delete2 = config;
+			if (level->content == -1) {
+				level->content = fnode - level->nodes;
 			}
+			filter_compile_level(dict, NULL, &fnode->children);
 		} else {
-			delete2 = config;
-		}
-		/* filter next sibling node */
-		if (config->next != NULL) {
-			if (ncxml_subtree_filter(config->next, filter, keys) == 0) {
-				delete = config->next;
-				xmlUnlinkNode(delete);
-				xmlFreeNode(delete);
-			} else {
-				filter_in = 1;
+			level->content_only = 0;
+			if (filter_compile_level(dict, child, &fnode->children) != EXIT_SUCCESS) {
+				return (EXIT_FAILURE);
 			}
 		}
-		if (delete2) {
-			xmlUnlinkNode(delete2);
-			xmlFreeNode(delete2);
-		}
+
+		fnode++;
 	}
 
-	return filter_in;
+	return (EXIT_SUCCESS);
 }
 
-int ncxml_filter(xmlNodePtr old, const struct nc_filter* filter, xmlNodePtr *new, const xmlDocPtr data_model)
+static struct nc_filter_compiled* filter_compile(xmlNodePtr filter)
 {
-	xmlDocPtr result, data_filtered[2] = {NULL, NULL};
-	xmlNodePtr filter_item, node;
-	keyList keys;
-	int ret = EXIT_FAILURE;
+	struct nc_filter_compiled* compiled;
 
-	if (new == NULL || old == NULL || filter == NULL) {
-		return EXIT_FAILURE;
+	if ((compiled = calloc(1, sizeof(struct nc_filter_compiled))) == NULL ||
+			(compiled->dict = xmlDictCreate()) == NULL) {
+		ERROR("Memory allocation failed (%s:%d).", __FILE__, __LINE__);
+		free(compiled);
+		return (NULL);
 	}
 
-	switch (filter->type) {
-	case NC_FILTER_SUBTREE:
-		if (filter->subtree_filter == NULL) {
-			ERROR("%s: invalid filter (%s:%d).", __func__, __FILE__, __LINE__);
-			return EXIT_FAILURE;
-		}
+	if (filter_compile_level(compiled->dict, filter->children, &compiled->top) != EXIT_SUCCESS) {
+		ERROR("%s: compiling the subtree filter failed.", __func__);
+		ncxml_filter_compiled_free(compiled);
+		return (NULL);
+	}
 
-		/* get all keys from data model */
-		keys = get_keynode_list(data_model);
+	return (compiled);
+}
 
-		data_filtered[0] = xmlNewDoc(BAD_CAST "1.0");
-		data_filtered[1] = xmlNewDoc(BAD_CAST "1.0");
-		for (filter_item = filter->subtree_filter->children; filter_item != NULL; filter_item = filter_item->next) {
-			xmlAddChildList((xmlNodePtr)(data_filtered[0]), xmlCopyNodeList(old));
+int ncxml_filter_compile(struct nc_filter* filter)
+{
+	if (filter == NULL || filter->type != NC_FILTER_SUBTREE || filter->subtree_filter == NULL) {
+		return (EXIT_FAILURE);
+	}
 
-			/* modify filter doc to deny ncxml_subtree_filter processing
-			 * siblings that are (on this top level) meaningless and they
-			 * will be processed separatelly in the next run of the loop.
-			 */
-			node = filter_item->next;
-			filter_item->next = NULL;
-			ncxml_subtree_filter(data_filtered[0]->children, filter_item, keys);
-			/* revert change made to the filter doc */
-			filter_item->next = node;
+	if (filter->compiled == NULL && (filter->compiled = filter_compile(filter->subtree_filter)) == NULL) {
+		return (EXIT_FAILURE);
+	}
 
-			if (data_filtered[1]->children == NULL) {
-				/* there are no data so far */
-				if (data_filtered[0]->children != NULL) {
-					/* we have some result, move it to [1] */
-					node = data_filtered[0]->children;
-					xmlUnlinkNode(node);
-					xmlDocSetRootElement(data_filtered[1], node);
-				}
-			} else if (data_filtered[0]-> children != NULL) {
-				/* there are some data already filtered */
-				/* and we have some new data, so merge them */
-				if (data_model != NULL) {
-					result = ncxml_merge(data_filtered[0], data_filtered[1], data_model);
+	return (EXIT_SUCCESS);
+}
+
+/**
+ * \brief compare the node name, namespace and properties with the filter node
+ *
+ * \param fnode         compiled filter node
+ * \param node          compared node
+ *
+ * \return              1 if the node matches, 0 otherwise
+ */
+static int filter_node_match(const struct nc_filter_node* fnode, xmlNodePtr node)
+{
+	xmlChar *value;
+	int i;
+
+	if (strcmp(fnode->name, (char *) node->name) ||
+			(fnode->ns != NULL && (node->ns == NULL || strcmp(fnode->ns, (char *) node->ns->href)))) {
+		return 0;
+	}
+
+	for (i = 0; i < 2 * fnode->attr_count; i += 2) {
+		if ((value = xmlGetProp(node, BAD_CAST fnode->attrs[i])) == NULL) {
+			return 0;
+		} else if (strcmp(fnode->attrs[i + 1], (char *) value)) {
+			xmlFree(value);
+			return 0;
+		}
+		xmlFree(value);
+	}
+
+	return 1;
+}
+
+/**
+ * \brief compare the node's content without leading and trailing spaces with
+ * the content of the content match node
+ *
+ * \return              0 if the contents are the same, non-zero otherwise
+ */
+static int filter_content_cmp(const char* content, const xmlChar* node_content)
+{
+	int len;
+
+	if (node_content == NULL) {
+		return 1;
+	}
+
+	while (isspace(node_content[0])) {
+		++node_content;
+	}
+	for (len = strlen((char *) node_content); len && isspace(node_content[len - 1]); --len);
+
+	return ((int) strlen(content) != len || strncmp(content, (char *) node_content, len));
+}
+
+/**
+ * \brief NETCONF subtree filtering, stolen from old old netopeer
+ *
+ * \param config        pointer to xmlNode tree to filter
+ * \param filter        compiled filter level (sibling set) to apply
+ * \param keys          compiled list keys of the data model
+ *
+ * \return              1 if config satisfies the output filter, 0 otherwise
+ */
+static int ncxml_subtree_filter(xmlNodePtr config, const struct nc_filter_level* filter, keyList keys)
+{
+	xmlNodePtr config_node, delete;
+	const struct nc_filter_node* filter_node;
+	const struct model_list_keys* list = NULL;
+	int i, k, list_known = 0;
+	int nomatch = 0;
+	int filter_in = 0, sibling_in = 0, sibling_selection = 0;
+
+	if (filter->content != -1) {
+
+		/* 0 means that all the sibling nodes will be in the filter result - this is a default
+		 * behavior when there are no selection or containment nodes in the filter sibling set.
+		 * If 1 is set, sibling nodes for the filter result will be selected according to the
+		 * rules in RFC 6241, sec. 6.2.5
+		 */
+		filter_node = &filter->nodes[filter->content];
+
+		/* try to find required node */
+		for (config_node = config; config_node && config_node->children; config_node = config_node->next) {
+			if (!filter_node_match(filter_node, config_node) ||
+					filter_content_cmp(filter_node->content, config_node->children->content)) {
+				continue;
+			}
+
+			/* we have the matching node, now decide what to do */
+			filter_in = 1;
+			if (filter->count == 1) {
+				/* only content match node present - all sibling nodes stays */
+				break;
+			}
+
+			/* if all filter sibling nodes are content match nodes, no config sibling node will be removed */
+			sibling_selection = !filter->content_only;
+
+			/* select and remove all unwanted nodes */
+			config_node = config;
+			while (config_node) {
+				/* init */
+				sibling_in = 0;
+
+				/* go to the first filter sibing node */
+				i = 0;
+
+filter:
+				/* pass all filter sibling nodes */
+				for (; i < filter->count; i++) {
+					filter_node = &filter->nodes[i];
+					if (filter_node_match(filter_node, config_node)) {
+						/* content match node check */
+						if (filter_node->content && config_node->children && (config_node->children->type == XML_TEXT_NODE) &&
+								!xmlIsBlankNode(config_node->children) &&
+								filter_content_cmp(filter_node->content, config_node->children->content)) {
+							nomatch = 1;
+							continue;
+						}
+						sibling_in = 1;
+						break;
+					}
+				}
+
+				if (i == filter->count) {
+					if (nomatch) {
+						/* instance does not follow restrictions */
+						return 0;
+					}
+
+					/* keys of the list instance are always present */
+					if (!list_known) {
+						list = get_list_keys(keys, config_node->parent);
+						list_known = 1;
+					}
+					for (k = 0; list != NULL && k < list->count; k++) {
+						if (xmlStrcmp(BAD_CAST list->names[k], config_node->name) == 0) {
+							break;
+						}
+					}
+					if (list != NULL && k < list->count) {
+						/* go to the next sibling */
+						config_node = config_node->next;
+						continue;
+					}
+				}
+
+				/* if this config node is not in filter, remove it */
+				if (sibling_selection && !sibling_in) {
+					delete = config_node;
+					config_node = config_node->next;
+					xmlUnlinkNode(delete);
+					xmlFreeNode(delete);
+				} else {
+					/* recursively process subtree filter */
+					if (i < filter->count && filter_node->children.count && config_node->children && (config_node->children->type == XML_ELEMENT_NODE)) {
+						sibling_in = ncxml_subtree_filter(config_node->children, &filter_node->children, keys);
+					}
+					if (sibling_selection && sibling_in == 0) {
+						if (i < filter->count) {
+							/* try another filter node */
+							i++;
+							goto filter;
+						}
+
+						/* subtree is not a content of the filter output */
+						delete = config_node;
+
+						/* remeber where to go next */
+						config_node = config_node->next;
+
+						/* and remove unwanted subtree */
+						xmlUnlinkNode(delete);
+						xmlFreeNode(delete);
+					} else {
+						/* go to the next sibling */
+						config_node = config_node->next;
+					}
+				}
+			}
+			break;
+		}
+
+		return filter_in;
+	}
+
+	/* this is containment node (no sibling node is content match node), filter all the config siblings */
+	while (config) {
+		sibling_in = 0;
+		for (i = 0; i < filter->count; i++) {
+			if (filter_node_match(&filter->nodes[i], config)) {
+				sibling_in = 1;
+				break;
+			}
+		}
+
+		while (sibling_in && config->children && filter->nodes[i].children.count &&
+				((sibling_in = ncxml_subtree_filter(config->children, &filter->nodes[i].children, keys)) == 0)) {
+			/* try another filter node */
+			for (i++; i < filter->count; i++) {
+				if (filter_node_match(&filter->nodes[i], config)) {
+					sibling_in = 1;
+					break;
+				}
+			}
+		}
+
+		delete = config;
+		config = config->next;
+		if (sibling_in) {
+			filter_in = 1;
+		} else {
+			/* subtree is not a content of the filter output */
+			xmlUnlinkNode(delete);
+			xmlFreeNode(delete);
+		}
+	}
+
+	return filter_in;
+}
+
+int ncxml_filter(xmlNodePtr old, const struct nc_filter* filter, xmlNodePtr *new, const xmlDocPtr data_model, keyList keys)
+{
+	xmlDocPtr result, data_filtered[2] = {NULL, NULL};
+	xmlNodePtr node;
+	struct nc_filter_compiled *compiled;
+	struct nc_filter_level item;
+	int i, ret = EXIT_FAILURE;
+
+	if (new == NULL || old == NULL || filter == NULL) {
+		return EXIT_FAILURE;
+	}
+
+	switch (filter->type) {
+	case NC_FILTER_SUBTREE:
+		if (filter->subtree_filter == NULL) {
+			ERROR("%s: invalid filter (%s:%d).", __func__, __FILE__, __LINE__);
+			return EXIT_FAILURE;
+		}
+
+		/* use the filter compiled for the request if possible */
+		if ((compiled = filter->compiled) == NULL && (compiled = filter_compile(filter->subtree_filter)) == NULL) {
+			return EXIT_FAILURE;
+		}
+
+		data_filtered[0] = xmlNewDoc(BAD_CAST "1.0");
+		data_filtered[1] = xmlNewDoc(BAD_CAST "1.0");
+		for (i = 0; i < compiled->top.count; i++) {
+			/* process the top level filter nodes separately, their siblings
+			 * are (on this top level) meaningless
+			 */
+			item.nodes = &compiled->top.nodes[i];
+			item.count = 1;
+			item.content = (item.nodes->content != NULL) ? 0 : -1;
+			item.content_only = (item.content == 0);
+
+			if (item.content == -1) {
+				/* containment node selects only the matching data subtrees, do not copy the others */
+				for (node = old; node != NULL; node = node->next) {
+					if (filter_node_match(item.nodes, node)) {
+						xmlAddChild((xmlNodePtr)(data_filtered[0]), xmlDocCopyNode(node, data_filtered[0], 1));
+					}
+				}
+			} else {
+				xmlAddChildList((xmlNodePtr)(data_filtered[0]), xmlCopyNodeList(old));
+			}
+			if (data_filtered[0]->children == NULL) {
+				continue;
+			}
+
+			ncxml_subtree_filter(data_filtered[0]->children, &item, keys);
+
+			if (data_filtered[1]->children == NULL) {
+				/* there are no data so far */
+				if (data_filtered[0]->children != NULL) {
+					/* we have some result, move it to [1] */
+					node = data_filtered[0]->children;
+					xmlUnlinkNode(node);
+					xmlDocSetRootElement(data_filtered[1], node);
+				}
+			} else if (data_filtered[0]-> children != NULL) {
+				/* there are some data already filtered */
+				/* and we have some new data, so merge them */
+				if (data_model != NULL) {
+					result = ncxml_merge(data_filtered[0], data_filtered[1], data_model, keys);
 				} else {
 					result = data_filtered[1];
 					data_filtered[1] = NULL;
@@ -5335,11 +5536,7 @@ int ncxml_filter(xmlNodePtr old, const struct nc_filter* filter, xmlNodePtr *new
 			}
 		}
 
-		if (keys != NULL) {
-			keyListFree(keys);
-		}
-
-		if (filter->subtree_filter->children != NULL) {
+		if (compiled->top.count != 0) {
 			if(data_filtered[1] != NULL && data_filtered[1]->children != NULL) {
 				*new = xmlCopyNodeList(data_filtered[1]->children);
 			} else {
@@ -5350,6 +5547,9 @@ int ncxml_filter(xmlNodePtr old, const struct nc_filter* filter, xmlNodePtr *new
 		}
 		xmlFreeDoc(data_filtered[0]);
 		xmlFreeDoc(data_filtered[1]);
+		if (compiled != filter->compiled) {
+			ncxml_filter_compiled_free(compiled);
+		}
 		ret = EXIT_SUCCESS;
 		break;
 	default:
@@ -5360,17 +5560,6 @@ int ncxml_filter(xmlNodePtr old, const struct nc_filter* filter, xmlNodePtr *new
 	return ret;
 }
 
-API int ncds_rollback(ncds_id id)
-{
-	struct ncds_ds *datastore = datastores_get_ds(id);
-
-	if (datastore == NULL) {
-		return (EXIT_FAILURE);
-	}
-
-	return (datastore->func.rollback(datastore));
-}
-
 /**
  * @brief Check if source and target are same. If url is enabled, checks if source and target urls are same
  * @param rpc
@@ -5431,11 +5620,12 @@ static int ncds_is_conflict(const nc_rpc * rpc, const struct nc_session * sessio
 }
 
 /**
+ * \param[in] record Record of the edit-config changing the running datastore,
+ * NULL if the whole configuration could be changed.
  * \return NULL on success, error reply with error info else
  */
-static nc_reply* ncds_apply_transapi(struct ncds_ds* ds, const struct nc_session* session, xmlDocPtr old, NC_EDIT_ERROPT_TYPE erropt, nc_reply *reply)
+static nc_reply* ncds_apply_transapi(struct ncds_ds* ds, const struct nc_session* session, xmlDocPtr old, const struct edit_record* record, NC_EDIT_ERROPT_TYPE erropt, nc_reply *reply)
 {
-	char *new_data;
 	xmlDocPtr new;
 	xmlChar *config;
 	int ret;
@@ -5450,9 +5640,9 @@ static nc_reply* ncds_apply_transapi(struct ncds_ds* ds, const struct nc_session
 	}
 
 	/* find differences and call functions */
-	new_data = ds->func.getconfig(ds, session, NC_DATASTORE_RUNNING, &e);
-	new = read_datastore_data(ds->id, new_data);
-	free(new_data);
+	new = ncds_getconfig_doc(ds, session, NC_DATASTORE_RUNNING, &e);
+	nc_err_free(e);
+	e = NULL;
 
 	/* add default values */
 	ncdflt_default_values(new, ds->ext_model, NCWD_MODE_IMPL_TAGGED);
@@ -5477,7 +5667,7 @@ static nc_reply* ncds_apply_transapi(struct ncds_ds* ds, const struct nc_session
 		ncdflt_default_values(old, ds->ext_model, NCWD_MODE_IMPL_TAGGED);
 
 		/* perform TransAPI transactions */
-		ret = transapi_running_changed(ds, old, new, erropt, &e);
+		ret = transapi_running_changed(ds, old, new, record, erropt, &e);
 		if (ret) {
 			e_new = nc_err_new(NC_ERR_OP_FAILED);
 			if (e != NULL) {
@@ -5540,9 +5730,8 @@ static nc_reply* ncds_apply_transapi(struct ncds_ds* ds, const struct nc_session
  */
 static int rpc_get_prefilter(struct nc_filter **filter, const struct ncds_ds* ds, const nc_rpc* rpc, struct nc_filter* shared_filter)
 {
-	xmlNodePtr filter_node;
-	int retval = 1;
-	char* s;
+	const struct nc_filter_node* filter_node;
+	int retval = 1, i;
 
 	/* get filter if specified for this request */
 	if (shared_filter == NULL) {
@@ -5553,24 +5742,13 @@ static int rpc_get_prefilter(struct nc_filter **filter, const struct ncds_ds* ds
 
 	/* check root element according to the filter (if any) */
 	if (*filter != NULL && (*filter)->type == NC_FILTER_SUBTREE &&
-			ds->data_model && ds->data_model->ns) {
+			ds->data_model && ds->data_model->ns &&
+			(shared_filter == NULL ? ncxml_filter_compile(*filter) == EXIT_SUCCESS : (*filter)->compiled != NULL)) {
 		retval = 0;
-		for (filter_node = (*filter)->subtree_filter->children; filter_node != NULL; filter_node = filter_node->next) {
-			/* XML namespace wildcard mechanism:
-			 * 1) no namespace defined and namespace is inherited from message so it
-			 *    is NETCONF base namespace
-			 * 2) namespace is empty: xmlns=""
-			 */
-			s = NULL;
-			if (filter_node->ns == NULL || filter_node->ns->href == NULL ||
-					strcmp((char *)filter_node->ns->href, NC_NS_BASE10) == 0 ||
-					strlen(s = nc_clrwspace((char*)(filter_node->ns->href))) == 0) {
-				free(s);
-				return (1);
-			}
-			free(s);
-
-			if (filter_node->ns && xmlStrcmp(BAD_CAST ds->data_model->ns, filter_node->ns->href) == 0) {
+		for (i = 0; i < (*filter)->compiled->top.count; i++) {
+			filter_node = &(*filter)->compiled->top.nodes[i];
+			/* XML namespace wildcard mechanism was resolved when compiling the filter */
+			if (filter_node->ns == NULL || strcmp(ds->data_model->ns, filter_node->ns) == 0) {
 				return (1);
 			}
 		}
@@ -5585,6 +5763,156 @@ static int rpc_get_prefilter(struct nc_filter **filter, const struct ncds_ds* ds
 	return (retval);
 }
 
+/* bit of the datastore lock in the masks of ds_lock_targets(), 0 for non-standard datastores */
+#define DS_LOCK_BIT(target) (((target) >= NC_DATASTORE_RUNNING && (target) <= NC_DATASTORE_CANDIDATE) ? (1 << ((target) - NC_DATASTORE_RUNNING)) : 0)
+#define DS_LOCK_ALL 0x7
+
+/**
+ * @brief Get the datastores locked to perform the operation.
+ *
+ * @param[in] rpc NETCONF \<rpc\> message specifying the operation.
+ * @param[in] op Operation of the rpc.
+ * @param[out] rd Mask of the datastores only read by the operation.
+ * @param[out] wr Mask of the datastores modified by the operation.
+ */
+static void ds_lock_targets_get(const nc_rpc* rpc, NC_OP op, unsigned int* rd, unsigned int* wr)
+{
+	*rd = *wr = 0;
+
+	switch (op) {
+	case NC_OP_GET:
+		*rd = DS_LOCK_BIT(NC_DATASTORE_RUNNING);
+		break;
+	case NC_OP_GETCONFIG:
+	case NC_OP_VALIDATE:
+		*rd = DS_LOCK_BIT(nc_rpc_get_source(rpc));
+		break;
+	case NC_OP_LOCK:
+	case NC_OP_UNLOCK:
+		*wr = DS_LOCK_BIT(nc_rpc_get_target(rpc));
+		break;
+	case NC_OP_COPYCONFIG:
+	case NC_OP_EDITCONFIG:
+	case NC_OP_DELETECONFIG:
+	case NC_OP_COMMIT:
+	case NC_OP_DISCARDCHANGES:
+		/*
+		 * the datastore keeps a single rollback backup for all its targets,
+		 * so operations storing it (and possibly rolling back) must not run
+		 * concurrently with any other access to the datastore
+		 */
+		*wr = DS_LOCK_ALL;
+		break;
+	case NC_OP_UNKNOWN:
+		/* transAPI RPC callbacks may access any datastore */
+		*wr = DS_LOCK_ALL;
+		break;
+	default:
+		break;
+	}
+	/* write lock covers the read access */
+	*rd &= ~(*wr);
+}
+
+/**
+ * @brief Lock the datastores of the masks, always in the same order to avoid deadlocks.
+ *
+ * @return 0 on success, the error number of the failed lock else, nothing is
+ * left locked then.
+ */
+static int ds_lock_targets(struct ncds_ds* ds, unsigned int rd, unsigned int wr)
+{
+	int i, ret = 0;
+
+	for (i = 0; i < 3; i++) {
+		if (wr & (1 << i)) {
+			ret = pthread_rwlock_wrlock(&ds->lock[i]);
+		} else if (rd & (1 << i)) {
+			ret = pthread_rwlock_rdlock(&ds->lock[i]);
+		}
+		if (ret != 0) {
+			/* release the locks taken before the failed one */
+			while (--i >= 0) {
+				if ((rd | wr) & (1 << i)) {
+					pthread_rwlock_unlock(&ds->lock[i]);
+				}
+			}
+			return (ret);
+		}
+	}
+
+	return (0);
+}
+
+/**
+ * @brief Unlock the datastores locked by ds_lock_targets().
+ */
+static void ds_unlock_targets(struct ncds_ds* ds, unsigned int rd, unsigned int wr)
+{
+	int i;
+
+	for (i = 2; i >= 0; i--) {
+		if ((rd | wr) & (1 << i)) {
+			pthread_rwlock_unlock(&ds->lock[i]);
+		}
+	}
+}
+
+/**
+ * @brief Unlock all the targets of the datastores of the list up to the end
+ * item (not included), locked by ds_lock_all().
+ */
+static void ds_unlock_all(struct ncds_ds_list* end)
+{
+	struct ncds_ds_list* ds;
+
+	for (ds = ncds.datastores; ds != end; ds = ds->next) {
+		ds_unlock_targets(ds->datastore, 0, DS_LOCK_ALL);
+	}
+}
+
+/**
+ * @brief Lock all the targets of all the datastores, in the order of the list
+ * to avoid deadlocks among the callers.
+ *
+ * @return 0 on success, the error number of the failed lock else, nothing is
+ * left locked then.
+ */
+static int ds_lock_all(void)
+{
+	struct ncds_ds_list* ds;
+	int ret;
+
+	for (ds = ncds.datastores; ds != NULL; ds = ds->next) {
+		if ((ret = ds_lock_targets(ds->datastore, 0, DS_LOCK_ALL)) != 0) {
+			ds_unlock_all(ds);
+			return (ret);
+		}
+	}
+
+	return (0);
+}
+
+API int ncds_rollback(ncds_id id)
+{
+	struct ncds_ds *datastore = datastores_get_ds(id);
+	int ret;
+
+	if (datastore == NULL) {
+		return (EXIT_FAILURE);
+	}
+
+	/* the rollback backup is shared by all the targets of the datastore */
+	if ((ret = ds_lock_targets(datastore, 0, DS_LOCK_ALL)) != 0) {
+		ERROR("Failed to lock datastore (%s).", strerror(ret));
+		return (EXIT_FAILURE);
+	}
+	ret = datastore->func.rollback(datastore);
+	ds_unlock_targets(datastore, 0, DS_LOCK_ALL);
+
+	return (ret);
+}
+
 /**
  * @ingroup store
  * @brief Perform the requested RPC operation on the datastore.
@@ -5594,6 +5922,10 @@ static int rpc_get_prefilter(struct nc_filter **filter, const struct ncds_ds* ds
  * @param[in] session NETCONF session (a dummy session is acceptable) where the
  * \<rpc\> came from. Capabilities checks are done according to this session.
  * @param[in] rpc NETCONF \<rpc\> message specifying requested operation.
+ * @param[in] shared_filter Filter of the rpc compiled by the caller, NULL if
+ * not available.
+ * @param[in] locked Flag that the caller already holds all the locks of the
+ * datastore(s), see ds_lock_all().
  * @return NULL in case of a non-NC_RPC_DATASTORE_* operation type or invalid
  * parameter session or rpc, else \<rpc-reply\> with \<ok\>, \<data\> or
  * \<rpc-error\> according to the type and the result of the requested
@@ -5601,7 +5933,7 @@ static int rpc_get_prefilter(struct nc_filter **filter, const struct ncds_ds* ds
  * datastore (e.g. the namespace does not match), NCDS_RPC_NOT_APPLICABLE
  * is returned.
  */
-static nc_reply* ncds_apply_rpc(ncds_id id, const struct nc_session* session, const nc_rpc* rpc, struct nc_filter* shared_filter)
+static nc_reply* ncds_apply_rpc(ncds_id id, const struct nc_session* session, const nc_rpc* rpc, struct nc_filter* shared_filter, int locked)
 {
 	struct nc_err* e = NULL;
 	struct ncds_ds* ds = NULL;
@@ -5615,7 +5947,6 @@ static nc_reply* ncds_apply_rpc(ncds_id id, const struct nc_session* session, co
 	xmlNodePtr aux_node, node;
 	NC_OP op;
 	xmlDocPtr old = NULL;
-	char * old_data = NULL;
 	NC_DATASTORE source_ds = 0, target_ds = 0;
 	struct nacm_rpc *nacm_aux;
 	nc_rpc *rpc_aux;
@@ -5626,6 +5957,7 @@ static nc_reply* ncds_apply_rpc(ncds_id id, const struct nc_session* session, co
 	const char *data_ns = NULL;
 	char *aux = NULL;
 	NC_EDIT_ERROPT_TYPE erropt;
+	unsigned int lock_rd, lock_wr;
 #ifndef DISABLE_VALIDATION
 	NC_EDIT_TESTOPT_TYPE testopt;
 #endif
@@ -5657,27 +5989,38 @@ process_datastore:
 	op = nc_rpc_get_op(rpc);
 	/* if transapi used AND operation will affect running repository => store current running content */
 
-	i = pthread_mutex_lock(&ds->lock);
-	if (i != 0) {
-		ERROR("Failed to lock datastore (%s).", strerror(errno));
-		return (NULL);
+	/* lock only the datastores touched by the operation */
+	ds_lock_targets_get(rpc, op, &lock_rd, &lock_wr);
+	if (locked) {
+		/* nothing to lock (and unlock) here */
+		lock_rd = lock_wr = 0;
+	} else if (ds->type == NCDS_TYPE_CUSTOM && (lock_rd | lock_wr)) {
+		/* functions of the custom datastores are not required to be reentrant */
+		lock_rd = 0;
+		lock_wr = DS_LOCK_ALL;
+	}
+	if ((i = ds_lock_targets(ds, lock_rd, lock_wr)) != 0) {
+		ERROR("Failed to lock datastore (%s).", strerror(i));
+		return (nc_reply_error(nc_err_new(NC_ERR_OP_FAILED)));
 	}
 
 	if (ds->transapis != NULL
 		&& (op == NC_OP_COMMIT || op == NC_OP_COPYCONFIG || (op == NC_OP_EDITCONFIG && (nc_rpc_get_testopt(rpc) != NC_EDIT_TESTOPT_TEST))) &&
 		(nc_rpc_get_target(rpc) == NC_DATASTORE_RUNNING)) {
 
-		old_data = ds->func.getconfig(ds, session, NC_DATASTORE_RUNNING, &e);
-		old = read_datastore_data(ds->id, old_data);
+		old = ncds_getconfig_doc(ds, session, NC_DATASTORE_RUNNING, &e);
 		if (old == NULL) {/* cannot get or parse data */
-			pthread_mutex_unlock(&ds->lock);
-			if (e == NULL) { /* error not set */
-				e = nc_err_new(NC_ERR_OP_FAILED);
+			ds_unlock_targets(ds, lock_rd, lock_wr);
+			if (nc_err_get(e, NC_ERR_PARAM_MSG) == NULL) { /* error message not set */
 				nc_err_set(e, NC_ERR_PARAM_MSG, "TransAPI: Failed to get data from RUNNING datastore.");
 			}
 			return nc_reply_error(e);
 		}
-		free(old_data);
+
+		if (op == NC_OP_EDITCONFIG) {
+			/* let edit_config() record the touched nodes to limit the search for the changes */
+			ds->running_edit = edit_record_new(ds->ext_model_keys);
+		}
 	}
 
 	filter = NULL;
@@ -5732,19 +6075,31 @@ process_datastore:
 			break;
 		}
 
-		if ((data = ds->func.getconfig(ds, session, NC_DATASTORE_RUNNING, &e)) == NULL ) {
-			if (e == NULL ) {
-				ERROR("%s: Failed to get data from the datastore (%s:%d).", __func__, __FILE__, __LINE__);
-				e = nc_err_new(NC_ERR_OP_FAILED);
+		if (ds->get_state_xml == NULL && ds->get_state != NULL) {
+			/* status data callback needs the configuration data as string */
+			if ((data = ds->func.getconfig(ds, session, NC_DATASTORE_RUNNING, &e)) == NULL ) {
+				if (e == NULL ) {
+					ERROR("%s: Failed to get data from the datastore (%s:%d).", __func__, __FILE__, __LINE__);
+					e = nc_err_new(NC_ERR_OP_FAILED);
+				}
+				break;
+			}
+			doc1 = read_datastore_data(ds->id, data);
+		} else {
+			data = NULL;
+			if ((doc1 = ncds_getconfig_doc(ds, session, NC_DATASTORE_RUNNING, &e)) == NULL) {
+				break;
 			}
-			break;
 		}
 
+		/* state data retrieval and filtering do not block the datastore */
+		ds_unlock_targets(ds, lock_rd, lock_wr);
+		lock_rd = lock_wr = 0;
+
 		if (ds->get_state_xml != NULL || ds->get_state != NULL) {
 			/* caller provided callback function to retrieve status data */
 
-			/* convert configuration data into XML structure */
-			doc1 = read_datastore_data(ds->id, data);
+			/* configuration data in XML structure */
 			if (doc1 == NULL || doc1->children == NULL) {
 				/* empty */
 				xmlFreeDoc(doc1);
@@ -5779,7 +6134,7 @@ process_datastore:
 
 			/* merge status and config data */
 			/* if merge fail (probably one of docs NULL)*/
-			if ((doc_merged = ncxml_merge(doc1, doc2, ds->ext_model)) == NULL) {
+			if ((doc_merged = ncxml_merge(doc1, doc2, ds->ext_model, ds->ext_model_keys)) == NULL) {
 				/* use only config if not null*/
 				if (doc1 != NULL) {
 					doc_merged = doc1;
@@ -5800,7 +6155,7 @@ process_datastore:
 				xmlFreeDoc(doc2);
 			}
 		} else {
-			doc_merged = read_datastore_data(ds->id, data);
+			doc_merged = doc1;
 		}
 		free(data);
 
@@ -5823,7 +6178,7 @@ process_datastore:
 		node = NULL;
 		if (doc_merged->children != NULL) {
 			if (filter != NULL) {
-				if (ncxml_filter(doc_merged->children, filter, &node, ds->ext_model) != 0) {
+				if (ncxml_filter(doc_merged->children, filter, &node, ds->ext_model, ds->ext_model_keys) != 0) {
 					ERROR("Filter failed.");
 					e = nc_err_new(NC_ERR_BAD_ELEM);
 					nc_err_set(e, NC_ERR_PARAM_TYPE, "protocol");
@@ -5849,23 +6204,15 @@ process_datastore:
 			break;
 		}
 
-		if ((data = ds->func.getconfig(ds, session, nc_rpc_get_source(rpc), &e)) == NULL) {
-			if (e == NULL) {
-				ERROR ("%s: Failed to get data from the datastore (%s:%d).", __func__, __FILE__, __LINE__);
-				e = nc_err_new(NC_ERR_OP_FAILED);
-			}
-			break;
-		}
-		doc_merged = read_datastore_data(ds->id, data);
-		free(data);
-
-		if (doc_merged == NULL) {
+		if ((doc_merged = ncds_getconfig_doc(ds, session, nc_rpc_get_source(rpc), &e)) == NULL) {
 			ERROR("Reading configuration datastore failed.");
-			e = nc_err_new(NC_ERR_OP_FAILED);
-			nc_err_set(e, NC_ERR_PARAM_MSG, "Invalid datastore content.");
 			break;
 		}
 
+		/* filtering works with the copy of the datastore content */
+		ds_unlock_targets(ds, lock_rd, lock_wr);
+		lock_rd = lock_wr = 0;
+
 		/* process default values */
 		if (ds && ds->data_model->xml) {
 			ncdflt_default_values(doc_merged, ds->ext_model, rpc->with_defaults);
@@ -5878,7 +6225,7 @@ process_datastore:
 		node = NULL;
 		if (doc_merged->children != NULL) {
 			if (filter != NULL) {
-				if (ncxml_filter(doc_merged->children, filter, &node, ds->ext_model) != 0) {
+				if (ncxml_filter(doc_merged->children, filter, &node, ds->ext_model, ds->ext_model_keys) != 0) {
 					ERROR("Filter failed.");
 					e = nc_err_new(NC_ERR_BAD_ELEM);
 					nc_err_set(e, NC_ERR_PARAM_TYPE, "protocol");
@@ -6180,22 +6527,8 @@ apply_editcopyconfig:
 						}
 					}
 
-					data = ds->func.getconfig(ds, session, source_ds, &e);
-					if (data == NULL ) {
-						if (e == NULL ) {
-							ERROR("%s: Failed to get data from the datastore (%s:%d).", __func__, __FILE__, __LINE__);
-							e = nc_err_new(NC_ERR_OP_FAILED);
-						}
-						xmlFreeDoc(doc1);
-						break;
-					}
-					doc2 = read_datastore_data(ds->id, data);
-					free(data);
+					doc2 = ncds_getconfig_doc(ds, session, source_ds, &e);
 					if (doc2 == NULL) {
-						if (e == NULL ) {
-							ERROR("%s: Unable to process datastore data (%s:%d).", __func__, __FILE__, __LINE__);
-							e = nc_err_new(NC_ERR_OP_FAILED);
-						}
 						xmlFreeDoc(doc1);
 						break;
 					}
@@ -6379,7 +6712,7 @@ apply_editcopyconfig:
 		break;
 	default:
 		ERROR("%s: unsupported NETCONF operation requested.", __func__);
-		pthread_mutex_unlock(&ds->lock);
+		ds_unlock_targets(ds, lock_rd, lock_wr);
 		return (nc_reply_error (nc_err_new (NC_ERR_OP_NOT_SUPPORTED)));
 		break;
 	}
@@ -6415,7 +6748,7 @@ apply_editcopyconfig:
 				}
 				xmlFreeDoc(doc_merged);
 				if (!reply) {
-					return nc_reply_error(nc_err_new(NC_ERR_OP_FAILED));
+					reply = nc_reply_error(nc_err_new(NC_ERR_OP_FAILED));
 				}
 			} else {
 				reply = nc_reply_ok();
@@ -6439,15 +6772,17 @@ apply_editcopyconfig:
 			erropt = NC_EDIT_ERROPT_ROLLBACK;
 		}
 
-		if ((new_reply = ncds_apply_transapi(ds, session, old, erropt, NULL)) != NULL) {
+		if ((new_reply = ncds_apply_transapi(ds, session, old, ds->running_edit, erropt, NULL)) != NULL) {
 			nc_reply_free(reply);
 			reply = new_reply;
 		}
 	}
 	xmlFreeDoc (old);
 	old = NULL;
+	edit_record_free(ds->running_edit);
+	ds->running_edit = NULL;
 
-	pthread_mutex_unlock(&ds->lock);
+	ds_unlock_targets(ds, lock_rd, lock_wr);
 
 	if (id == NCDS_INTERNAL_ID) {
 		if (old_reply == NULL) {
@@ -6503,11 +6838,139 @@ static char* serialize_cpblts(const struct nc_cpblts *capabilities)
 	return(retval);
 }
 
+API void ncds_set_rpc2all_workers(unsigned int count)
+{
+	rpc2all_workers = count;
+}
+
+/**
+ * @brief Datastores processed by the threads of ncds_apply_rpc2all_parallel().
+ */
+struct rpc2all_work {
+	struct ncds_ds** ds;
+	nc_reply** replies;
+	int count;
+	int next;
+	const struct nc_session* session;
+};
+
+/**
+ * @brief Thread of ncds_apply_rpc2all_parallel(), each one uses its own copy
+ * of the rpc since it is modified while processed. The compiled filter is
+ * shared.
+ */
+struct rpc2all_worker {
+	struct rpc2all_work* work;
+	const nc_rpc* rpc;
+	struct nc_filter* filter;
+	pthread_t thread;
+};
+
+static void* ncds_apply_rpc2all_worker(void* arg)
+{
+	struct rpc2all_worker* worker = (struct rpc2all_worker*)arg;
+	struct rpc2all_work* work = worker->work;
+	int i;
+
+	while ((i = __atomic_fetch_add(&(work->next), 1, __ATOMIC_RELAXED)) < work->count) {
+		work->replies[i] = ncds_apply_rpc(work->ds[i]->id, work->session, worker->rpc, worker->filter, 0);
+	}
+
+	return (NULL);
+}
+
+/**
+ * @brief Apply the read operation on the datastores processed by ncds_apply_rpc2all()
+ * using up to rpc2all_workers threads.
+ *
+ * @param[in] session NETCONF session where the rpc came from.
+ * @param[in] rpc NETCONF \<rpc\> message with \<get\> or \<get-config\>.
+ * @param[in] shared_filter Filter of the rpc.
+ * @param[out] count Number of the replies.
+ * @return Replies of the datastores in the order of the datastores list, NULL
+ * if the datastores are supposed to be processed sequentially.
+ */
+static nc_reply** ncds_apply_rpc2all_parallel(const struct nc_session* session, const nc_rpc* rpc, struct nc_filter* shared_filter, int* count)
+{
+	struct ncds_ds_list* ds_iter;
+	struct rpc2all_work work;
+	struct rpc2all_worker* workers;
+	int i, ret, n = 0;
+
+	for (ds_iter = ncds.datastores; ds_iter != NULL; ds_iter = ds_iter->next) {
+		if (ds_iter->datastore->id <= 0 || ds_iter->datastore->id >= internal_ds_count) {
+			n++;
+		}
+	}
+	if (n < 2) {
+		return (NULL);
+	}
+
+	work.ds = malloc(n * sizeof(struct ncds_ds*));
+	work.replies = calloc(n, sizeof(nc_reply*));
+	workers = calloc((rpc2all_workers < (unsigned int) n) ? rpc2all_workers : (unsigned int) n, sizeof(struct rpc2all_worker));
+	if (work.ds == NULL || work.replies == NULL || workers == NULL) {
+		ERROR("Memory allocation failed (%s:%d).", __FILE__, __LINE__);
+		free(work.ds);
+		free(work.replies);
+		free(workers);
+		return (NULL);
+	}
+	for (i = 0, ds_iter = ncds.datastores; ds_iter != NULL; ds_iter = ds_iter->next) {
+		if (ds_iter->datastore->id <= 0 || ds_iter->datastore->id >= internal_ds_count) {
+			work.ds[i++] = ds_iter->datastore;
+		}
+	}
+	work.count = n;
+	work.next = 0;
+	work.session = session;
+
+	/* the calling thread is the first worker */
+	workers[0].work = &work;
+	workers[0].rpc = rpc;
+	workers[0].filter = shared_filter;
+	for (i = 1; i < n && (unsigned int) i < rpc2all_workers; i++) {
+		workers[i].work = &work;
+		if ((workers[i].rpc = nc_rpc_dup(rpc)) == NULL) {
+			break;
+		}
+		workers[i].filter = shared_filter;
+		if ((ret = pthread_create(&(workers[i].thread), NULL, ncds_apply_rpc2all_worker, &workers[i])) != 0) {
+			WARN("%s: creating a thread failed (%s).", __func__, strerror(ret));
+			nc_rpc_free((nc_rpc*)workers[i].rpc);
+			break;
+		}
+	}
+	ncds_apply_rpc2all_worker(&workers[0]);
+	while (--i > 0) {
+		pthread_join(workers[i].thread, NULL);
+		nc_rpc_free((nc_rpc*)workers[i].rpc);
+	}
+
+	free(workers);
+	free(work.ds);
+	*count = n;
+	return (work.replies);
+}
+
+/**
+ * @brief Free the replies of ncds_apply_rpc2all_parallel() not used by ncds_apply_rpc2all().
+ */
+static void ncds_apply_rpc2all_replies_free(nc_reply** replies, int from, int count)
+{
+	for (; from < count; from++) {
+		if (replies[from] != NULL && replies[from] != NCDS_RPC_NOT_APPLICABLE) {
+			nc_reply_free(replies[from]);
+		}
+	}
+	free(replies);
+}
+
 API nc_reply* ncds_apply_rpc2all(struct nc_session* session, const nc_rpc* rpc, ncds_id* ids[])
 {
 	struct ncds_ds_list* ds, *ds_rollback;
 	nc_reply *old_reply = NULL, *new_reply = NULL, *reply = NULL;
-	int id_i = 0, transapi = 0;
+	int id_i = 0, transapi = 0, locked = 0, ret;
 	char *op_name, *op_namespace, *data;
 	xmlDocPtr old;
 	NC_OP op;
@@ -6516,6 +6979,8 @@ API nc_reply* ncds_apply_rpc2all(struct nc_session* session, const nc_rpc* rpc,
 	NC_RPC_TYPE req_type;
 	struct nc_err *e = NULL;
 	struct nc_filter *shared_filter = NULL;
+	nc_reply **replies = NULL;
+	int replies_count = 0, replies_i = 0;
 
 	if (rpc == NULL || session == NULL) {
 		ERROR("%s: invalid parameter %s", __func__, (rpc==NULL)?"rpc":"session");
@@ -6554,12 +7019,32 @@ API nc_reply* ncds_apply_rpc2all(struct nc_session* session, const nc_rpc* rpc,
 		/* no break */
 	case NC_OP_GETCONFIG:
 		shared_filter = nc_rpc_get_filter(rpc);
+		/* compile the filter once for all the datastores */
+		if (shared_filter != NULL && shared_filter->type == NC_FILTER_SUBTREE) {
+			ncxml_filter_compile(shared_filter);
+		}
 		break;
 	default:
 		/* do nothing */
 		break;
 	}
 
+	if ((op == NC_OP_GET || op == NC_OP_GETCONFIG) && rpc2all_workers > 1) {
+		/* process the datastores in parallel, the replies are merged below as in the sequential processing */
+		replies = ncds_apply_rpc2all_parallel(session, rpc, shared_filter, &replies_count);
+	} else if (req_type == NC_RPC_DATASTORE_WRITE && erropt == NC_EDIT_ERROPT_ROLLBACK) {
+		/*
+		 * the rollback backups of the changed datastores must not be replaced
+		 * by other operations before they are possibly used, so keep all the
+		 * datastores locked until the whole operation is done
+		 */
+		if ((ret = ds_lock_all()) != 0) {
+			ERROR("Failed to lock datastores (%s).", strerror(ret));
+			return (nc_reply_error(nc_err_new(NC_ERR_OP_FAILED)));
+		}
+		locked = 1;
+	}
+
 	for (ds = ncds.datastores; ds != NULL; ds = ds->next) {
 		/* skip internal datastores */
 		if (ds->datastore->id > 0 && ds->datastore->id < internal_ds_count) {
@@ -6567,7 +7052,11 @@ API nc_reply* ncds_apply_rpc2all(struct nc_session* session, const nc_rpc* rpc,
 		}
 
 		/* apply RPC on a single datastore */
-		reply = ncds_apply_rpc(ds->datastore->id, session, rpc, shared_filter);
+		if (replies != NULL) {
+			reply = replies[replies_i++];
+		} else {
+			reply = ncds_apply_rpc(ds->datastore->id, session, rpc, shared_filter, locked);
+		}
 		if (ids != NULL && reply != NCDS_RPC_NOT_APPLICABLE) {
 			ncds.datastores_ids[id_i] = ds->datastore->id;
 			id_i++;
@@ -6585,6 +7074,12 @@ API nc_reply* ncds_apply_rpc2all(struct nc_session* session, const nc_rpc* rpc,
 				free(server_capabilities);
 				server_capabilities = NULL;
 				pthread_spin_unlock(&server_cpblt_lock);
+				if (replies != NULL) {
+					ncds_apply_rpc2all_replies_free(replies, replies_i, replies_count);
+				}
+				if (locked) {
+					ds_unlock_all(NULL);
+				}
 
 				if (nc_reply_get_type(old_reply) == NC_REPLY_ERROR) {
 					return (old_reply);
@@ -6614,24 +7109,21 @@ API nc_reply* ncds_apply_rpc2all(struct nc_session* session, const nc_rpc* rpc,
 							transapi = 0;
 						}
 
+						/* all the datastores are locked since the changes were applied */
 						if (transapi) {
 							/* remeber data for transAPI diff */
-							data = ds_rollback->datastore->func.getconfig(ds_rollback->datastore, session, NC_DATASTORE_RUNNING, &e);
+							old = ncds_getconfig_doc(ds_rollback->datastore, session, NC_DATASTORE_RUNNING, &e);
 							nc_err_free(e);
 							e = NULL;
-
-							old = read_datastore_data(ds_rollback->datastore->id, data);
-							free(data);
 						}
 
 						ds_rollback->datastore->func.rollback(ds_rollback->datastore);
 
 						/* transAPI rollback */
 						if (transapi) {
-							reply = ncds_apply_transapi(ds_rollback->datastore, session, old, erropt, reply);
+							reply = ncds_apply_transapi(ds_rollback->datastore, session, old, NULL, erropt, reply);
 							xmlFreeDoc(old);
 						}
-
 					}
 					goto cleanup;
 				} /* else if (erropt == NC_EDIT_ERROPT_CONT)
@@ -6657,6 +7149,12 @@ cleanup:
 	/* clean up the common data for calling nc_apply_rpc() */
 	nc_filter_free(shared_filter);
 	shared_filter = NULL;
+	if (replies != NULL) {
+		ncds_apply_rpc2all_replies_free(replies, replies_i, replies_count);
+	}
+	if (locked) {
+		ds_unlock_all(NULL);
+	}
 
 	pthread_spin_lock(&server_cpblt_lock);
 	free(server_capabilities);
@@ -6785,51 +7283,20 @@ API void ncds_break_locks(const struct nc_session* session)
 
 const struct data_model* ncds_get_model_data(const char* namespace)
 {
-	struct model_list* listitem;
-	struct data_model *model = NULL;
-
 	if (namespace == NULL) {
 		return (NULL);
 	}
 
-	for (listitem = models_list; listitem != NULL; listitem = listitem->next) {
-		if (listitem->model->ns != NULL && strcmp(listitem->model->ns, namespace) == 0) {
-			/* namespace matches */
-			model = listitem->model;
-			break;
-		}
-	}
-
-	if (model != NULL) {
-		/* model found */
-		return (model);
-	}
-
-	/* model not found */
-	return (NULL);
+	return ((const struct data_model*) xmlHashLookup(models_index, BAD_CAST namespace));
 }
 
 const struct data_model* ncds_get_model_operation(const char* operation, const char* namespace)
 {
-	const struct data_model *model = NULL;
-	int i;
-
 	if (operation == NULL || namespace == NULL) {
 		return (NULL);
 	}
 
-	model = ncds_get_model_data(namespace);
-	if (model != NULL && model->rpcs != NULL ) {
-		for (i = 0; model->rpcs[i] != NULL ; i++) {
-			if (strcmp(model->rpcs[i], operation) == 0) {
-				/* operation definition found */
-				return (model);
-			}
-		}
-	}
-
-	/* oepration definition not found */
-	return (NULL);
+	return ((const struct data_model*) xmlHashLookup2(models_ops_index, BAD_CAST operation, BAD_CAST namespace));
 }
 
 static int ncds_update_features()
@@ -6982,23 +7449,9 @@ static struct model_feature** get_features_from_prefix(struct data_model* model,
 
 const struct data_model* ncds_get_model_notification(const char* notification, const char* namespace)
 {
-	const struct data_model *model = NULL;
-	int i;
-
 	if (notification == NULL || namespace == NULL) {
 		return (NULL);
 	}
 
-	model = ncds_get_model_data(namespace);
-	if (model != NULL && model->notifs != NULL ) {
-		for (i = 0; model->notifs[i] != NULL ; i++) {
-			if (strcmp(model->notifs[i], notification) == 0) {
-				/* notification definition found */
-				return (model);
-			}
-		}
-	}
-
-	/* notification definition not found */
-	return (NULL);
+	return ((const struct data_model*) xmlHashLookup2(models_notifs_index, BAD_CAST notification, BAD_CAST namespace));
 }
@@ -386,6 +386,10 @@ int ncds_set_validation(struct ncds_ds* ds, int enable, const char* relaxng, con
  * If the file does not exist, it is created. The file is opened and the file
  * descriptor is stored in the structure.
  *
+ * To avoid the disk I/O, the file (and its journal) can be placed in a memory
+ * filesystem such as /dev/shm. Every process using the datastore still parses
+ * the file once and then applies only the changes made by the others.
+ *
  * @param[in] datastore Datastore structure to be configured.
  * @param[in] path File path to the file storing configuration datastores.
  * @return
@@ -470,6 +474,20 @@ void ncds_free2(ncds_id datastore_id);
  */
 nc_reply* ncds_apply_rpc2all(struct nc_session* session, const nc_rpc* rpc, ncds_id* ids[]);
 
+/**
+ * @ingroup store
+ * @brief Set the number of threads applying the read operations (\<get\>
+ * and \<get-config\>) on the datastores in parallel in ncds_apply_rpc2all().
+ *
+ * The replies are merged in the same order and with the same result as when
+ * the datastores are processed sequentially, which is the default. The status
+ * data callbacks of the different datastores can then be called concurrently.
+ *
+ * @param[in] count Maximal number of threads including the calling one, 0 and
+ * 1 for processing the datastores sequentially.
+ */
+void ncds_set_rpc2all_workers(unsigned int count);
+
 /**
  * @ingroup store
  * @brief Undo the last change performed on the specified datastore.
@@ -125,6 +125,19 @@ struct ncds_funcs {
 	 * @return NULL on error, resulting data on success.
 	*/
 	char* (*getconfig)(struct ncds_ds* ds, const struct nc_session* session, NC_DATASTORE target, struct nc_err** error);
+	/**
+	 * @brief Get configuration data stored in target datastore as an XML document.
+	 * Optional, getconfig() and parsing its result is used when not implemented.
+	 *
+	 * @param[in] ds Datastore structure from which the data will be obtained.
+	 * @param[in] session Session originating the request.
+	 * @param[in] source Datastore (runnign, startup, candidate) to get the data from.
+	 * @param[out] error NETCONF error structure describing the experienced error.
+	 * @return NULL on error, on success a new document with the configuration root
+	 * elements as its top level nodes (empty document for empty datastore), the
+	 * caller is supposed to free it.
+	 */
+	xmlDocPtr (*getconfig_xml)(struct ncds_ds* ds, const struct nc_session* session, NC_DATASTORE target, struct nc_err** error);
 	/**
 	 * @brief Copy the content of source datastore or externally sent configuration to target datastore
 	 *
@@ -326,9 +339,11 @@ struct ncds_ds {
 	 */
 	time_t last_access;
 	/**
-	 * @brief Lock for serialized access/modification of the datastore.
+	 * @brief Locks of the running, startup and candidate datastores (indexed
+	 * by NC_DATASTORE - NC_DATASTORE_RUNNING) serializing their modifications
+	 * with any other access.
 	 */
-	pthread_mutex_t lock;
+	pthread_rwlock_t lock[3];
 	/**
 	 * @brief Pointer to a callback function implementing the retrieval of the
 	 * device status data.
@@ -352,6 +367,17 @@ struct ncds_ds {
 	 * @brief Parsed extended data model structure.
 	 */
 	struct model_tree* ext_model_tree;
+	/**
+	 * @brief List keys of the extended data model compiled by
+	 * ncds_consolidate(), see get_keynode_list().
+	 */
+	struct model_keys* ext_model_keys;
+	/**
+	 * @brief Record of the edit-config being applied on the running
+	 * datastore for transAPI, set only while ncds_apply_rpc() holds the
+	 * running lock.
+	 */
+	struct edit_record* running_edit;
 
 #ifndef DISABLE_VALIDATION
 	/**
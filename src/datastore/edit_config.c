@@ -49,6 +49,7 @@
 #include <libxml/tree.h>
 #include <libxml/xpath.h>
 #include <libxml/xpathInternals.h>
+#include <libxml/hash.h>
 
 #include "edit_config.h"
 #include "datastore_internal.h"
@@ -161,17 +162,115 @@ static NC_EDIT_OP_TYPE get_operation(xmlNodePtr node, NC_EDIT_DEFOP_TYPE defop,
 	return op;
 }
 
-/**
- * \brief Get all the key elements from the configuration data model
- *
- * \param model         XML form (YIN) of the configuration data model.
- *
- * \return              keyList with references to all the keys in the data model.
+/* namespace of the data nodes defined by the given model node */
+static char* model_keys_ns(xmlNodePtr modelnode)
+{
+	xmlNodePtr aux;
+	xmlChar* ns;
+
+	for (; modelnode != NULL && modelnode->type == XML_ELEMENT_NODE; modelnode = modelnode->parent) {
+		if (xmlStrcmp(modelnode->name, BAD_CAST "augment") == 0 &&
+				(ns = xmlGetNsProp(modelnode, BAD_CAST "ns", BAD_CAST "libnetconf")) != NULL) {
+			/* augment substituted from another model */
+			return ((char*)ns);
+		} else if (xmlStrcmp(modelnode->name, BAD_CAST "module") == 0) {
+			for (aux = modelnode->children; aux != NULL; aux = aux->next) {
+				if (aux->type == XML_ELEMENT_NODE && xmlStrcmp(aux->name, BAD_CAST "namespace") == 0) {
+					return ((char*)xmlGetProp(aux, BAD_CAST "uri"));
+				}
+			}
+			break;
+		}
+	}
+
+	return (NULL);
+}
+
+/*
+ * Schema path of the list the key statement belongs to. Its ancestors up to
+ * the module are matched with the data node ancestors by their names,
+ * choice, case and augment statements do not appear in the data tree.
  */
+static char* model_keys_list_path(xmlNodePtr keynode)
+{
+	xmlNodePtr aux;
+	xmlChar* name;
+	char *path = NULL, *path_aux;
+
+	for (aux = keynode->parent; aux != NULL && aux->type == XML_ELEMENT_NODE; ) {
+		if ((name = xmlGetProp(aux, BAD_CAST "name")) == NULL) {
+			break;
+		}
+		if (asprintf(&path_aux, "%s%s%s", (char*)name, path != NULL ? "/" : "", path != NULL ? path : "") == -1) {
+			xmlFree(name);
+			break;
+		}
+		xmlFree(name);
+		free(path);
+		path = path_aux;
+
+		do {
+			aux = aux->parent;
+		} while (aux != NULL && aux->type == XML_ELEMENT_NODE && (xmlStrcmp(aux->name, BAD_CAST "augment") == 0
+				|| xmlStrcmp(aux->name, BAD_CAST "choice") == 0
+				|| xmlStrcmp(aux->name, BAD_CAST "case") == 0));
+
+		if (aux != NULL && aux->type == XML_ELEMENT_NODE && xmlStrcmp(aux->name, BAD_CAST "module") == 0) {
+			/* we are on the top of the data tree */
+			return (path);
+		}
+	}
+
+	/* the key is not placed in the data tree (e.g. grouping without a name) */
+	free(path);
+	return (NULL);
+}
+
+/*
+ * Schema path of the data node written into the given buffer, the path is
+ * allocated only if it does not fit. NULL if the node is not placed in a document.
+ */
+static char* model_keys_node_path(xmlNodePtr node, char* buf, size_t size)
+{
+	xmlNodePtr aux;
+	size_t len = 0, l;
+	char* path;
+
+	for (aux = node; aux != NULL && aux->type == XML_ELEMENT_NODE; aux = aux->parent) {
+		len += xmlStrlen(aux->name) + 1;
+	}
+	if (len == 0 || aux == NULL || aux->type != XML_DOCUMENT_NODE) {
+		return (NULL);
+	}
+
+	if (len <= size) {
+		path = buf;
+	} else if ((path = malloc(len)) == NULL) {
+		ERROR("Memory allocation failed (%s:%d).", __FILE__, __LINE__);
+		return (NULL);
+	}
+	path[--len] = '\0';
+	for (aux = node; aux->type == XML_ELEMENT_NODE; aux = aux->parent) {
+		l = xmlStrlen(aux->name);
+		len -= l;
+		memcpy(path + len, aux->name, l);
+		if (len > 0) {
+			path[--len] = '/';
+		}
+	}
+
+	return (path);
+}
+
 keyList get_keynode_list(xmlDocPtr model)
 {
 	xmlXPathContextPtr model_ctxt = NULL;
 	xmlXPathObjectPtr result = NULL;
+	struct model_keys* keys = NULL;
+	struct model_list_keys* list;
+	xmlChar *value, *ns;
+	char *path, *token, *s;
+	int i;
 
 	if (model == NULL) {
 		return (NULL);
@@ -189,76 +288,134 @@ keyList get_keynode_list(xmlDocPtr model)
 	}
 
 	result = xmlXPathEvalExpression(BAD_CAST "//" NC_NS_YIN_ID ":key", model_ctxt);
-	if (result != NULL) {
-		if (xmlXPathNodeSetIsEmpty(result->nodesetval)) {
-			xmlXPathFreeObject(result);
-			result = (NULL);
+	xmlXPathFreeContext(model_ctxt);
+	if (result == NULL || xmlXPathNodeSetIsEmpty(result->nodesetval)) {
+		xmlXPathFreeObject(result);
+		return (NULL);
+	}
+
+	if ((keys = calloc(1, sizeof(struct model_keys))) == NULL ||
+			(keys->list = calloc(result->nodesetval->nodeNr, sizeof(struct model_list_keys))) == NULL ||
+			(keys->lists = xmlHashCreate(result->nodesetval->nodeNr)) == NULL) {
+		ERROR("Memory allocation failed (%s:%d).", __FILE__, __LINE__);
+		xmlXPathFreeObject(result);
+		keyListFree(keys);
+		return (NULL);
+	}
+
+	for (i = 0; i < result->nodesetval->nodeNr; i++) {
+		if ((path = model_keys_list_path(result->nodesetval->nodeTab[i])) == NULL) {
+			continue;
+		}
+		ns = (xmlChar*) model_keys_ns(result->nodesetval->nodeTab[i]->parent);
+		if (xmlHashLookup2(keys->lists, BAD_CAST path, ns) != NULL ||
+				(value = xmlGetProp(result->nodesetval->nodeTab[i], BAD_CAST "value")) == NULL) {
+			/* the first key definition matching the path is used */
+			free(path);
+			xmlFree(ns);
+			continue;
+		}
+
+		/* attribute have the form of space-separated list of key nodes */
+		list = &(keys->list[keys->count++]);
+		for (s = (char*)value; (token = strtok(s, " ")) != NULL; s = NULL) {
+			if ((list->names = realloc(list->names, (list->count + 1) * sizeof(char*))) == NULL) {
+				ERROR("Memory allocation failed (%s:%d).", __FILE__, __LINE__);
+				list->count = 0;
+				break;
+			}
+			list->names[list->count++] = strdup(token);
 		}
+		xmlFree(value);
+
+		xmlHashAddEntry2(keys->lists, BAD_CAST path, ns, list);
+		if (ns == NULL) {
+			keys->nons++;
+		}
+		free(path);
+		xmlFree(ns);
 	}
-	xmlXPathFreeContext(model_ctxt);
+	xmlXPathFreeObject(result);
 
-	return ((keyList)result);
+	return (keys);
 }
 
-/* get the key nodes from the xml document */
-static int find_key_elems(xmlNodePtr modelnode, xmlNodePtr node, int all, xmlNodePtr **result)
+void keyListFree(keyList keys)
 {
-	xmlChar *str = NULL;
-	char* s, *token;
-	unsigned int i, c;
+	int i, j;
 
-	/* get the name of the key node(s) from the 'value' attribute in key element in data model */
-	if ((str = xmlGetProp(modelnode, BAD_CAST "value")) == NULL) {
-		return EXIT_FAILURE;
+	if (keys == NULL) {
+		return;
 	}
 
-	/* attribute have the form of space-separated list of key nodes */
-	/* get the number of keys */
-	for (i = 0, c = 1; i < strlen((char*)str); i++) {
-		if (str[i] == ' ') {
-			c++;
+	for (i = 0; i < keys->count; i++) {
+		for (j = 0; j < keys->list[i].count; j++) {
+			free(keys->list[i].names[j]);
 		}
+		free(keys->list[i].names);
 	}
+	free(keys->list);
+	xmlHashFree(keys->lists, NULL);
+	free(keys);
+}
+
+const struct model_list_keys* get_list_keys(keyList keys, xmlNodePtr node)
+{
+	const struct model_list_keys* list;
+	const xmlChar* ns;
+	char buf[256], *path;
+
+	if (keys == NULL || node == NULL || (path = model_keys_node_path(node, buf, sizeof(buf))) == NULL) {
+		return (NULL);
+	}
+	/* lists of the same path from different modules are distinguished by the namespace */
+	ns = (node->ns != NULL) ? node->ns->href : NULL;
+	if ((list = xmlHashLookup2(keys->lists, BAD_CAST path, ns)) == NULL && ns != NULL && keys->nons > 0) {
+		list = xmlHashLookup2(keys->lists, BAD_CAST path, NULL);
+	}
+	if (path != buf) {
+		free(path);
+	}
+
+	return (list);
+}
+
+/* get the key nodes from the xml document */
+static int find_key_elems(const struct model_list_keys* list, xmlNodePtr node, int all, xmlNodePtr **result)
+{
+	int i, c;
+
 	/* allocate sufficient array of pointers to key nodes */
-	*result = (xmlNodePtr*)calloc(c + 1, sizeof(xmlNodePtr));
+	*result = (xmlNodePtr*)calloc(list->count + 1, sizeof(xmlNodePtr));
 	if (*result == NULL) {
-		xmlFree(str);
 		return (EXIT_FAILURE);
 	}
 
-	/* and now process all key nodes defined in attribute value list */
-	for (i = 0, s = (char*)str; i < c; i++, s = NULL) {
-		token = strtok(s, " ");
-		if (token == NULL) {
-			break;
-		}
-
+	/* and now process all key nodes of the list */
+	for (i = c = 0; i < list->count; i++) {
 		/* get key nodes in original xml tree - all keys are needed */
-		(*result)[i] = node->children;
-		while (((*result)[i] != NULL) && strcmp(token, (char*) ((*result)[i])->name)) {
-			(*result)[i] = ((*result)[i])->next;
+		(*result)[c] = node->children;
+		while (((*result)[c] != NULL) && strcmp(list->names[i], (char*) ((*result)[c])->name)) {
+			(*result)[c] = ((*result)[c])->next;
 		}
-		if ((*result)[i] == NULL) {
+		if ((*result)[c] == NULL) {
 			if (all) {
-				xmlFree(str);
 				free(*result);
 				*result = NULL;
 				return (EXIT_FAILURE);
-			} else {
-				i--;
 			}
+		} else {
+			c++;
 		}
 	}
 
-	xmlFree(str);
-
 	return EXIT_SUCCESS;
 }
 
 /**
  * \brief Get all the key nodes for the specific element.
  *
- * \param[in] keys List of key elements from the configuration data model.
+ * \param[in] keys Compiled keys of the configuration data model.
  * \param[in] node Node for which the key elements are needed.
  * \param[in] all If set to 1, all the keys must be found in the node, non-zero is
  * returned otherwise.
@@ -267,9 +424,7 @@ static int find_key_elems(xmlNodePtr modelnode, xmlNodePtr node, int all, xmlNod
  */
 static int get_keys(keyList keys, xmlNodePtr node, int all, xmlNodePtr **result)
 {
-	xmlChar *str = NULL;
-	int j, match;
-	xmlNodePtr key_parent, node_parent;
+	const struct model_list_keys* list;
 
 	assert(keys != NULL);
 	assert(node != NULL);
@@ -277,56 +432,12 @@ static int get_keys(keyList keys, xmlNodePtr node, int all, xmlNodePtr **result)
 
 	*result = NULL;
 
-	for (j = 0; j < keys->nodesetval->nodeNr; j++) {
-		/* get corresponding key definition from the data model */
-		// name = xmlGetNsProp (keys->nodesetval->nodeTab[i]->parent, BAD_CAST "name", BAD_CAST NC_NS_YIN);
-		match = 1;
-		key_parent = keys->nodesetval->nodeTab[j]->parent;
-		node_parent = node;
-
-		while (1) {
-			if ((str = xmlGetProp(key_parent, BAD_CAST "name")) == NULL) {
-				match = 0;
-				break;
-			}
-			if (xmlStrcmp(str, node_parent->name)) {
-				xmlFree(str);
-				match = 0;
-				break;
-			}
-			xmlFree(str);
-
-			do {
-				key_parent = key_parent->parent;
-			} while (key_parent && ((xmlStrcmp(key_parent->name, BAD_CAST "augment") == 0)
-                    || (xmlStrcmp(key_parent->name, BAD_CAST "choice") == 0)
-                    || (xmlStrcmp(key_parent->name, BAD_CAST "case") == 0)));
-			node_parent = node_parent->parent;
-
-			if ((!key_parent && node_parent) || (key_parent && !node_parent)) {
-				match = 0;
-				break;
-			}
-
-			if (!xmlStrcmp(key_parent->name, BAD_CAST "module") && (node_parent->type == XML_DOCUMENT_NODE)) {
-				break;
-			}
-		}
-
-		if (!match) {
-			continue;
-		}
-
-		/*
-		 * now we have key values for the appropriate node which was
-		 * specified as function parameter, so there will be no other
-		 * run in this for loop - no continue command is allowed from
-		 * now to the end of the loop
-		 */
-		return find_key_elems(keys->nodesetval->nodeTab[j], node, all, result);
+	if ((list = get_list_keys(keys, node)) == NULL) {
+		/* not a list instance */
+		return (EXIT_SUCCESS);
 	}
 
-	return (EXIT_SUCCESS);
+	return find_key_elems(list, node, all, result);
 }
 
 
@@ -511,6 +622,7 @@ int matching_elements(xmlNodePtr node1, xmlNodePtr node2, keyList keys, int leaf
 				/* cleanup for next round */
 				xmlFree(key_value2);
 				xmlFree(keynode_value2);
+				key_value2 = keynode_value2 = NULL;
 
 				if (key == NULL) {
 					/* there is no matching node */
@@ -617,6 +729,337 @@ static xmlChar* get_default_value(xmlNodePtr node, xmlDocPtr model)
 	return (value);
 }
 
+/**
+ * @brief Index of the parent's children, the keyed list instances are stored
+ * by their name, namespace and key values.
+ */
+struct edit_index_parent {
+	xmlNodePtr parent;
+	xmlHashTablePtr instances;
+	struct edit_index_parent *prev, *next;
+};
+
+/**
+ * @brief Index of the list instances in the original configuration document.
+ *
+ * The index is built lazily for each parent node whose children are searched
+ * for a keyed list instance from the edit-config data, so the instance is
+ * found without comparing it with all its siblings. It lives for a single
+ * edit-config and the edit operations keep it consistent when they add or
+ * remove nodes in the original document.
+ */
+struct edit_index {
+	keyList keys;
+	xmlHashTablePtr parents;
+	struct edit_index_parent* list;
+};
+
+/* instances with the same key values, they must be searched sequentially */
+static char edit_index_dupl;
+#define EDIT_INDEX_DUPL ((void*)&edit_index_dupl)
+
+static struct edit_index* edit_index_new(keyList keys)
+{
+	struct edit_index* index;
+
+	if (keys == NULL) {
+		/* there are no keyed lists */
+		return (NULL);
+	}
+
+	if ((index = malloc(sizeof(struct edit_index))) == NULL) {
+		ERROR("Memory allocation failed (%s:%d).", __FILE__, __LINE__);
+		return (NULL);
+	}
+	if ((index->parents = xmlHashCreate(16)) == NULL) {
+		ERROR("%s: xmlHashCreate failed (%s:%d).", __func__, __FILE__, __LINE__);
+		free(index);
+		return (NULL);
+	}
+	index->keys = keys;
+	index->list = NULL;
+
+	return (index);
+}
+
+static void edit_index_drop(struct edit_index* index, struct edit_index_parent* rec)
+{
+	char id[32];
+
+	snprintf(id, sizeof(id), "%p", (void*)rec->parent);
+	xmlHashRemoveEntry(index->parents, BAD_CAST id, NULL);
+
+	if (rec->prev != NULL) {
+		rec->prev->next = rec->next;
+	} else {
+		index->list = rec->next;
+	}
+	if (rec->next != NULL) {
+		rec->next->prev = rec->prev;
+	}
+
+	xmlHashFree(rec->instances, NULL);
+	free(rec);
+}
+
+static void edit_index_free(struct edit_index* index)
+{
+	if (index == NULL) {
+		return;
+	}
+
+	while (index->list != NULL) {
+		edit_index_drop(index, index->list);
+	}
+	xmlHashFree(index->parents, NULL);
+	free(index);
+}
+
+/**
+ * @brief Get the key values of the list instance in the form used by the index.
+ * @param[in] keys List of the key elements from the configuration data model.
+ * @param[in] node List instance.
+ * @return Allocated string, NULL if the node is not a list instance with all
+ * its keys present.
+ */
+static char* edit_index_key(keyList keys, xmlNodePtr node)
+{
+	xmlNodePtr *keynode_list = NULL;
+	xmlChar *value;
+	char *key = NULL, *aux, *s;
+	int i;
+
+	if (node->type != XML_ELEMENT_NODE || get_keys(keys, node, 1, &keynode_list) != EXIT_SUCCESS || keynode_list == NULL) {
+		return (NULL);
+	}
+
+	for (i = 0; keynode_list[i] != NULL; i++) {
+		/* compare values without leading/trailing whitespaces as matching_elements() does */
+		value = xmlNodeGetContent(keynode_list[i]);
+		s = nc_clrwspace(value != NULL ? (char*)value : "");
+		xmlFree(value);
+
+		/* prefix each value with its length to keep different tuples distinct */
+		if (s == NULL || asprintf(&aux, "%s%zu:%s", key != NULL ? key : "", strlen(s), s) == -1) {
+			free(s);
+			free(key);
+			free(keynode_list);
+			return (NULL);
+		}
+		free(s);
+		free(key);
+		key = aux;
+	}
+	free(keynode_list);
+
+	return (key);
+}
+
+/**
+ * @brief Get the namespace of the edit node usable as the index key, see nc_nscmp().
+ * @return Namespace URI, NULL if the edit node matches a node from any namespace.
+ */
+static const xmlChar* edit_index_ns(xmlNodePtr edit)
+{
+	char* s;
+	int empty;
+
+	if (edit->ns == NULL || edit->ns->href == NULL || !strcmp((char*)edit->ns->href, NC_NS_BASE10)) {
+		return (NULL);
+	}
+
+	s = nc_clrwspace((char*)edit->ns->href);
+	empty = (s == NULL || strlen(s) == 0);
+	free(s);
+
+	return (empty ? NULL : edit->ns->href);
+}
+
+static void edit_index_insert(struct edit_index* index, struct edit_index_parent* rec, xmlNodePtr node)
+{
+	const xmlChar* ns;
+	xmlNodePtr found;
+	char* key;
+
+	if ((key = edit_index_key(index->keys, node)) == NULL) {
+		return;
+	}
+	ns = (node->ns != NULL && node->ns->href != NULL) ? node->ns->href : BAD_CAST "";
+
+	if ((found = xmlHashLookup3(rec->instances, node->name, ns, BAD_CAST key)) == NULL) {
+		xmlHashAddEntry3(rec->instances, node->name, ns, BAD_CAST key, node);
+	} else if (found != node) {
+		xmlHashUpdateEntry3(rec->instances, node->name, ns, BAD_CAST key, EDIT_INDEX_DUPL, NULL);
+	}
+	free(key);
+}
+
+/**
+ * @brief Get the index of the parent's children.
+ * @param[in] index Index of the original document.
+ * @param[in] parent Parent node from the original document.
+ * @param[in] build If set, the index of the parent's children is built when
+ * it does not exist yet.
+ * @return Index of the parent's children, NULL if it does not exist.
+ */
+static struct edit_index_parent* edit_index_get(struct edit_index* index, xmlNodePtr parent, int build)
+{
+	struct edit_index_parent* rec;
+	xmlNodePtr child;
+	char id[32];
+
+	snprintf(id, sizeof(id), "%p", (void*)parent);
+	if ((rec = xmlHashLookup(index->parents, BAD_CAST id)) != NULL || !build) {
+		return (rec);
+	}
+
+	if ((rec = calloc(1, sizeof(struct edit_index_parent))) == NULL) {
+		ERROR("Memory allocation failed (%s:%d).", __FILE__, __LINE__);
+		return (NULL);
+	}
+	rec->parent = parent;
+	if ((rec->instances = xmlHashCreate(64)) == NULL || xmlHashAddEntry(index->parents, BAD_CAST id, rec) != 0) {
+		ERROR("%s: creating the index failed (%s:%d).", __func__, __FILE__, __LINE__);
+		xmlHashFree(rec->instances, NULL);
+		free(rec);
+		return (NULL);
+	}
+	rec->next = index->list;
+	if (index->list != NULL) {
+		index->list->prev = rec;
+	}
+	index->list = rec;
+
+	for (child = parent->children; child != NULL; child = child->next) {
+		edit_index_insert(index, rec, child);
+	}
+
+	return (rec);
+}
+
+/*
+ * adding or removing a key element changes the key values of its list
+ * instance, so forget the index of the instance's siblings
+ */
+static void edit_index_key_changed(struct edit_index* index, xmlNodePtr node)
+{
+	struct edit_index_parent* rec;
+	xmlNodePtr instance = node->parent;
+
+	if (node->type == XML_ELEMENT_NODE && instance->type == XML_ELEMENT_NODE && instance->parent != NULL &&
+			(rec = edit_index_get(index, instance->parent, 0)) != NULL && is_key(instance, node, index->keys) != 0) {
+		edit_index_drop(index, rec);
+	}
+}
+
+/* forget the index of the children of the nodes from the removed subtree */
+static void edit_index_forget(struct edit_index* index, xmlNodePtr node)
+{
+	struct edit_index_parent* rec;
+	xmlNodePtr child;
+
+	if (node->type != XML_ELEMENT_NODE && node->type != XML_DOCUMENT_NODE) {
+		return;
+	}
+
+	if ((rec = edit_index_get(index, node, 0)) != NULL) {
+		edit_index_drop(index, rec);
+	}
+	for (child = node->children; child != NULL && index->list != NULL; child = child->next) {
+		edit_index_forget(index, child);
+	}
+}
+
+/**
+ * @brief Update the index after the node was added into the original document.
+ */
+static void edit_index_add(struct edit_index* index, xmlNodePtr node)
+{
+	struct edit_index_parent* rec;
+
+	if (index == NULL || node == NULL || node->parent == NULL) {
+		return;
+	}
+
+	if ((rec = edit_index_get(index, node->parent, 0)) != NULL) {
+		edit_index_insert(index, rec, node);
+	}
+	edit_index_key_changed(index, node);
+}
+
+/**
+ * @brief Update the index before the node is removed from the original document.
+ */
+static void edit_index_remove(struct edit_index* index, xmlNodePtr node)
+{
+	struct edit_index_parent* rec;
+	const xmlChar* ns;
+	char* key;
+
+	if (index == NULL || node == NULL || node->parent == NULL) {
+		return;
+	}
+
+	if ((rec = edit_index_get(index, node->parent, 0)) != NULL && (key = edit_index_key(index->keys, node)) != NULL) {
+		ns = (node->ns != NULL && node->ns->href != NULL) ? node->ns->href : BAD_CAST "";
+		if (xmlHashLookup3(rec->instances, node->name, ns, BAD_CAST key) == node) {
+			xmlHashRemoveEntry3(rec->instances, node->name, ns, BAD_CAST key, NULL);
+		}
+		free(key);
+	}
+	edit_index_key_changed(index, node);
+	if (index->list != NULL) {
+		edit_index_forget(index, node);
+	}
+}
+
+/**
+ * @brief Find the first parent's child matching the edit node.
+ *
+ * @param[in] index Index of the original document, NULL to compare the edit
+ * node with all the parent's children.
+ * @param[in] parent Parent node from the original document.
+ * @param[in] edit Node from the edit-config data.
+ * @param[in] keys List of the key elements from the configuration data model.
+ * @param[in] leaf Compare the text content of the leaf-list's items.
+ * @param[out] unique Set to 1 if the node was found in the index, so no other
+ * parent's child matches the edit node. Can be NULL.
+ * @return Found child, NULL if no child matches the edit node.
+ */
+static xmlNodePtr edit_index_find(struct edit_index* index, xmlNodePtr parent, xmlNodePtr edit, keyList keys, int leaf, int* unique)
+{
+	struct edit_index_parent* rec;
+	const xmlChar* ns;
+	xmlNodePtr node;
+	char* key;
+
+	if (unique != NULL) {
+		*unique = 0;
+	}
+
+	if (index != NULL && leaf == 0 && edit->type == XML_ELEMENT_NODE &&
+			(ns = edit_index_ns(edit)) != NULL && (key = edit_index_key(index->keys, edit)) != NULL) {
+		rec = edit_index_get(index, parent, 1);
+		node = (rec != NULL) ? xmlHashLookup3(rec->instances, edit->name, ns, BAD_CAST key) : NULL;
+		free(key);
+
+		if (rec != NULL && node != EDIT_INDEX_DUPL) {
+			if (unique != NULL) {
+				*unique = (node != NULL);
+			}
+			return (node);
+		}
+	}
+
+	for (node = parent->children; node != NULL; node = node->next) {
+		if (matching_elements(edit, node, keys, leaf) != 0) {
+			return (node);
+		}
+	}
+
+	return (NULL);
+}
+
 /**
  * \brief Find an equivalent of the given edit node on orig_doc document.
  *
@@ -624,11 +1067,12 @@ static xmlChar* get_default_value(xmlNodePtr node, xmlDocPtr model)
  * \param[in] edit Element from the edit-config's \<config\>. Its equivalent in
  *                 orig_doc should be found.
  * \param[in] keys List of the key elements from the configuration data model.
+ * \param[in] index Index of the orig_doc's list instances, can be NULL.
  * \return Found equivalent element, NULL if no such element exists.
  */
-xmlNodePtr find_element_equiv(xmlDocPtr orig_doc, xmlNodePtr edit, xmlDocPtr model, keyList keys)
+static xmlNodePtr find_element_equiv_indexed(xmlDocPtr orig_doc, xmlNodePtr edit, xmlDocPtr model, keyList keys, struct edit_index* index)
 {
-	xmlNodePtr orig_parent, node, model_def;
+	xmlNodePtr orig_parent, model_def;
 	int leaf = 0;
 
 	if (edit == NULL || orig_doc == NULL) {
@@ -637,7 +1081,7 @@ xmlNodePtr find_element_equiv(xmlDocPtr orig_doc, xmlNodePtr edit, xmlDocPtr mod
 
 	/* go recursively to the root */
 	if (edit->parent->type != XML_DOCUMENT_NODE) {
-		orig_parent = find_element_equiv(orig_doc, edit->parent, model, keys);
+		orig_parent = find_element_equiv_indexed(orig_doc, edit->parent, model, keys, index);
 	} else {
 		if (orig_doc->children == NULL) {
 			orig_parent = NULL;
@@ -656,21 +1100,139 @@ xmlNodePtr find_element_equiv(xmlDocPtr orig_doc, xmlNodePtr edit, xmlDocPtr mod
 	}
 
 	/* element check */
-	node = orig_parent->children;
-	while (node != NULL) {
-		/* compare edit and node */
-		if (matching_elements(edit, node, keys, leaf) == 0) {
-			/* non matching nodes */
-			node = node->next;
+	return (edit_index_find(index, orig_parent, edit, keys, leaf, NULL));
+}
+
+/**
+ * \brief Find an equivalent of the given edit node on orig_doc document.
+ *
+ * \param[in] orig_doc Original configuration document to edit.
+ * \param[in] edit Element from the edit-config's \<config\>. Its equivalent in
+ *                 orig_doc should be found.
+ * \param[in] keys List of the key elements from the configuration data model.
+ * \return Found equivalent element, NULL if no such element exists.
+ */
+xmlNodePtr find_element_equiv(xmlDocPtr orig_doc, xmlNodePtr edit, xmlDocPtr model, keyList keys)
+{
+	return (find_element_equiv_indexed(orig_doc, edit, model, keys, NULL));
+}
+
+/**
+ * \brief Record of the nodes touched by an edit-config.
+ */
+struct edit_record {
+	keyList keys;
+	xmlHashTablePtr nodes; /* identifiers of the touched nodes */
+	int complete;          /* set when the record covers the whole edit */
+};
+
+struct edit_record* edit_record_new(keyList keys)
+{
+	struct edit_record* record;
+
+	if ((record = malloc(sizeof(struct edit_record))) == NULL) {
+		ERROR("Memory allocation failed (%s:%d).", __FILE__, __LINE__);
+		return (NULL);
+	}
+	if ((record->nodes = xmlHashCreate(16)) == NULL) {
+		ERROR("%s: xmlHashCreate failed (%s:%d).", __func__, __FILE__, __LINE__);
+		free(record);
+		return (NULL);
+	}
+	record->keys = keys;
+	record->complete = 0;
+
+	return (record);
+}
+
+void edit_record_free(struct edit_record* record)
+{
+	if (record == NULL) {
+		return;
+	}
+
+	xmlHashFree(record->nodes, NULL);
+	free(record);
+}
+
+/* identifier of the data node - names of its ancestors with the key values of the list instances */
+static void edit_record_id(keyList keys, xmlNodePtr node, xmlBufferPtr id)
+{
+	char* key;
+
+	if (node->parent != NULL && node->parent->type == XML_ELEMENT_NODE) {
+		edit_record_id(keys, node->parent, id);
+	}
+
+	xmlBufferCCat(id, "/");
+	xmlBufferCat(id, node->name);
+	if (keys != NULL && (key = edit_index_key(keys, node)) != NULL) {
+		xmlBufferCCat(id, "[");
+		xmlBufferCCat(id, key);
+		xmlBufferCCat(id, "]");
+		free(key);
+	}
+}
+
+static void edit_record_add(struct edit_record* record, xmlNodePtr node)
+{
+	xmlBufferPtr id;
+
+	if ((id = xmlBufferCreate()) == NULL) {
+		/* we cannot say what was touched */
+		record->complete = -1;
+		return;
+	}
+	edit_record_id(record->keys, node, id);
+	xmlHashAddEntry(record->nodes, xmlBufferContent(id), record);
+	xmlBufferFree(id);
+}
+
+int edit_record_touched(const struct edit_record* record, xmlNodePtr node)
+{
+	xmlBufferPtr id;
+	int ret;
+
+	if (record == NULL || record->complete != 1 || (id = xmlBufferCreate()) == NULL) {
+		/* anything could be changed */
+		return (1);
+	}
+	edit_record_id(record->keys, node, id);
+	ret = (xmlHashLookup(record->nodes, xmlBufferContent(id)) != NULL);
+	xmlBufferFree(id);
+
+	return (ret);
+}
+
+/**
+ * \brief Record the nodes of the original document touched by the edit.
+ *
+ * Only the nodes existing in the original document are recorded, nodes
+ * created by the edit are not in the original document and removed nodes are
+ * missing in the edited one, so the changes of their parents are detected
+ * without the record.
+ *
+ * \param[in] record Record to fill.
+ * \param[in] orig_parent Parent of the original nodes equivalent to the edit nodes.
+ * \param[in] edit First edit node to process, its siblings are processed too.
+ * \param[in] index Index of the orig_doc's list instances, can be NULL.
+ */
+static void edit_record_collect(struct edit_record* record, xmlNodePtr orig_parent, xmlNodePtr edit, struct edit_index* index)
+{
+	xmlNodePtr orig_node;
+
+	for (; edit != NULL && record->complete != -1; edit = edit->next) {
+		if (edit->type != XML_ELEMENT_NODE) {
+			continue;
+		}
+		if ((orig_node = edit_index_find(index, orig_parent, edit, record->keys, 0, NULL)) == NULL) {
+			/* created by the edit */
 			continue;
-		} else {
-			/* matching nodes found */
-			return (node);
 		}
-	}
 
-	/* no corresponding node found */
-	return (NULL);
+		edit_record_add(record, orig_node);
+		edit_record_collect(record, orig_node, edit->children, index);
+	}
 }
 
 /**
@@ -831,15 +1393,16 @@ static int check_edit_ops_hierarchy(xmlNodePtr edit, NC_EDIT_DEFOP_TYPE defop, s
  * supposed to edit the orig configuration data.
  * \param[in] model XML form (YIN) of the configuration data model appropriate
  * to the given repo.
+ * \param[in] keys Compiled list keys of the configuration data model.
  * \param[out] err NETCONF error structure.
  * \return On error, non-zero is returned and an err structure is filled. Zero is
  * returned on success.
  */
-static int check_edit_ops(NC_CHECK_EDIT_OP op, NC_EDIT_DEFOP_TYPE defop, xmlDocPtr orig, xmlDocPtr edit, xmlDocPtr model, struct nc_err **error)
+static int check_edit_ops(NC_CHECK_EDIT_OP op, NC_EDIT_DEFOP_TYPE defop, xmlDocPtr orig, xmlDocPtr edit, xmlDocPtr model, keyList keys, struct nc_err **error)
 {
 	xmlXPathObjectPtr operation_nodes = NULL;
 	xmlNodePtr node_to_process = NULL, n;
-	keyList keys;
+	struct edit_index* index = NULL;
 	xmlChar *defval = NULL, *value = NULL;
 	int i;
 
@@ -847,41 +1410,32 @@ static int check_edit_ops(NC_CHECK_EDIT_OP op, NC_EDIT_DEFOP_TYPE defop, xmlDocP
 	assert(edit != NULL);
 	assert(error != NULL);
 
-	keys = get_keynode_list(model);
-
 	operation_nodes = get_operation_elements((NC_EDIT_OP_TYPE)op, edit);
 	if (operation_nodes == NULL) {
 		if (error != NULL) {
 			*error = nc_err_new(NC_ERR_OP_FAILED);
 		}
-		if (keys != NULL) {
-			keyListFree(keys);
-		}
 		return EXIT_FAILURE;
 	}
 
 	if (xmlXPathNodeSetIsEmpty(operation_nodes->nodesetval)) {
 		xmlXPathFreeObject(operation_nodes);
-		if (keys != NULL) {
-			keyListFree(keys);
-		}
 		return EXIT_SUCCESS;
 	}
 
 	*error = NULL;
+	index = edit_index_new(keys);
 	for (i = 0; i < operation_nodes->nodesetval->nodeNr; i++) {
 		node_to_process = operation_nodes->nodesetval->nodeTab[i];
 
 		if (check_edit_ops_hierarchy(node_to_process, defop, error) != EXIT_SUCCESS) {
 			xmlXPathFreeObject(operation_nodes);
-			if (keys != NULL) {
-				keyListFree(keys);
-			}
+			edit_index_free(index);
 			return EXIT_FAILURE;
 		}
 
 		/* \todo namespace handlings */
-		n = find_element_equiv(orig, node_to_process, model, keys);
+		n = find_element_equiv_indexed(orig, node_to_process, model, keys, index);
 		if (op == NC_CHECK_EDIT_DELETE && n == NULL) {
 			if (ncdflt_get_basic_mode() == NCWD_MODE_ALL) {
 				/* A valid 'delete' operation attribute for a
@@ -961,6 +1515,7 @@ static int check_edit_ops(NC_CHECK_EDIT_OP op, NC_EDIT_DEFOP_TYPE defop, xmlDocP
 					 * allow recreate it by the new one with
 					 * the default value
 					 */
+					edit_index_remove(index, n);
 					xmlUnlinkNode(n);
 					xmlFreeNode(n);
 				}
@@ -984,9 +1539,7 @@ static int check_edit_ops(NC_CHECK_EDIT_OP op, NC_EDIT_DEFOP_TYPE defop, xmlDocP
 	if (value != NULL) {
 		xmlFree(value);
 	}
-	if (keys != NULL) {
-		keyListFree(keys);
-	}
+	edit_index_free(index);
 
 	if (*error != NULL) {
 		return (EXIT_FAILURE);
@@ -1021,16 +1574,17 @@ static int edit_delete(xmlNodePtr node)
  * \param[in] edit_node Node from the edit-config's \<config\> element with
  * the specified "remove" operation.
  * \param[in] keys  List of the key elements from the configuration data model.
+ * \param[in] index Index of the orig_doc's list instances, can be NULL.
  *
  * \return Zero on success, non-zero otherwise.
  */
-static int edit_remove(xmlDocPtr orig_doc, xmlNodePtr edit_node, xmlDocPtr model, keyList keys, const struct nacm_rpc* nacm, struct nc_err** error)
+static int edit_remove(xmlDocPtr orig_doc, xmlNodePtr edit_node, xmlDocPtr model, keyList keys, struct edit_index* index, const struct nacm_rpc* nacm, struct nc_err** error)
 {
 	xmlNodePtr old;
 	char *msg = NULL;
 	int ret;
 
-	old = find_element_equiv(orig_doc, edit_node, model, keys);
+	old = find_element_equiv_indexed(orig_doc, edit_node, model, keys, index);
 
 	if (old == NULL) {
 		ret = EXIT_SUCCESS;
@@ -1039,10 +1593,12 @@ static int edit_remove(xmlDocPtr orig_doc, xmlNodePtr edit_node, xmlDocPtr model
 		/* NACM */
 		if (nacm_check_data(old, NACM_ACCESS_DELETE, nacm) == NACM_PERMIT) {
 			/* remove the edit node's equivalent from the original document */
+			edit_index_remove(index, old);
 			edit_delete(old);
 
 			/* in case of list, it can be possible to apply the node repeatedly */
-			while ((old = find_element_equiv(orig_doc, edit_node, model, keys)) != NULL) {
+			while ((old = find_element_equiv_indexed(orig_doc, edit_node, model, keys, index)) != NULL) {
+				edit_index_remove(index, old);
 				edit_delete(old);
 			}
 
@@ -1481,8 +2037,10 @@ static void nc_clear_namespaces(xmlNodePtr node)
 /**
  * Common routine to create a node
  */
-static int edit_create_routine(xmlNodePtr parent, xmlNodePtr edit_node)
+static int edit_create_routine(xmlNodePtr parent, xmlNodePtr edit_node, struct edit_index* index)
 {
+	xmlNodePtr created;
+
 	if (parent == NULL || edit_node == NULL) {
 		ERROR("%s: invalid input parameter.", __func__);
 		return (EXIT_FAILURE);
@@ -1492,22 +2050,23 @@ static int edit_create_routine(xmlNodePtr parent, xmlNodePtr edit_node)
 	VERB("Creating the node %s (%s:%d)", (char*)edit_node->name, __FILE__, __LINE__);
 	if (parent->type == XML_DOCUMENT_NODE) {
 		if (parent->children == NULL) {
-			xmlDocSetRootElement(parent->doc, xmlCopyNode(edit_node, 1));
+			xmlDocSetRootElement(parent->doc, created = xmlCopyNode(edit_node, 1));
 		} else {
 			/* adding root's sibling! */
-			xmlAddChild(parent, xmlCopyNode(edit_node, 1));
+			created = xmlAddChild(parent, xmlCopyNode(edit_node, 1));
 		}
 	} else {
-		if (xmlAddChild(parent, xmlCopyNode(edit_node, 1)) == NULL) {
+		if ((created = xmlAddChild(parent, xmlCopyNode(edit_node, 1))) == NULL) {
 			ERROR("%s: Creating new node (%s) failed (%s:%d)", __func__, (char*)(edit_node->name), __FILE__, __LINE__);
 			return (EXIT_FAILURE);
 		}
 	}
+	edit_index_add(index, created);
 
 	return (EXIT_SUCCESS);
 }
 
-static int edit_create_lists(xmlNodePtr parent, xmlNodePtr edit_node, xmlDocPtr model, keyList keys, struct nc_err** error)
+static int edit_create_lists(xmlNodePtr parent, xmlNodePtr edit_node, xmlDocPtr model, keyList keys, struct edit_index* index, struct nc_err** error)
 {
 	int list_type;
 	xmlChar *insert;
@@ -1619,12 +2178,12 @@ static int edit_create_lists(xmlNodePtr parent, xmlNodePtr edit_node, xmlDocPtr
 
 	xmlFree(insert);
 	nc_clear_namespaces(created);
+	edit_index_add(index, created);
 
 	return (EXIT_SUCCESS);
 
 error:
 	xmlFree(insert);
-	keyListFree(keys);
 	return (EXIT_FAILURE);
 }
 
@@ -1636,7 +2195,7 @@ error:
  * @param[in] model Configuration data model in YIN format.
  * @return 0 in case of success, 1 in case of error
  */
-static int edit_choice_clean(xmlNodePtr parent, xmlNodePtr except_node, xmlDocPtr model, const struct nacm_rpc* nacm, struct nc_err** error)
+static int edit_choice_clean(xmlNodePtr parent, xmlNodePtr except_node, xmlDocPtr model, struct edit_index* index, const struct nacm_rpc* nacm, struct nc_err** error)
 {
 	xmlNodePtr choice_branch, child, aux;
 	char* msg = NULL;
@@ -1666,6 +2225,7 @@ static int edit_choice_clean(xmlNodePtr parent, xmlNodePtr except_node, xmlDocPt
 			/* NACM */
 			if ((r = nacm_check_data(child, NACM_ACCESS_DELETE, nacm)) == NACM_PERMIT) {
 				/* remove the edit node's equivalent from the original document */
+				edit_index_remove(index, child);
 				edit_delete(child);
 			} else if (r == NACM_DENY) {
 				if (error != NULL) {
@@ -1701,13 +2261,13 @@ static int edit_choice_clean(xmlNodePtr parent, xmlNodePtr except_node, xmlDocPt
  * @param[in] model Configuration data model in YIN format.
  * @return 0 in case of success, 1 in case of error
  */
-static int edit_create_choice(xmlNodePtr parent, xmlNodePtr edit_node, xmlDocPtr model, const struct nacm_rpc* nacm, struct nc_err** error)
+static int edit_create_choice(xmlNodePtr parent, xmlNodePtr edit_node, xmlDocPtr model, struct edit_index* index, const struct nacm_rpc* nacm, struct nc_err** error)
 {
-	if (edit_choice_clean(parent, edit_node, model, nacm, error) == EXIT_FAILURE) {
+	if (edit_choice_clean(parent, edit_node, model, index, nacm, error) == EXIT_FAILURE) {
 		return (EXIT_FAILURE);
 	}
 
-	return (edit_create_routine(parent, edit_node));
+	return (edit_create_routine(parent, edit_node, index));
 }
 
 /**
@@ -1718,10 +2278,11 @@ static int edit_create_choice(xmlNodePtr parent, xmlNodePtr edit_node, xmlDocPtr
  *                      create. If there is no equivalent node in the original
  *                      document, it is created.
  * \param[in] keys  List of key elements from configuration data model.
+ * \param[in] index Index of the orig_doc's list instances, can be NULL.
  *
  * \return Zero on success, non-zero otherwise.
  */
-static xmlNodePtr edit_create_recursively(xmlDocPtr orig_doc, xmlNodePtr edit_node, NC_EDIT_DEFOP_TYPE defop, xmlDocPtr model, keyList keys, const struct nacm_rpc* nacm, struct nc_err** error)
+static xmlNodePtr edit_create_recursively(xmlDocPtr orig_doc, xmlNodePtr edit_node, NC_EDIT_DEFOP_TYPE defop, xmlDocPtr model, keyList keys, struct edit_index* index, const struct nacm_rpc* nacm, struct nc_err** error)
 {
 	int r;
 	char *msg = NULL;
@@ -1737,7 +2298,7 @@ static xmlNodePtr edit_create_recursively(xmlDocPtr orig_doc, xmlNodePtr edit_no
 		return (NULL);
 	}
 
-	retval = find_element_equiv(orig_doc, edit_node, model, keys);
+	retval = find_element_equiv_indexed(orig_doc, edit_node, model, keys, index);
 	if (retval == NULL) {
 		if (defop == NC_EDIT_DEFOP_NONE && !get_operation(edit_node, NC_EDIT_DEFOP_NOTSET, NULL)) {
 			/* parent of the node to create does not exist and it is not supposed to be created */
@@ -1776,10 +2337,11 @@ static xmlNodePtr edit_create_recursively(xmlDocPtr orig_doc, xmlNodePtr edit_no
 				xmlSetNs(retval, ns_aux);
 			}
 			xmlDocSetRootElement(orig_doc, retval);
+			edit_index_add(index, retval);
 			return (retval);
 		}
 
-		parent = edit_create_recursively(orig_doc, edit_node->parent, defop, model, keys, nacm, error);
+		parent = edit_create_recursively(orig_doc, edit_node->parent, defop, model, keys, index, nacm, error);
 		if (parent == NULL) {
 			return (NULL);
 		}
@@ -1791,6 +2353,7 @@ static xmlNodePtr edit_create_recursively(xmlDocPtr orig_doc, xmlNodePtr edit_no
 			ns_aux = xmlNewNs(retval, edit_node->ns->href, NULL);
 			xmlSetNs(retval, ns_aux);
 		}
+		edit_index_add(index, retval);
 	}
 	return retval;
 }
@@ -1802,10 +2365,11 @@ static xmlNodePtr edit_create_recursively(xmlDocPtr orig_doc, xmlNodePtr edit_no
  * \param[in] edit_node Node from the edit-config's \<config\> element with
  * specified "create" operation.
  * \param[in] keys  List of key elements from configuration data model.
+ * \param[in] index Index of the orig_doc's list instances, can be NULL.
  *
  * \return Zero on success, non-zero otherwise.
  */
-static int edit_create(xmlDocPtr orig_doc, xmlNodePtr edit_node, NC_EDIT_DEFOP_TYPE defop, xmlDocPtr model, keyList keys, const struct nacm_rpc* nacm, struct nc_err** error)
+static int edit_create(xmlDocPtr orig_doc, xmlNodePtr edit_node, NC_EDIT_DEFOP_TYPE defop, xmlDocPtr model, keyList keys, struct edit_index* index, const struct nacm_rpc* nacm, struct nc_err** error)
 {
 	xmlNodePtr parent = NULL, model_node;
 	int r;
@@ -1835,7 +2399,7 @@ static int edit_create(xmlDocPtr orig_doc, xmlNodePtr edit_node, NC_EDIT_DEFOP_T
 	}
 
 	if (edit_node->parent->type != XML_DOCUMENT_NODE) {
-		parent = edit_create_recursively(orig_doc, edit_node->parent, defop, model, keys, nacm, error);
+		parent = edit_create_recursively(orig_doc, edit_node->parent, defop, model, keys, index, nacm, error);
 		if (parent == NULL) {
 			return EXIT_FAILURE;
 		}
@@ -1851,16 +2415,16 @@ static int edit_create(xmlDocPtr orig_doc, xmlNodePtr edit_node, NC_EDIT_DEFOP_T
 	/* handle user-ordered lists */
 	model_node = find_element_model(edit_node, model);
 	if (is_user_ordered_list(model_node) != 0) {
-		if (edit_create_lists(parent, edit_node, model, keys, error) == EXIT_FAILURE) {
+		if (edit_create_lists(parent, edit_node, model, keys, index, error) == EXIT_FAILURE) {
 			return (EXIT_FAILURE);
 		}
 	} else if (is_partof_choice(model_node) != NULL) {
-		if (edit_create_choice(parent, edit_node, model, nacm, error) == EXIT_FAILURE) {
+		if (edit_create_choice(parent, edit_node, model, index, nacm, error) == EXIT_FAILURE) {
 			return (EXIT_FAILURE);
 		}
 	} else {
 		/* create a new element in the configuration data as a copy of the element from the edit-config */
-		if (edit_create_routine(parent, edit_node) == EXIT_FAILURE) {
+		if (edit_create_routine(parent, edit_node, index) == EXIT_FAILURE) {
 			return (EXIT_FAILURE);
 		}
 	}
@@ -1918,10 +2482,11 @@ int edit_replace_nacmcheck(xmlNodePtr orig_node, xmlDocPtr edit_doc, xmlDocPtr m
  * \param[in] edit_node Node from the edit-config's \<config\> element with
  * the specified "replace" operation.
  * \param[in] keys  List of the key elements from the configuration data model.
+ * \param[in] index Index of the orig_doc's list instances, can be NULL.
  *
  * \return Zero on success, non-zero otherwise.
  */
-static int edit_replace(xmlDocPtr orig_doc, xmlNodePtr edit_node, NC_EDIT_DEFOP_TYPE defop, xmlDocPtr model, keyList keys, const struct nacm_rpc* nacm, struct nc_err** error)
+static int edit_replace(xmlDocPtr orig_doc, xmlNodePtr edit_node, NC_EDIT_DEFOP_TYPE defop, xmlDocPtr model, keyList keys, struct edit_index* index, const struct nacm_rpc* nacm, struct nc_err** error)
 {
 	xmlNodePtr old;
 	int r;
@@ -1933,6 +2498,7 @@ static int edit_replace(xmlDocPtr orig_doc, xmlNodePtr edit_node, NC_EDIT_DEFOP_
 
 	if (edit_node == NULL) {
 		if ((r = nacm_check_data(orig_doc->children, NACM_ACCESS_DELETE, nacm)) == NACM_PERMIT) {
+			edit_index_remove(index, orig_doc->children);
 			return (edit_delete(orig_doc->children));
 		} else if (r == NACM_DENY) {
 			if (error != NULL) {
@@ -1950,10 +2516,10 @@ static int edit_replace(xmlDocPtr orig_doc, xmlNodePtr edit_node, NC_EDIT_DEFOP_
 		return (EXIT_FAILURE);
 	}
 
-	old = find_element_equiv(orig_doc, edit_node, model, keys);
+	old = find_element_equiv_indexed(orig_doc, edit_node, model, keys, index);
 	if (old == NULL) {
 		/* node to be replaced doesn't exist, so create new configuration data */
-		return edit_create(orig_doc, edit_node, defop, model, keys, nacm, error);
+		return edit_create(orig_doc, edit_node, defop, model, keys, index, nacm, error);
 	} else {
 		/* NACM */
 		if ((r = edit_replace_nacmcheck(old, edit_node->doc, model, keys, nacm, error)) != NACM_PERMIT) {
@@ -1983,9 +2549,10 @@ static int edit_replace(xmlDocPtr orig_doc, xmlNodePtr edit_node, NC_EDIT_DEFOP_
 		 * "moving" of the instance of the list/leaf-list using YANG's insert
 		 * attribute
 		 */
+		edit_index_remove(index, old);
 		xmlUnlinkNode(old);
 		xmlFreeNode(old);
-		return edit_create(orig_doc, edit_node, defop, model, keys, nacm, error);
+		return edit_create(orig_doc, edit_node, defop, model, keys, index, nacm, error);
 	}
 }
 
@@ -2094,21 +2661,6 @@ static int edit_merge_lists(xmlNodePtr merged_node, xmlNodePtr edit_node, xmlDoc
 	return (0);
 }
 
-static xmlNodePtr is_list(xmlNodePtr node, xmlDocPtr model)
-{
-	xmlNodePtr model_node;
-
-	model_node = find_element_model(node, model);
-	if (model_node == NULL) {
-		WARN("unknown element %s!", (char* )(node->name));
-		return (0);
-	} else if (xmlStrcmp(model_node->name, BAD_CAST "list") == 0) {
-		return (model_node);
-	} else {
-		return (NULL);
-	}
-}
-
 static int is_leaf_list(xmlNodePtr node, xmlDocPtr model)
 {
 	xmlNodePtr model_node;
@@ -2124,11 +2676,11 @@ static int is_leaf_list(xmlNodePtr node, xmlDocPtr model)
 	}
 }
 
-static int edit_merge_recursively(xmlNodePtr orig_node, xmlNodePtr edit_node, NC_EDIT_DEFOP_TYPE defop, xmlDocPtr model, keyList keys, const struct nacm_rpc* nacm, struct nc_err** error)
+static int edit_merge_recursively(xmlNodePtr orig_node, xmlNodePtr edit_node, NC_EDIT_DEFOP_TYPE defop, xmlDocPtr model, keyList keys, struct edit_index* index, const struct nacm_rpc* nacm, struct nc_err** error)
 {
 	xmlNodePtr children, aux, next, nextchild, parent;
 	int r, access, duplicates;
-	int leaf_list;
+	int leaf_list, unique;
 	char *msg = NULL;
 
 	/* process leaf text nodes - even if we are merging, leaf text nodes are
@@ -2200,6 +2752,7 @@ static int edit_merge_recursively(xmlNodePtr orig_node, xmlNodePtr edit_node, NC
 						return EXIT_FAILURE;
 					}
 					nc_clear_namespaces(aux);
+					edit_index_add(index, aux);
 				}
 			}
 		}
@@ -2210,6 +2763,7 @@ static int edit_merge_recursively(xmlNodePtr orig_node, xmlNodePtr edit_node, NC
 		/* skip checks if the node is text */
 		if (children->type == XML_TEXT_NODE) {
 			/* find text element to children */
+			unique = 0;
 			aux = orig_node->children;
 			while (aux != NULL && aux->type != XML_TEXT_NODE) {
 				aux = aux->next;
@@ -2228,10 +2782,7 @@ static int edit_merge_recursively(xmlNodePtr orig_node, xmlNodePtr edit_node, NC
 
 			/* find matching element to children */
 			leaf_list = is_leaf_list(children, model);
-			aux = orig_node->children;
-			while (aux != NULL && matching_elements(children, aux, keys, leaf_list) == 0) {
-				aux = aux->next;
-			}
+			aux = edit_index_find(index, orig_node, children, keys, leaf_list, &unique);
 		}
 
 		nextchild = children->next;
@@ -2241,7 +2792,7 @@ static int edit_merge_recursively(xmlNodePtr orig_node, xmlNodePtr edit_node, NC
 			 * original configuration data, so create it as new
 			 */
 			VERB("Adding a missing node %s while merging (%s:%d)", (char*)children->name, __FILE__, __LINE__);
-			if (edit_create(orig_node->doc, children, defop, model, keys, nacm, error) != 0) {
+			if (edit_create(orig_node->doc, children, defop, model, keys, index, nacm, error) != 0) {
 				ERROR("Adding missing nodes when merging failed (%s:%d)", __FILE__, __LINE__);
 				return EXIT_FAILURE;
 			}
@@ -2251,7 +2802,7 @@ static int edit_merge_recursively(xmlNodePtr orig_node, xmlNodePtr edit_node, NC
 				while (aux != NULL) {
 					next = aux->next;
 					if (aux->type == XML_TEXT_NODE) {
-						if (edit_merge_recursively(aux, children, defop, model, keys, nacm, error) != EXIT_SUCCESS) {
+						if (edit_merge_recursively(aux, children, defop, model, keys, index, nacm, error) != EXIT_SUCCESS) {
 							return EXIT_FAILURE;
 						}
 					}
@@ -2274,7 +2825,7 @@ static int edit_merge_recursively(xmlNodePtr orig_node, xmlNodePtr edit_node, NC
 				while (aux != NULL) {
 					next = aux->next;
 					if (matching_elements(children, aux, keys, leaf_list) != 0) {
-						if (edit_merge_recursively(aux, children, defop, model, keys, nacm, error) != EXIT_SUCCESS) {
+						if (edit_merge_recursively(aux, children, defop, model, keys, index, nacm, error) != EXIT_SUCCESS) {
 							return EXIT_FAILURE;
 						}
 
@@ -2297,9 +2848,13 @@ static int edit_merge_recursively(xmlNodePtr orig_node, xmlNodePtr edit_node, NC
 						default:
 							break;
 						}
-						if (edit_choice_clean(parent, children, model, nacm, error) == EXIT_FAILURE) {
+						if (edit_choice_clean(parent, children, model, index, nacm, error) == EXIT_FAILURE) {
 							return (EXIT_FAILURE);
 						}
+						if (unique) {
+							/* the index guarantees that no other sibling matches */
+							next = NULL;
+						}
 					}
 					aux = next;
 				}
@@ -2312,7 +2867,7 @@ static int edit_merge_recursively(xmlNodePtr orig_node, xmlNodePtr edit_node, NC
 	return EXIT_SUCCESS;
 }
 
-int edit_merge(xmlDocPtr orig_doc, xmlNodePtr edit_node, NC_EDIT_DEFOP_TYPE defop, xmlDocPtr model, keyList keys, const struct nacm_rpc* nacm, struct nc_err** error)
+static int edit_merge_indexed(xmlDocPtr orig_doc, xmlNodePtr edit_node, NC_EDIT_DEFOP_TYPE defop, xmlDocPtr model, keyList keys, struct edit_index* index, const struct nacm_rpc* nacm, struct nc_err** error)
 {
 	xmlNodePtr orig_node;
 	xmlNodePtr aux, children;
@@ -2328,9 +2883,9 @@ int edit_merge(xmlDocPtr orig_doc, xmlNodePtr edit_node, NC_EDIT_DEFOP_TYPE defo
 	}
 
 	VERB("Merging the node %s (%s:%d)", (char*)edit_node->name, __FILE__, __LINE__);
-	orig_node = find_element_equiv(orig_doc, edit_node, model, keys);
+	orig_node = find_element_equiv_indexed(orig_doc, edit_node, model, keys, index);
 	if (orig_node == NULL) {
-		return edit_create(orig_doc, edit_node, defop, model, keys, nacm, error);
+		return edit_create(orig_doc, edit_node, defop, model, keys, index, nacm, error);
 	}
 
 	children = edit_node->children;
@@ -2342,9 +2897,9 @@ int edit_merge(xmlDocPtr orig_doc, xmlNodePtr edit_node, NC_EDIT_DEFOP_TYPE defo
 				continue;
 			}
 
-			aux = find_element_equiv(orig_doc, children, model, keys);
+			aux = find_element_equiv_indexed(orig_doc, children, model, keys, index);
 		} else if (children->type == XML_TEXT_NODE) {
-			aux = find_element_equiv(orig_doc, children->parent, model, keys);
+			aux = find_element_equiv_indexed(orig_doc, children->parent, model, keys, index);
 			if (aux) {
 				aux = aux->children;
 			}
@@ -2383,10 +2938,11 @@ int edit_merge(xmlDocPtr orig_doc, xmlNodePtr edit_node, NC_EDIT_DEFOP_TYPE defo
 				ERROR("Adding missing nodes when merging failed (%s:%d)", __FILE__, __LINE__);
 				return EXIT_FAILURE;
 			}
+			edit_index_add(index, aux);
 		} else {
 			/* go recursive */
 			VERB("Merging the node %s (%s:%d)", (char*)children->name, __FILE__, __LINE__);
-			if (edit_merge_recursively(aux, children, defop, model, keys, nacm, error) != EXIT_SUCCESS) {
+			if (edit_merge_recursively(aux, children, defop, model, keys, index, nacm, error) != EXIT_SUCCESS) {
 				return EXIT_FAILURE;
 			}
 
@@ -2395,7 +2951,7 @@ int edit_merge(xmlDocPtr orig_doc, xmlNodePtr edit_node, NC_EDIT_DEFOP_TYPE defo
 			}
 		}
 
-		if (edit_choice_clean(aux->parent, children, model, nacm, error) == EXIT_FAILURE) {
+		if (edit_choice_clean(aux->parent, children, model, index, nacm, error) == EXIT_FAILURE) {
 			return (EXIT_FAILURE);
 		}
 
@@ -2407,6 +2963,18 @@ int edit_merge(xmlDocPtr orig_doc, xmlNodePtr edit_node, NC_EDIT_DEFOP_TYPE defo
 	return EXIT_SUCCESS;
 }
 
+int edit_merge(xmlDocPtr orig_doc, xmlNodePtr edit_node, NC_EDIT_DEFOP_TYPE defop, xmlDocPtr model, keyList keys, const struct nacm_rpc* nacm, struct nc_err** error)
+{
+	struct edit_index* index;
+	int ret;
+
+	index = edit_index_new(keys);
+	ret = edit_merge_indexed(orig_doc, edit_node, defop, model, keys, index, nacm, error);
+	edit_index_free(index);
+
+	return (ret);
+}
+
 /**
  * \brief Perform all the edit-config's operations specified in the edit_doc document.
  *
@@ -2416,20 +2984,21 @@ int edit_merge(xmlDocPtr orig_doc, xmlNodePtr edit_node, NC_EDIT_DEFOP_TYPE defo
  * \param[in] defop Default edit-config's operation for this edit-config call.
  * \param[in] model XML form (YIN) of the configuration data model appropriate
  * to the given configuration data.
+ * \param[in] keys Compiled list keys of the configuration data model.
  * \param[out] err NETCONF error structure.
  *
  * \return On error, non-zero is returned and err structure is filled. Zero is
  *         returned on success.
  */
-static int edit_operations(xmlDocPtr orig_doc, xmlDocPtr edit_doc, NC_EDIT_DEFOP_TYPE defop, xmlDocPtr model, const struct nacm_rpc* nacm, struct nc_err **error)
+static int edit_operations(xmlDocPtr orig_doc, xmlDocPtr edit_doc, NC_EDIT_DEFOP_TYPE defop, xmlDocPtr model, keyList keys, const struct nacm_rpc* nacm, struct nc_err **error)
 {
 	xmlXPathObjectPtr nodes;
 	int i;
 	char *msg = NULL;
 	xmlNodePtr orig_node, edit_node;
-	keyList keys;
+	struct edit_index* index;
 
-	keys = get_keynode_list(model);
+	index = edit_index_new(keys);
 
 	if (error != NULL) {
 		*error = NULL;
@@ -2439,7 +3008,7 @@ static int edit_operations(xmlDocPtr orig_doc, xmlDocPtr edit_doc, NC_EDIT_DEFOP
 	if (defop == NC_EDIT_DEFOP_REPLACE) {
 		/* replace whole document */
 		for (edit_node = edit_doc->children; edit_node != NULL; edit_node = edit_doc->children) {
-			edit_replace(orig_doc, edit_node, defop, model, keys, nacm, error);
+			edit_replace(orig_doc, edit_node, defop, model, keys, index, nacm, error);
 		}
 
 		/* according to RFC 6020 sec. 7.2, default-operation "replace"
@@ -2455,7 +3024,7 @@ static int edit_operations(xmlDocPtr orig_doc, xmlDocPtr edit_doc, NC_EDIT_DEFOP
 			/* something to delete */
 			for (i = 0; i < nodes->nodesetval->nodeNr; i++) {
 				edit_node = nodes->nodesetval->nodeTab[i];
-				orig_node = find_element_equiv(orig_doc, edit_node, model, keys);
+				orig_node = find_element_equiv_indexed(orig_doc, edit_node, model, keys, index);
 				if (orig_node == NULL) {
 					xmlXPathFreeObject(nodes);
 					if (error != NULL) {
@@ -2463,10 +3032,11 @@ static int edit_operations(xmlDocPtr orig_doc, xmlDocPtr edit_doc, NC_EDIT_DEFOP
 					}
 					goto error;
 				}
-				for (; orig_node != NULL; orig_node = find_element_equiv(orig_doc, edit_node, model, keys)) {
+				for (; orig_node != NULL; orig_node = find_element_equiv_indexed(orig_doc, edit_node, model, keys, index)) {
 					/* NACM */
 					if (nacm_check_data(orig_node, NACM_ACCESS_DELETE, nacm) == NACM_PERMIT) {
 						/* remove the edit node's equivalent from the original document */
+						edit_index_remove(index, orig_node);
 						edit_delete(orig_node);
 					} else {
 						if (error != NULL ) {
@@ -2494,7 +3064,7 @@ static int edit_operations(xmlDocPtr orig_doc, xmlDocPtr edit_doc, NC_EDIT_DEFOP
 		if (!xmlXPathNodeSetIsEmpty(nodes->nodesetval)) {
 			/* something to remove */
 			for (i = 0; i < nodes->nodesetval->nodeNr; i++) {
-				if (edit_remove(orig_doc, nodes->nodesetval->nodeTab[i], model, keys, nacm, error) != EXIT_SUCCESS) {
+				if (edit_remove(orig_doc, nodes->nodesetval->nodeTab[i], model, keys, index, nacm, error) != EXIT_SUCCESS) {
 					xmlXPathFreeObject(nodes);
 					goto error;
 				}
@@ -2510,7 +3080,7 @@ static int edit_operations(xmlDocPtr orig_doc, xmlDocPtr edit_doc, NC_EDIT_DEFOP
 		if (!xmlXPathNodeSetIsEmpty(nodes->nodesetval)) {
 			/* something to replace */
 			for (i = 0; i < nodes->nodesetval->nodeNr; i++) {
-				if (edit_replace(orig_doc, nodes->nodesetval->nodeTab[i], defop, model, keys, nacm, error) != EXIT_SUCCESS) {
+				if (edit_replace(orig_doc, nodes->nodesetval->nodeTab[i], defop, model, keys, index, nacm, error) != EXIT_SUCCESS) {
 					xmlXPathFreeObject(nodes);
 					goto error;
 				}
@@ -2526,7 +3096,7 @@ static int edit_operations(xmlDocPtr orig_doc, xmlDocPtr edit_doc, NC_EDIT_DEFOP
 		if (!xmlXPathNodeSetIsEmpty(nodes->nodesetval)) {
 			/* something to create */
 			for (i = 0; i < nodes->nodesetval->nodeNr; i++) {
-				if (edit_create(orig_doc, nodes->nodesetval->nodeTab[i], defop, model, keys, nacm, error) != EXIT_SUCCESS) {
+				if (edit_create(orig_doc, nodes->nodesetval->nodeTab[i], defop, model, keys, index, nacm, error) != EXIT_SUCCESS) {
 					xmlXPathFreeObject(nodes);
 					goto error;
 				}
@@ -2542,7 +3112,7 @@ static int edit_operations(xmlDocPtr orig_doc, xmlDocPtr edit_doc, NC_EDIT_DEFOP
 		if (!xmlXPathNodeSetIsEmpty(nodes->nodesetval)) {
 			/* something to create */
 			for (i = 0; i < nodes->nodesetval->nodeNr; i++) {
-				if (edit_merge(orig_doc, nodes->nodesetval->nodeTab[i], defop, model, keys, nacm, error) != EXIT_SUCCESS) {
+				if (edit_merge_indexed(orig_doc, nodes->nodesetval->nodeTab[i], defop, model, keys, index, nacm, error) != EXIT_SUCCESS) {
 					xmlXPathFreeObject(nodes);
 					goto error;
 				}
@@ -2557,7 +3127,7 @@ static int edit_operations(xmlDocPtr orig_doc, xmlDocPtr edit_doc, NC_EDIT_DEFOP
 		/* replace whole document */
 		if (edit_doc->children != NULL) {
 			for (edit_node = edit_doc->children; edit_node != NULL; edit_node = edit_doc->children) {
-				if (edit_merge(orig_doc, edit_doc->children, defop, model, keys, nacm, error) != EXIT_SUCCESS) {
+				if (edit_merge_indexed(orig_doc, edit_doc->children, defop, model, keys, index, nacm, error) != EXIT_SUCCESS) {
 					goto error;
 				}
 			}
@@ -2566,17 +3136,13 @@ static int edit_operations(xmlDocPtr orig_doc, xmlDocPtr edit_doc, NC_EDIT_DEFOP
 
 cleanup:
 
-	if (keys != NULL) {
-		keyListFree(keys);
-	}
+	edit_index_free(index);
 
 	return EXIT_SUCCESS;
 
 error:
 
-	if (keys != NULL ) {
-		keyListFree(keys);
-	}
+	edit_index_free(index);
 
 	if (error != NULL && *error == NULL) {
 		*error = nc_err_new(NC_ERR_OP_FAILED);
@@ -2662,16 +3228,13 @@ static int compact_edit_operations(xmlDocPtr edit_doc, NC_EDIT_DEFOP_TYPE defop)
 	return EXIT_SUCCESS;
 }
 
-static int check_list_keys(xmlDocPtr edit, xmlDocPtr model, struct nc_err **error)
+static int check_list_keys(xmlDocPtr edit, keyList modelkeys, struct nc_err **error)
 {
-	xmlNodePtr listdef;
+	const struct model_list_keys* list;
 	xmlNodePtr *keys = NULL;
 	xmlNodePtr node, next;
-	keyList modelkeys;
 	int ret = EXIT_SUCCESS;
-	int i;
 
-	modelkeys = get_keynode_list(model);
 	if (!modelkeys) {
 		/* no keys in the model */
 		return ret;
@@ -2679,24 +3242,15 @@ static int check_list_keys(xmlDocPtr edit, xmlDocPtr model, struct nc_err **erro
 
 	node = xmlDocGetRootElement(edit);
 	while (node) {
-		if ((listdef = is_list(node, model)) != NULL) {
-			for (i = 0; i < modelkeys->nodesetval->nodeNr; i++) {
-				if (modelkeys->nodesetval->nodeTab[i]->parent == listdef) {
-					break;
-				}
+		if ((list = get_list_keys(modelkeys, node)) != NULL) {
+			/* find out if all the keys are present in edit data */
+			if (find_key_elems(list, node, 1, &keys)) {
+				ret = EXIT_FAILURE;
+				goto cleanup;
 			}
-
-			if (i < modelkeys->nodesetval->nodeNr) {
-				/* find out if all the keys are present in edit data */
-				if (find_key_elems(modelkeys->nodesetval->nodeTab[i], node, 1, &keys)) {
-					ret = EXIT_FAILURE;
-					goto cleanup;
-				}
-				free(keys);
-				keys = NULL;
-
-			} /* else list has no keys */
-		}
+			free(keys);
+			keys = NULL;
+		} /* else not a list or list has no keys */
 
 		/* go to the next element to process (depth-first processing) */
 		/* children first */
@@ -2735,8 +3289,6 @@ static int check_list_keys(xmlDocPtr edit, xmlDocPtr model, struct nc_err **erro
 
 cleanup:
 
-	keyListFree(modelkeys);
-
 	if (ret && error != NULL) {
 		*error = nc_err_new(NC_ERR_MISSING_ELEM);
 		nc_err_set(*error, NC_ERR_PARAM_INFO_BADELEM, (char*)node->name);
@@ -2756,25 +3308,28 @@ cleanup:
  * \param[in] defop Default edit-config's operation for this edit-config call.
  * \param[in] errop NETCONF edit-config's error option defining reactions to an error.
  * \param[in] nacm NACM structure of the request RPC to check Access Rights
+ * \param[out] record Record to fill with the touched nodes, can be NULL.
  * \param[out] err NETCONF error structure.
  * \return On error, non-zero is returned and err structure is filled. Zero is
  * returned on success.
  */
-int edit_config(xmlDocPtr repo, xmlDocPtr edit, struct ncds_ds* ds, NC_EDIT_DEFOP_TYPE defop, NC_EDIT_ERROPT_TYPE UNUSED(errop), const struct nacm_rpc* nacm, struct nc_err **error)
+int edit_config(xmlDocPtr repo, xmlDocPtr edit, struct ncds_ds* ds, NC_EDIT_DEFOP_TYPE defop, NC_EDIT_ERROPT_TYPE UNUSED(errop), const struct nacm_rpc* nacm, struct edit_record* record, struct nc_err **error)
 {
+	struct edit_index* index;
+
 	if (repo == NULL || edit == NULL) {
 		return (EXIT_FAILURE);
 	}
 
 	/* check validity - for list instances, all keys must be present */
-	if (check_list_keys(edit, ds->ext_model, error) != EXIT_SUCCESS) {
+	if (check_list_keys(edit, ds->ext_model_keys, error) != EXIT_SUCCESS) {
 		goto error_cleanup;
 	}
 	/* check operations */
-	if (check_edit_ops(NC_CHECK_EDIT_DELETE, defop, repo, edit, ds->ext_model, error) != EXIT_SUCCESS) {
+	if (check_edit_ops(NC_CHECK_EDIT_DELETE, defop, repo, edit, ds->ext_model, ds->ext_model_keys, error) != EXIT_SUCCESS) {
 		goto error_cleanup;
 	}
-	if (check_edit_ops(NC_CHECK_EDIT_CREATE, defop, repo, edit, ds->ext_model, error) != EXIT_SUCCESS) {
+	if (check_edit_ops(NC_CHECK_EDIT_CREATE, defop, repo, edit, ds->ext_model, ds->ext_model_keys, error) != EXIT_SUCCESS) {
 		goto error_cleanup;
 	}
 
@@ -2786,8 +3341,19 @@ int edit_config(xmlDocPtr repo, xmlDocPtr edit, struct ncds_ds* ds, NC_EDIT_DEFO
 		goto error_cleanup;
 	}
 
+	/* remember what is going to be changed, replacing the whole document
+	 * touches everything */
+	if (record != NULL && defop != NC_EDIT_DEFOP_REPLACE) {
+		index = edit_index_new(ds->ext_model_keys);
+		edit_record_collect(record, (xmlNodePtr)repo, edit->children, index);
+		edit_index_free(index);
+		if (record->complete == 0) {
+			record->complete = 1;
+		}
+	}
+
 	/* perform operations */
-	if (edit_operations(repo, edit, defop, ds->ext_model, nacm, error) != EXIT_SUCCESS) {
+	if (edit_operations(repo, edit, defop, ds->ext_model, ds->ext_model_keys, nacm, error) != EXIT_SUCCESS) {
 		goto error_cleanup;
 	}
 
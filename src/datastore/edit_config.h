@@ -39,6 +39,7 @@
 
 #include <libxml/tree.h>
 #include <libxml/xpath.h>
+#include <libxml/hash.h>
 
 #include "datastore_internal.h"
 #include "../netconf.h"
@@ -48,11 +49,89 @@
 #ifndef NC_EDIT_CONFIG_H_
 #define NC_EDIT_CONFIG_H_
 
-typedef xmlXPathObjectPtr keyList;
-#define keyListFree(x) xmlXPathFreeObject((xmlXPathObjectPtr)x)
+/**
+ * \brief Key leaves of a list from the configuration data model.
+ */
+struct model_list_keys {
+	char** names; /**< names of the key leaves in the order of the key statement */
+	int count;    /**< number of the key leaves */
+};
 
+/**
+ * \brief Compiled keys of the configuration data model.
+ *
+ * Key leaves of the lists are indexed by the schema path of the list made of
+ * the names of its data node ancestors (e.g. "top/item") together with the
+ * namespace of the list's data nodes.
+ */
+struct model_keys {
+	xmlHashTablePtr lists;
+	struct model_list_keys* list;
+	int count;
+	int nons;     /**< number of the lists with the namespace not known from the model */
+};
+
+typedef struct model_keys* keyList;
+
+/**
+ * \brief Compile the keys of all the lists from the configuration data model.
+ *
+ * \param[in] model XML form (YIN) of the configuration data model.
+ * \return Compiled keys to be freed by keyListFree(), NULL if the model has no
+ * keyed list.
+ */
 keyList get_keynode_list(xmlDocPtr model);
 
+/**
+ * \brief Free the compiled keys of the configuration data model.
+ *
+ * \param[in] keys Compiled keys from get_keynode_list().
+ */
+void keyListFree(keyList keys);
+
+/**
+ * \brief Get the key leaves of the list the given data node is an instance of.
+ *
+ * \param[in] keys Compiled keys of the configuration data model.
+ * \param[in] node Data node from a configuration document.
+ * \return Key leaves of the list, NULL if the node is not an instance of a keyed list.
+ */
+const struct model_list_keys* get_list_keys(keyList keys, xmlNodePtr node);
+
+/**
+ * \brief Record of the configuration data nodes touched by an edit-config.
+ *
+ * It is filled by edit_config() and allows to limit the search for the
+ * changes made by the edit to the touched subtrees.
+ */
+struct edit_record;
+
+/**
+ * \brief Create an empty edit-config record.
+ *
+ * \param[in] keys Compiled keys of the configuration data model.
+ * \return Record to be freed by edit_record_free(), NULL on error.
+ */
+struct edit_record* edit_record_new(keyList keys);
+
+/**
+ * \brief Free the edit-config record.
+ *
+ * \param[in] record Record to free.
+ */
+void edit_record_free(struct edit_record* record);
+
+/**
+ * \brief Decide whether the content of the node could be changed by the
+ * recorded edit-config.
+ *
+ * \param[in] record Record filled by edit_config(), NULL if not available.
+ * \param[in] node Node from the configuration data before the edit.
+ * \return 0 if the node and its descendants were not touched by the edit,
+ * non-zero otherwise (also if the record is not available or incomplete).
+ */
+int edit_record_touched(const struct edit_record* record, xmlNodePtr node);
+
 /**
  * \brief Compare 2 elements and decide if they are equal for NETCONF.
  *
@@ -98,11 +177,12 @@ xmlNodePtr find_element_model(xmlNodePtr node, xmlDocPtr model);
  * \param[in] defop Default edit-config's operation for this edit-config call.
  * \param[in] errop NETCONF edit-config's error option defining reactions to an error.
  * \param[in] nacm NACM structure of the request RPC to check Access Rights
+ * \param[out] record Record to fill with the touched nodes, can be NULL.
  * \param[out] err NETCONF error structure.
  * \return On error, non-zero is returned and err structure is filled. Zero is
  * returned on success.
  */
-int edit_config(xmlDocPtr repo, xmlDocPtr edit, struct ncds_ds* ds, NC_EDIT_DEFOP_TYPE defop, NC_EDIT_ERROPT_TYPE UNUSED(errop), const struct nacm_rpc* nacm, struct nc_err **error);
+int edit_config(xmlDocPtr repo, xmlDocPtr edit, struct ncds_ds* ds, NC_EDIT_DEFOP_TYPE defop, NC_EDIT_ERROPT_TYPE UNUSED(errop), const struct nacm_rpc* nacm, struct edit_record* record, struct nc_err **error);
 
 int edit_replace_nacmcheck(xmlNodePtr orig_node, xmlDocPtr edit_doc, xmlDocPtr model, keyList keys, const struct nacm_rpc* nacm, struct nc_err** error);
 int edit_merge(xmlDocPtr orig_doc, xmlNodePtr edit_node, NC_EDIT_DEFOP_TYPE defop, xmlDocPtr model, keyList keys, const struct nacm_rpc* nacm, struct nc_err** error);
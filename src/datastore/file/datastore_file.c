@@ -44,6 +44,7 @@
 #include <stdlib.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
 #include <fcntl.h>
 #include <string.h>
 #include <errno.h>
@@ -72,28 +73,103 @@ static const char rcsid[] __attribute__((used)) ="$Id: "__FILE__": "RCSID" $";
   <candidate modified=\"false\" lock=\"\"/>\
 </datastores>"
 
-static struct timespec tv_timeout;
-static sigset_t fullsigset;
-
-#define LOCK(file_ds, ret) {\
-	sigfillset(&fullsigset);\
-	sigprocmask(SIG_SETMASK, &fullsigset, &(file_ds->ds_lock.sigset));\
-	clock_gettime(CLOCK_REALTIME, &tv_timeout);\
-	tv_timeout.tv_sec += NCDS_LOCK_TIMEOUT;\
-	if (sem_timedwait(file_ds->ds_lock.lock, &tv_timeout) == -1 && errno == ETIMEDOUT) {\
-		ret = 1;\
-		sigprocmask(SIG_SETMASK, &(file_ds->ds_lock.sigset), NULL);\
-	} else {\
-		ret = 0;\
-		file_ds->ds_lock.holding_lock = 1;\
-	}\
+/* local function declaration */
+static int file_sync(struct ncds_ds_file* file_ds);
+static int file_reparse(struct ncds_ds_file* file_ds);
+
+/**
+ * @brief Lock the datastore for the exclusive access of the calling thread. The
+ * threads of the process are serialized by the rwlock, the processes by the
+ * robust mutex in the shared memory or by the semaphore if it is not available.
+ * All the signals are blocked until file_ds_unlock().
+ *
+ * @return 0 on success, 1 if the lock was not acquired in NCDS_LOCK_TIMEOUT seconds.
+ */
+static int file_ds_lock(struct ncds_ds_file* file_ds)
+{
+	struct timespec timeout;
+	sigset_t fullsigset, sigset;
+	int r;
+
+	sigfillset(&fullsigset);
+	sigprocmask(SIG_SETMASK, &fullsigset, &sigset);
+	clock_gettime(CLOCK_REALTIME, &timeout);
+	timeout.tv_sec += NCDS_LOCK_TIMEOUT;
+
+	if (pthread_rwlock_timedwrlock(&(file_ds->ds_lock.rwlock), &timeout) != 0) {
+		sigprocmask(SIG_SETMASK, &sigset, NULL);
+		return (1);
+	}
+
+	if (file_ds->shared != NULL) {
+		r = pthread_mutex_timedlock(&(file_ds->shared->lock), &timeout);
+		if (r == EOWNERDEAD) {
+			/* the previous holder died, make everyone read the datastore again */
+			WARN("Process holding the lock of the datastore file %s died, reloading the datastore.", file_ds->path);
+			pthread_mutex_consistent(&(file_ds->shared->lock));
+			__atomic_add_fetch(&(file_ds->shared->file_generation), 1, __ATOMIC_SEQ_CST);
+			__atomic_add_fetch(&(file_ds->shared->generation), 1, __ATOMIC_SEQ_CST);
+			r = 0;
+		}
+	} else if (sem_timedwait(file_ds->ds_lock.lock, &timeout) == -1) {
+		r = errno;
+	} else {
+		r = 0;
+	}
+	if (r != 0) {
+		pthread_rwlock_unlock(&(file_ds->ds_lock.rwlock));
+		sigprocmask(SIG_SETMASK, &sigset, NULL);
+		return (1);
+	}
+
+	file_ds->ds_lock.sigset = sigset;
+	file_ds->ds_lock.holding_lock = 1;
+	return (0);
 }
-#define UNLOCK(file_ds) {\
-	sem_post(file_ds->ds_lock.lock);\
-	file_ds->ds_lock.holding_lock = 0;\
-	sigprocmask(SIG_SETMASK, &(file_ds->ds_lock.sigset), NULL);\
+
+/**
+ * @brief Unlock the datastore locked by file_ds_lock().
+ */
+static void file_ds_unlock(struct ncds_ds_file* file_ds)
+{
+	sigset_t sigset = file_ds->ds_lock.sigset;
+
+	if (file_ds->shared != NULL) {
+		pthread_mutex_unlock(&(file_ds->shared->lock));
+	} else {
+		sem_post(file_ds->ds_lock.lock);
+	}
+	file_ds->ds_lock.holding_lock = 0;
+	pthread_rwlock_unlock(&(file_ds->ds_lock.rwlock));
+	sigprocmask(SIG_SETMASK, &sigset, NULL);
 }
 
+/**
+ * @brief Lock the datastore for reading in parallel with the other readers. It
+ * succeeds only if the xml is known to be up to date, so the reader does not need
+ * the files nor the lock of the processes.
+ *
+ * @return 1 if locked for reading, 0 if file_ds_lock() must be used instead.
+ */
+static int file_ds_rdlock(struct ncds_ds_file* file_ds)
+{
+	if (file_ds->shared == NULL || pthread_rwlock_rdlock(&(file_ds->ds_lock.rwlock)) != 0) {
+		return (0);
+	}
+
+	/* generation is changed by the writers before they change anything */
+	if (__atomic_load_n(&(file_ds->shared->generation), __ATOMIC_ACQUIRE) != file_ds->generation) {
+		pthread_rwlock_unlock(&(file_ds->ds_lock.rwlock));
+		return (0);
+	}
+
+	return (1);
+}
+
+#define LOCK(file_ds, ret) ret = file_ds_lock(file_ds)
+#define UNLOCK(file_ds) file_ds_unlock(file_ds)
+#define RDUNLOCK(file_ds) pthread_rwlock_unlock(&(file_ds->ds_lock.rwlock))
+
 /**
  * @brief Determine if the datastore is accessible (is not NETCONF locked) for the
  * specified session. This function MUST be called between LOCK and UNLOCK
@@ -308,10 +384,662 @@ invalid_ds:
 	return (EXIT_FAILURE);
 }
 
+/*
+ * JOURNAL FILE FORMAT
+ * "NCJOURNAL <inode>\n" - inode of the datastore file the journal belongs to
+ * records[]:
+ *   "NCJ <op> <target> <arg1> <arg2> <name> <len>\n" <data[len]> "\n"
+ *
+ * Instead of rewriting the whole datastore file, the changes are appended
+ * into the journal as records:
+ *   'e' - edit-config with the data as the config, arg1 is the default
+ *         operation and arg2 is the error option
+ *   'r' - replace the target content with the data
+ *   'c' - copy the content of the arg1 datastore into the target
+ *   'a' - set the target's attribute name to the value in data
+ *
+ * When the journal gets too big, the datastore file is rewritten (as a new
+ * file renamed over the original one) and the journal is emptied. A journal
+ * left from another version of the datastore file is ignored.
+ */
+#define JOURNAL_MAGIC "NCJOURNAL"
+#define JOURNAL_RECORD "NCJ"
+
+static xmlNodePtr file_ds_node(struct ncds_ds_file* file_ds, NC_DATASTORE target)
+{
+	switch(target) {
+	case NC_DATASTORE_RUNNING:
+		return (file_ds->running);
+	case NC_DATASTORE_STARTUP:
+		return (file_ds->startup);
+	case NC_DATASTORE_CANDIDATE:
+		return (file_ds->candidate);
+	default:
+		return (NULL);
+	}
+}
+
+/**
+ * @brief Drop the serialized content of the target datastore, all the
+ * datastores for NC_DATASTORE_ERROR.
+ */
+static void file_snapshot_drop(struct ncds_ds_file* file_ds, NC_DATASTORE target)
+{
+	int i;
+
+	for (i = 0; i < 3; i++) {
+		if (target == NC_DATASTORE_ERROR || target == (NC_DATASTORE) (NC_DATASTORE_RUNNING + i)) {
+			free(file_ds->snapshot[i]);
+			file_ds->snapshot[i] = NULL;
+		}
+	}
+}
+
+/**
+ * @brief Forget the rollback backup of the last change.
+ */
+static void file_rollback_drop(struct ncds_ds_file* file_ds)
+{
+	xmlFreeDoc(file_ds->xml_rollback);
+	file_ds->xml_rollback = NULL;
+	file_ds->rollback_target = NC_DATASTORE_ERROR;
+	xmlFree(file_ds->rollback_modified);
+	file_ds->rollback_modified = NULL;
+}
+
+/**
+ * @brief Replace the content of the target datastore node with the top level
+ * nodes of the new_content document, they are moved, not copied. The replaced
+ * content is moved into the rollback backup if the current change has not
+ * saved any yet, freed otherwise.
+ *
+ * @param file_ds Datastore being changed.
+ * @param target_ds Datastore node to fill.
+ * @param new_content Document with the new content, NULL to only remove the
+ * current content. The document is left empty.
+ */
+static void file_replace_content(struct ncds_ds_file* file_ds, xmlNodePtr target_ds, xmlDocPtr new_content)
+{
+	xmlNodePtr aux_node, backup = NULL;
+	NC_DATASTORE target;
+
+	if (file_ds->xml_rollback != NULL && file_ds->rollback_target == NC_DATASTORE_ERROR) {
+		for (target = NC_DATASTORE_RUNNING; target <= NC_DATASTORE_CANDIDATE; target++) {
+			if (file_ds_node(file_ds, target) == target_ds) {
+				backup = xmlDocGetRootElement(file_ds->xml_rollback);
+				file_ds->rollback_target = target;
+				break;
+			}
+		}
+	}
+
+	while ((aux_node = target_ds->children) != NULL) {
+		xmlUnlinkNode(aux_node);
+		if (backup != NULL) {
+			xmlAddChild(backup, aux_node);
+		} else {
+			xmlFreeNode(aux_node);
+		}
+	}
+
+	if (new_content != NULL) {
+		while ((aux_node = new_content->children) != NULL) {
+			xmlUnlinkNode(aux_node);
+			xmlAddChild(target_ds, aux_node);
+		}
+	}
+}
+
+/**
+ * @brief Apply edit-config on the target datastore node, the touched nodes are
+ * recorded into the record if not NULL.
+ */
+static int file_edit_apply(struct ncds_ds_file* file_ds, xmlNodePtr target_ds, xmlDocPtr config_doc, NC_EDIT_DEFOP_TYPE defop, NC_EDIT_ERROPT_TYPE errop, const struct nacm_rpc* nacm, struct edit_record* record, struct nc_err **error)
+{
+	xmlDocPtr datastore_doc;
+	xmlNodePtr aux_node, root;
+	int retval = EXIT_SUCCESS;
+
+	/* create an XML doc with a copy of the datastore configuration */
+	datastore_doc = xmlNewDoc (BAD_CAST "1.0");
+	xmlDocSetRootElement(datastore_doc, xmlCopyNode(target_ds->children, 1));
+	if (target_ds->children) {
+		for (root = target_ds->children->next; root != NULL; root = aux_node) {
+			aux_node = root->next;
+			xmlAddNextSibling(datastore_doc->last, xmlCopyNode(root, 1));
+		}
+	}
+
+	/* preform edit config */
+	if (edit_config(datastore_doc, config_doc, (struct ncds_ds*)file_ds, defop, errop, nacm, record, error)) {
+		retval = EXIT_FAILURE;
+	} else {
+		/* replace datastore by edited configuration */
+		file_replace_content(file_ds, target_ds, datastore_doc);
+	}
+	xmlFreeDoc(datastore_doc);
+
+	return (retval);
+}
+
+/**
+ * @brief Add a record into the journal records of the current operation,
+ * they are written by file_sync().
+ */
+static void file_journal_add(struct ncds_ds_file* file_ds, char op, NC_DATASTORE target, int arg1, int arg2, const char* name, const char* data, size_t len)
+{
+	char header[128];
+
+	if (file_ds->journal_records == NULL && (file_ds->journal_records = xmlBufferCreate()) == NULL) {
+		ERROR("%s: xmlBufferCreate failed (%s:%d).", __func__, __FILE__, __LINE__);
+		return;
+	}
+	if (data == NULL) {
+		len = 0;
+	}
+	if (op != 'a') {
+		/* the content of the target datastore was changed */
+		file_snapshot_drop(file_ds, target);
+	}
+
+	snprintf(header, sizeof(header), JOURNAL_RECORD" %c %d %d %d %s %zu\n", op, target, arg1, arg2, (name == NULL) ? "-" : name, len);
+	xmlBufferCCat(file_ds->journal_records, header);
+	if (len > 0) {
+		xmlBufferAdd(file_ds->journal_records, BAD_CAST data, len);
+	}
+	xmlBufferCCat(file_ds->journal_records, "\n");
+}
+
+static void file_journal_add_attr(struct ncds_ds_file* file_ds, NC_DATASTORE target, const char* name, const char* value)
+{
+	file_journal_add(file_ds, 'a', target, 0, 0, name, value, strlen(value));
+}
+
+/**
+ * @brief Add a record replacing the content of the target datastore with its
+ * current content.
+ */
+static void file_journal_add_content(struct ncds_ds_file* file_ds, NC_DATASTORE target)
+{
+	xmlBufferPtr buf;
+	xmlNodePtr aux_node;
+
+	if ((buf = xmlBufferCreate()) == NULL) {
+		ERROR("%s: xmlBufferCreate failed (%s:%d).", __func__, __FILE__, __LINE__);
+		return;
+	}
+	for (aux_node = file_ds_node(file_ds, target)->children; aux_node != NULL; aux_node = aux_node->next) {
+		xmlNodeDump(buf, file_ds->xml, aux_node, 0, 0);
+	}
+	file_journal_add(file_ds, 'r', target, 0, 0, NULL, (char*) xmlBufferContent(buf), xmlBufferLength(buf));
+	xmlBufferFree(buf);
+}
+
+/**
+ * @brief Read the config data of a journal record.
+ */
+static xmlDocPtr file_journal_config(const char* data, size_t len)
+{
+	char* aux;
+	xmlDocPtr doc;
+
+	if (asprintf(&aux, "<config>%.*s</config>", (int) len, data) == -1) {
+		ERROR("asprintf() failed (%s:%d).", __FILE__, __LINE__);
+		return (NULL);
+	}
+	doc = xmlReadMemory(aux, strlen(aux), NULL, NULL, NC_XMLREAD_OPTIONS);
+	free(aux);
+
+	return (doc);
+}
+
+/**
+ * @brief Apply a single journal record on the xml.
+ */
+static int file_journal_apply(struct ncds_ds_file* file_ds, char op, NC_DATASTORE target, int arg1, int arg2, const char* name, const char* data, size_t len)
+{
+	xmlDocPtr config_doc;
+	xmlNodePtr target_ds, source_ds, aux_node, root;
+	struct nc_err* e = NULL;
+	char* value;
+	int ret = EXIT_SUCCESS;
+
+	if ((target_ds = file_ds_node(file_ds, target)) == NULL) {
+		return (EXIT_FAILURE);
+	}
+	if (op != 'a') {
+		file_snapshot_drop(file_ds, target);
+	}
+
+	switch (op) {
+	case 'e':
+		if ((config_doc = file_journal_config(data, len)) == NULL) {
+			return (EXIT_FAILURE);
+		}
+		/* get off the root config element and move all children to the 1st level */
+		root = xmlDocGetRootElement(config_doc);
+		for (aux_node = root->children; aux_node != NULL; aux_node = root->children) {
+			xmlUnlinkNode(aux_node);
+			xmlAddNextSibling(config_doc->last, aux_node);
+		}
+		xmlUnlinkNode(root);
+		xmlFreeNode(root);
+
+		ret = file_edit_apply(file_ds, target_ds, config_doc, (NC_EDIT_DEFOP_TYPE) arg1, (NC_EDIT_ERROPT_TYPE) arg2, NULL, NULL, &e);
+		nc_err_free(e);
+		xmlFreeDoc(config_doc);
+		break;
+	case 'r':
+	case 'c':
+		if (op == 'r') {
+			if ((config_doc = file_journal_config(data, len)) == NULL) {
+				return (EXIT_FAILURE);
+			}
+			source_ds = config_doc->children->children;
+		} else {
+			config_doc = NULL;
+			if ((source_ds = file_ds_node(file_ds, (NC_DATASTORE) arg1)) == NULL) {
+				return (EXIT_FAILURE);
+			}
+			source_ds = source_ds->children;
+		}
+		while ((aux_node = target_ds->children) != NULL) {
+			xmlUnlinkNode(aux_node);
+			xmlFreeNode(aux_node);
+		}
+		xmlAddChildList(target_ds, xmlCopyNodeList(source_ds));
+		xmlFreeDoc(config_doc);
+		break;
+	case 'a':
+		if ((value = strndup(data, len)) == NULL) {
+			return (EXIT_FAILURE);
+		}
+		xmlSetProp(target_ds, BAD_CAST name, BAD_CAST value);
+		free(value);
+		break;
+	default:
+		return (EXIT_FAILURE);
+	}
+
+	return (ret);
+}
+
+/**
+ * @brief Apply the journal records written after the journal_offset.
+ *
+ * @param file_ds Datastore with the journal.
+ * @param recover Flag to cut off the incompletely written records, possible only
+ * when the caller holds the datastore lock.
+ * @return EXIT_SUCCESS or EXIT_FAILURE
+ */
+static int file_journal_replay(struct ncds_ds_file* file_ds, int recover)
+{
+	struct stat st;
+	char *buf, *rec, *end, *data;
+	char op, name[64];
+	int target, arg1, arg2, n;
+	size_t len, size;
+	ssize_t r;
+	unsigned long long ino;
+
+	if (fstat(file_ds->journal_fd, &st) == -1) {
+		ERROR("%s: fstat() on the journal %s failed (%s).", __func__, file_ds->journal_path, strerror(errno));
+		return (EXIT_FAILURE);
+	}
+	if (st.st_size <= file_ds->journal_offset) {
+		/* nothing new */
+		return (EXIT_SUCCESS);
+	}
+	/* the changes of others make the backup of our last change invalid */
+	file_rollback_drop(file_ds);
+
+	size = st.st_size - file_ds->journal_offset;
+	if ((buf = malloc(size + 1)) == NULL) {
+		ERROR("Memory allocation failed (%s:%d).", __FILE__, __LINE__);
+		return (EXIT_FAILURE);
+	}
+	for (len = 0; len < size; len += r) {
+		if ((r = pread(file_ds->journal_fd, buf + len, size - len, file_ds->journal_offset + len)) <= 0) {
+			if (r == -1 && errno == EINTR) {
+				r = 0;
+				continue;
+			}
+			break;
+		}
+	}
+	size = len;
+	buf[size] = '\0';
+
+	rec = buf;
+	if (file_ds->journal_offset == 0) {
+		/* check that the journal belongs to the current datastore file */
+		if (sscanf(rec, JOURNAL_MAGIC" %llu\n%n", &ino, &n) != 1 || (ino_t) ino != file_ds->file_ino) {
+			VERB("Ignoring the journal %s of another datastore file version.", file_ds->journal_path);
+			free(buf);
+			return (EXIT_SUCCESS);
+		}
+		rec += n;
+	}
+
+	while (rec < buf + size) {
+		n = 0;
+		/* the newline is matched separately, a whitespace in the format would skip the beginning of the data */
+		if (sscanf(rec, JOURNAL_RECORD" %c %d %d %d %63s %zu%n", &op, &target, &arg1, &arg2, name, &len, &n) != 6 || n == 0 ||
+				rec[n++] != '\n' || (size_t)(buf + size - (rec + n)) < len + 1 || rec[n + len] != '\n') {
+			/* incomplete record */
+			break;
+		}
+		data = rec + n;
+		end = data + len + 1;
+
+		if (file_journal_apply(file_ds, op, (NC_DATASTORE) target, arg1, arg2, name, data, len) != EXIT_SUCCESS) {
+			WARN("Applying a journal record of the datastore %s failed.", file_ds->path);
+		}
+		rec = end;
+	}
+
+	file_ds->journal_offset += rec - buf;
+	if (rec < buf + size) {
+		if (recover) {
+			WARN("Removing an incomplete record from the journal %s.", file_ds->journal_path);
+			if (ftruncate(file_ds->journal_fd, file_ds->journal_offset) == -1) {
+				ERROR("%s: ftruncate() on the journal %s failed (%s).", __func__, file_ds->journal_path, strerror(errno));
+			}
+		} else {
+			WARN("Incomplete record found in the journal %s.", file_ds->journal_path);
+		}
+	}
+	free(buf);
+
+	return (EXIT_SUCCESS);
+}
+
+/**
+ * @brief Empty the journal and mark it as belonging to the current datastore file.
+ */
+static int file_journal_reset(struct ncds_ds_file* file_ds)
+{
+	char header[64];
+	int len;
+
+	if (ftruncate(file_ds->journal_fd, 0) == -1) {
+		ERROR("%s: ftruncate() on the journal %s failed (%s).", __func__, file_ds->journal_path, strerror(errno));
+		return (EXIT_FAILURE);
+	}
+	len = snprintf(header, sizeof(header), JOURNAL_MAGIC" %llu\n", (unsigned long long) file_ds->file_ino);
+	if (pwrite(file_ds->journal_fd, header, len, 0) != len) {
+		ERROR("%s: writing the journal %s failed (%s).", __func__, file_ds->journal_path, strerror(errno));
+		return (EXIT_FAILURE);
+	}
+	file_ds->journal_offset = len;
+
+	return (EXIT_SUCCESS);
+}
+
+/**
+ * @brief Remember the version of the datastore file loaded into the xml.
+ */
+static void file_identity_store(struct ncds_ds_file* file_ds, const struct stat *st)
+{
+	file_ds->file_ino = st->st_ino;
+	file_ds->file_size = st->st_size;
+	file_ds->file_mtime = st->st_mtim;
+}
+
+static int file_identity_changed(struct ncds_ds_file* file_ds, const struct stat *st)
+{
+	return (file_ds->file_ino != st->st_ino || file_ds->file_size != st->st_size ||
+			file_ds->file_mtime.tv_sec != st->st_mtim.tv_sec || file_ds->file_mtime.tv_nsec != st->st_mtim.tv_nsec);
+}
+
+/**
+ * @brief Get the name of a named semaphore or shared memory object belonging
+ * to the datastore file. There must be a separate object for each datastore(set),
+ * so name it according to the filepath with a special prefix. Slashes in the path
+ * are replaced with underscores. Sequences of slashes are treated as a single
+ * slash character.
+ */
+static char* file_shared_name(const char* prefix, const char* path)
+{
+	char* name;
+
+	if (asprintf(&name, "%s/%s", prefix, path) == -1) {
+		ERROR("asprintf() failed (%s:%d).", __FILE__, __LINE__);
+		return (NULL);
+	}
+	nc_clip_occurences_with(name, '/', '_');
+	/* recreate initial backslash in the name */
+	name[0] = '/';
+
+	return (name);
+}
+
+/**
+ * @brief Map the datastore generation and lock shared with the other processes.
+ * The semaphore of the datastore MUST be already opened.
+ */
+static int file_shared_open(struct ncds_ds_file* file_ds)
+{
+#ifdef POSIX_SHM
+	struct ncds_file_shared* shared;
+	struct timespec timeout;
+	pthread_mutexattr_t attr;
+	char* name;
+	int fd, ret = EXIT_SUCCESS;
+	mode_t mask;
+
+	if ((name = file_shared_name(NCDS_SHM, file_ds->path)) == NULL) {
+		return (EXIT_FAILURE);
+	}
+	mask = umask(0000);
+	fd = shm_open(name, O_CREAT | O_RDWR, FILE_PERM);
+	umask(mask);
+	if (fd == -1) {
+		ERROR("Accessing POSIX shared memory %s failed (%s).", name, strerror(errno));
+		free(name);
+		return (EXIT_FAILURE);
+	}
+	free(name);
+
+	/* a new object is filled with zeros, the existing one keeps its size and content */
+	if (ftruncate(fd, sizeof(struct ncds_file_shared)) == -1) {
+		ERROR("Truncating POSIX shared memory failed (%s).", strerror(errno));
+		close(fd);
+		return (EXIT_FAILURE);
+	}
+	shared = mmap(NULL, sizeof(struct ncds_file_shared), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (shared == MAP_FAILED) {
+		ERROR("Mapping POSIX shared memory failed (%s).", strerror(errno));
+		return (EXIT_FAILURE);
+	}
+
+	if (!__atomic_load_n(&(shared->lock_ready), __ATOMIC_ACQUIRE)) {
+		/* the processes mapping a new object are serialized by the semaphore */
+		clock_gettime(CLOCK_REALTIME, &timeout);
+		timeout.tv_sec += NCDS_LOCK_TIMEOUT;
+		if (sem_timedwait(file_ds->ds_lock.lock, &timeout) == -1) {
+			ERROR("Locking datastore file %s timeouted.", file_ds->path);
+			munmap(shared, sizeof(struct ncds_file_shared));
+			return (EXIT_FAILURE);
+		}
+		if (!shared->lock_ready) {
+			if (pthread_mutexattr_init(&attr) != 0 ||
+					pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED) != 0 ||
+					pthread_mutexattr_setrobust(&attr, PTHREAD_MUTEX_ROBUST) != 0 ||
+					pthread_mutex_init(&(shared->lock), &attr) != 0) {
+				ERROR("Initiating the lock of the datastore file %s failed.", file_ds->path);
+				ret = EXIT_FAILURE;
+			} else {
+				__atomic_store_n(&(shared->lock_ready), 1, __ATOMIC_RELEASE);
+			}
+			pthread_mutexattr_destroy(&attr);
+		}
+		sem_post(file_ds->ds_lock.lock);
+		if (ret != EXIT_SUCCESS) {
+			munmap(shared, sizeof(struct ncds_file_shared));
+			return (EXIT_FAILURE);
+		}
+	}
+	file_ds->shared = shared;
+
+	return (EXIT_SUCCESS);
+#else
+	(void) file_ds;
+	return (EXIT_FAILURE);
+#endif
+}
+
+/**
+ * @brief Announce a change of the datastore to the other processes. This function
+ * MUST be called ONLY between file_ds_lock() and file_ds_unlock() and before the
+ * change is written, so that a writer interrupted in the middle still makes the
+ * others check the files.
+ *
+ * @param file_ds Datastore being changed.
+ * @param rewrite Flag for rewriting the whole datastore file.
+ */
+static void file_shared_update(struct ncds_ds_file* file_ds, int rewrite)
+{
+	if (file_ds->shared == NULL) {
+		return;
+	}
+
+	if (rewrite) {
+		file_ds->file_generation = __atomic_add_fetch(&(file_ds->shared->file_generation), 1, __ATOMIC_SEQ_CST);
+	}
+	file_ds->generation = __atomic_add_fetch(&(file_ds->shared->generation), 1, __ATOMIC_SEQ_CST);
+}
+
+/**
+ * @brief Open the journal of the datastore file and apply its records.
+ */
+static int file_journal_open(struct ncds_ds_file* file_ds)
+{
+	struct stat st;
+	mode_t mask;
+
+	if (asprintf(&file_ds->journal_path, "%s"NCDS_JOURNAL_SUFFIX, file_ds->path) == -1) {
+		ERROR("asprintf() failed (%s:%d).", __FILE__, __LINE__);
+		file_ds->journal_path = NULL;
+		return (EXIT_FAILURE);
+	}
+	mask = umask(MASK_PERM);
+	file_ds->journal_fd = open(file_ds->journal_path, O_RDWR | O_CREAT, FILE_PERM);
+	umask(mask);
+	if (file_ds->journal_fd == -1) {
+		ERROR("Unable to open the datastore journal %s (%s).", file_ds->journal_path, strerror(errno));
+		free(file_ds->journal_path);
+		file_ds->journal_path = NULL;
+		return (EXIT_FAILURE);
+	}
+
+	if (fstat(fileno(file_ds->file), &st) == -1) {
+		ERROR("%s: fstat() on the datastore file %s failed (%s).", __func__, file_ds->path, strerror(errno));
+		goto error;
+	}
+	file_identity_store(file_ds, &st);
+
+	if (stat(file_ds->path, &st) == 0 && file_identity_changed(file_ds, &st)) {
+		/* the datastore file was replaced after we read it, the journal belongs to the new one */
+		if (file_reparse(file_ds) != EXIT_SUCCESS) {
+			goto error;
+		}
+	} else {
+		/* crash recovery - apply the changes not yet merged into the datastore file */
+		file_ds->journal_offset = 0;
+		if (file_journal_replay(file_ds, 1) != EXIT_SUCCESS) {
+			goto error;
+		}
+	}
+	if (file_ds->journal_offset == 0 && file_journal_reset(file_ds) != EXIT_SUCCESS) {
+		/* new journal or a journal of another datastore file */
+		goto error;
+	}
+
+	return (EXIT_SUCCESS);
+
+error:
+	close(file_ds->journal_fd);
+	free(file_ds->journal_path);
+	file_ds->journal_path = NULL;
+	return (EXIT_FAILURE);
+}
+
+/**
+ * @brief Check if the file name is a journal.
+ */
+static int file_is_journal(const char* name)
+{
+	size_t len = strlen(name);
+
+	return (len >= strlen(NCDS_JOURNAL_SUFFIX) && strcmp(name + len - strlen(NCDS_JOURNAL_SUFFIX), NCDS_JOURNAL_SUFFIX) == 0);
+}
+
+/**
+ * @brief Check if the file name is a compaction temporary file of the datastore
+ * file name (the name followed by NCDS_COMPACT_SUFFIX and the mkstemp() suffix).
+ */
+static int file_is_compact_tmp(const char* name, const char* file_name)
+{
+	size_t flen = strlen(file_name);
+
+	return (strlen(name) == flen + strlen(NCDS_COMPACT_SUFFIX) + 6 && strncmp(name, file_name, flen) == 0 &&
+			strncmp(name + flen, NCDS_COMPACT_SUFFIX, strlen(NCDS_COMPACT_SUFFIX)) == 0);
+}
+
+/**
+ * @brief Remove the compaction temporary files left by a crashed process. This
+ * function MUST be called ONLY between file_ds_lock() and file_ds_unlock(), so
+ * no other process is just writing its temporary file.
+ */
+static void file_compact_cleanup(struct ncds_ds_file* file_ds)
+{
+	char *path, *dir_name, *file_name, *tmp_path;
+	struct dirent* file_info;
+	DIR* dir;
+
+	/* the temporary files are placed next to the file the path points to */
+	if ((path = realpath(file_ds->path, NULL)) == NULL) {
+		return;
+	}
+	file_name = basename(path);
+	if ((file_name = strdup(file_name)) == NULL) {
+		free(path);
+		return;
+	}
+	dir_name = dirname(path);
+
+	if ((dir = opendir(dir_name)) != NULL) {
+		while ((file_info = readdir(dir)) != NULL) {
+			if (!file_is_compact_tmp(file_info->d_name, file_name)) {
+				continue;
+			}
+			if (asprintf(&tmp_path, "%s/%s", dir_name, file_info->d_name) == -1) {
+				ERROR("asprintf() failed (%s:%d).", __FILE__, __LINE__);
+				break;
+			}
+			WARN("Removing the temporary datastore file %s left by a crashed process.", tmp_path);
+			if (unlink(tmp_path) == -1) {
+				WARN("Removing the file %s failed (%s).", tmp_path, strerror(errno));
+			}
+			free(tmp_path);
+		}
+		closedir(dir);
+	}
+	free(file_name);
+	free(path);
+}
+
 int ncds_file_changed(struct ncds_ds* ds)
 {
 	time_t t;
 	struct stat statbuf;
+	struct ncds_file_shared* shared = ((struct ncds_ds_file*)ds)->shared;
+
+	if (shared != NULL) {
+		return (__atomic_load_n(&(shared->generation), __ATOMIC_ACQUIRE) != ((struct ncds_ds_file*)ds)->generation);
+	}
 
 	/* get current time */
 	if ((t = time(NULL)) == ((time_t)(-1))) {
@@ -323,8 +1051,11 @@ int ncds_file_changed(struct ncds_ds* ds)
 	/* check when the file was modified */
 	if (stat(((struct ncds_ds_file*)ds)->path, &statbuf) == 0) {
 		if (statbuf.st_mtime < ds->last_access) {
-			/* file was not modified */
-			return (0);
+			/* file was not modified, but the changes could be in the journal */
+			if (((struct ncds_ds_file*)ds)->journal_path == NULL ||
+					(fstat(((struct ncds_ds_file*)ds)->journal_fd, &statbuf) == 0 && statbuf.st_mtime < ds->last_access)) {
+				return (0);
+			}
 		}
 	}
 	return (1);
@@ -344,8 +1075,10 @@ int ncds_file_init(struct ncds_ds* ds)
 	char* new_path = NULL, *sempath, *dir_name, *file_name, *dup_path;
 	struct dirent * file_info;
 	DIR * dir;
-	int fd;
+	int fd, ret;
 	mode_t mask;
+	NC_DATASTORE target;
+	xmlNodePtr target_ds;
 	struct ncds_ds_file* file_ds = (struct ncds_ds_file*)ds;
 
 	file_ds->xml = xmlReadFile(file_ds->path, NULL, NC_XMLREAD_OPTIONS);
@@ -393,6 +1126,10 @@ int ncds_file_init(struct ncds_ds* ds)
 			if (strncmp(file_info->d_name, file_name, strlen(file_name)) != 0) {
 				continue;
 			}
+			if (file_is_journal(file_info->d_name) || file_is_compact_tmp(file_info->d_name, file_name)) {
+				/* journal or an incomplete compaction, not a backup */
+				continue;
+			}
 
 			/* we have some file that could be a backup datastore from some previous run */
 			if (asprintf(&new_path, "%s/%s", dir_name, file_info->d_name) == -1) {
@@ -476,40 +1213,65 @@ int ncds_file_init(struct ncds_ds* ds)
 
 	/* init value */
 	file_ds->xml_rollback = NULL;
+	file_ds->rollback_target = NC_DATASTORE_ERROR;
+	file_ds->rollback_modified = NULL;
 
 	/* get pointers to running, startup and candidate nodes in xml */
 	if (file_fill_dsnodes(file_ds) != EXIT_SUCCESS) {
 		return (EXIT_FAILURE);
 	}
 
-	/* unlock forgotten locks if any */
-	xmlSetProp (file_ds->running, BAD_CAST "lock", BAD_CAST "");
-	xmlSetProp (file_ds->startup, BAD_CAST "lock", BAD_CAST "");
-	xmlSetProp (file_ds->candidate, BAD_CAST "lock", BAD_CAST "");
-
 	/*
 	 * open and eventually create a lock
 	 */
-	/* first - prepare the path, there must be a separate lock for each
-	 * datastore(set), so name it according to the filepath with a special prefix.
-	 * Slashes in the path are replaced with underscores.
-	 * Sequences of slashes are treated as a single slash character.
-	 */
-	if (asprintf(&sempath, "%s/%s", NCDS_LOCK, file_ds->path) == -1) {
-		ERROR("asprintf() failed (%s:%d).", __FILE__, __LINE__);
+	/* first - prepare the path */
+	if ((sempath = file_shared_name(NCDS_LOCK, file_ds->path)) == NULL) {
 		return (EXIT_FAILURE);
 	}
-	nc_clip_occurences_with(sempath, '/', '_');
-	/* recreate initial backslash in the semaphore name */
-	sempath[0] = '/';
 	/* and then create the lock (actually it is a semaphore) */
 	mask = umask(0000);
 	if ((file_ds->ds_lock.lock = sem_open (sempath, O_CREAT, FILE_PERM, 1)) == SEM_FAILED) {
 		umask(mask);
 		return (EXIT_FAILURE);
 	}
-	umask(mask);
-	free (sempath);
+	umask(mask);
+	free (sempath);
+	pthread_rwlock_init(&(file_ds->ds_lock.rwlock), NULL);
+
+	if (file_shared_open(file_ds) != EXIT_SUCCESS) {
+		VERB("Datastore generation not shared, changes of the datastore file %s will be detected from its modification time.", file_ds->path);
+	}
+
+	LOCK(file_ds, ret);
+	if (ret) {
+		ERROR("Locking datastore file %s timeouted.", file_ds->path);
+		return (EXIT_FAILURE);
+	}
+
+	file_compact_cleanup(file_ds);
+
+	/* apply the changes stored only in the journal */
+	if (file_journal_open(file_ds) != EXIT_SUCCESS) {
+		WARN("Datastore journal not available, the whole datastore file %s will be rewritten on every change.", file_ds->path);
+	}
+	/*
+	 * unlock forgotten locks if any, only in our copy of the configuration -
+	 * the locks may be held by the sessions of the other processes, so the
+	 * first reload restores them from the file (the xml is not considered
+	 * up to date)
+	 */
+	for (target = NC_DATASTORE_RUNNING; target <= NC_DATASTORE_CANDIDATE; target++) {
+		if ((target_ds = file_ds_node(file_ds, target)) != NULL) {
+			xmlSetProp(target_ds, BAD_CAST "lock", BAD_CAST "");
+		}
+	}
+	file_ds->file_ino = 0;
+	file_ds->ds.last_access = 0;
+	if (file_ds->shared != NULL) {
+		file_ds->generation = file_ds->shared->generation - 1;
+		file_ds->file_generation = file_ds->shared->file_generation - 1;
+	}
+	UNLOCK(file_ds);
 
 	return (EXIT_SUCCESS);
 }
@@ -524,15 +1286,82 @@ void ncds_file_free(struct ncds_ds* ds)
 			fclose(file_ds->file);
 		}
 		free(file_ds->path);
+		if (file_ds->journal_path != NULL) {
+			close(file_ds->journal_fd);
+			free(file_ds->journal_path);
+		}
+		if (file_ds->journal_records != NULL) {
+			xmlBufferFree(file_ds->journal_records);
+		}
+		file_snapshot_drop(file_ds, NC_DATASTORE_ERROR);
 		xmlFreeDoc(file_ds->xml);
-		xmlFreeDoc(file_ds->xml_rollback);
+		file_rollback_drop(file_ds);
 		if (file_ds->ds_lock.lock != NULL) {
 			if (file_ds->ds_lock.holding_lock) {
-				sem_post (file_ds->ds_lock.lock);
+				UNLOCK(file_ds);
 			}
+			pthread_rwlock_destroy(&(file_ds->ds_lock.rwlock));
 			sem_close(file_ds->ds_lock.lock);
 		}
+		if (file_ds->shared != NULL) {
+			munmap(file_ds->shared, sizeof(struct ncds_file_shared));
+		}
+	}
+}
+
+/**
+ * @brief Read the whole datastore file again and apply its journal. This function
+ * MUST be called ONLY between file_ds_lock() and file_ds_unlock().
+ *
+ * If it fails, the structure is preserved as it was.
+ *
+ * @param file_ds Pointer to the datastorage structure
+ *
+ * @return EXIT_SUCCESS or EXIT_FAILURE
+ */
+static int file_reparse(struct ncds_ds_file* file_ds)
+{
+	xmlDocPtr new_xml, old_xml;
+	struct stat statbuf;
+
+	/* file was modified, it may be necessary to reopen it */
+	fclose(file_ds->file);
+	file_ds->file = fopen(file_ds->path, "r+");
+	if (file_ds->file == NULL) {
+		ERROR("%s: reopenening the file %s failed (%s)", __func__, file_ds->path, strerror(errno));
+		return EXIT_FAILURE;
+	}
+
+	new_xml = xmlReadFile (file_ds->path, NULL, NC_XMLREAD_OPTIONS);
+	if (new_xml == NULL) {
+		return EXIT_FAILURE;
+	}
+
+	old_xml = file_ds->xml;
+	file_ds->xml = new_xml;
+	file_rollback_drop(file_ds);
+
+	if (file_fill_dsnodes (file_ds)) {
+		file_ds->xml = old_xml;
+		file_fill_dsnodes(file_ds);
+		xmlFreeDoc (new_xml);
+		return EXIT_FAILURE;
+	}
+	xmlFreeDoc(old_xml);
+	file_snapshot_drop(file_ds, NC_DATASTORE_ERROR);
+
+	if (file_ds->journal_path != NULL) {
+		/* apply the whole journal of the new datastore file */
+		if (fstat(fileno(file_ds->file), &statbuf) == 0) {
+			file_identity_store(file_ds, &statbuf);
+		}
+		file_ds->journal_offset = 0;
+		if (file_journal_replay(file_ds, 1) != EXIT_SUCCESS) {
+			return EXIT_FAILURE;
+		}
 	}
+
+	return EXIT_SUCCESS;
 }
 
 /**
@@ -541,7 +1370,9 @@ void ncds_file_free(struct ncds_ds* ds)
  *
  * Tries to read from the datastore and find the datastore root elements.
  * If succussfully, the old xml is freed and replaced with a new one.
- * If it fails, the structure is preserved as it was.
+ * If it fails, the structure is preserved as it was. If only the journal
+ * was changed, just the new journal records are applied. With the generation
+ * shared among processes, the files are not even touched when nothing changed.
  *
  * @param file_ds Pointer to the datastorage structure
  *
@@ -549,47 +1380,65 @@ void ncds_file_free(struct ncds_ds* ds)
  */
 static int file_reload(struct ncds_ds_file* file_ds)
 {
-	xmlDocPtr new_xml;
 	struct stat statbuf;
 	time_t t;
+	uint64_t generation, file_generation;
 
 	if (file_ds == NULL || !file_ds->ds_lock.holding_lock) {
 		ERROR("%s: invalid parameter.", __func__);
 		return EXIT_FAILURE;
 	}
 
+	/* drop the records of a previous unfinished operation */
+	if (file_ds->journal_records != NULL) {
+		xmlBufferEmpty(file_ds->journal_records);
+	}
+
 	/* get current time */
 	if ((t = time(NULL)) == ((time_t)(-1))) {
 		t = 0;
 		WARN("Setting datastore access time failed (%s)", strerror(errno));
 	}
 
-	/* check when the file was modified */
-	if (stat(file_ds->path, &statbuf) == 0) {
-		if (statbuf.st_mtime < file_ds->ds.last_access) {
-			/* file was not modified */
+	if (file_ds->shared != NULL) {
+		/* the generation changes only under the datastore lock we are holding */
+		generation = file_ds->shared->generation;
+		file_generation = file_ds->shared->file_generation;
+		if (generation == file_ds->generation) {
+			/* nothing changed since we loaded the xml */
 			return (EXIT_SUCCESS);
 		}
-	}
 
-	/* file was modified, it may be necessary to reopen it */
-	fclose(file_ds->file);
-	file_ds->file = fopen(file_ds->path, "r+");
-	if (file_ds->file == NULL) {
-		ERROR("%s: reopenening the file %s failed (%s)", __func__, file_ds->path, strerror(errno));
-		return EXIT_FAILURE;
+		if (file_ds->journal_path != NULL && file_generation == file_ds->file_generation) {
+			/* only the journal was appended */
+			if (file_journal_replay(file_ds, 1) != EXIT_SUCCESS) {
+				return EXIT_FAILURE;
+			}
+		} else if (file_reparse(file_ds) != EXIT_SUCCESS) {
+			return EXIT_FAILURE;
+		}
+		file_ds->generation = generation;
+		file_ds->file_generation = file_generation;
+		file_ds->ds.last_access = t;
+		return (EXIT_SUCCESS);
 	}
 
-	new_xml = xmlReadFile (file_ds->path, NULL, NC_XMLREAD_OPTIONS);
-	if (new_xml == NULL) {
-		return EXIT_FAILURE;
+	/* check if the file was modified */
+	if (stat(file_ds->path, &statbuf) == 0) {
+		if (file_ds->journal_path != NULL && !file_identity_changed(file_ds, &statbuf)) {
+			/* file was not modified, apply the changes from the journal */
+			if (file_journal_replay(file_ds, 1) != EXIT_SUCCESS) {
+				return EXIT_FAILURE;
+			}
+			file_ds->ds.last_access = t;
+			return (EXIT_SUCCESS);
+		} else if (file_ds->journal_path == NULL && statbuf.st_mtime < file_ds->ds.last_access) {
+			/* file was not modified */
+			return (EXIT_SUCCESS);
+		}
 	}
 
-	xmlFreeDoc (file_ds->xml);
-	file_ds->xml = new_xml;
-
-	if (file_fill_dsnodes (file_ds)) {
-		xmlFreeDoc (new_xml);
+	if (file_reparse(file_ds) != EXIT_SUCCESS) {
 		return EXIT_FAILURE;
 	}
 
@@ -601,8 +1450,80 @@ static int file_reload(struct ncds_ds_file* file_ds)
 }
 
 /**
- * @brief Write the current version of the configuration to a file. This function MUST be
- * called ONLY between file_ds_lock() and file_ds_unlock().
+ * @brief Write the whole configuration into a new datastore file replacing the
+ * current one and empty the journal. This function MUST be called ONLY between
+ * file_ds_lock() and file_ds_unlock().
+ *
+ * @param file_ds Datastore to write.
+ *
+ * @return EXIT_SUCCESS or EXIT_FAILURE
+ */
+static int file_compact(struct ncds_ds_file* file_ds)
+{
+	char *path, *tmp_path = NULL;
+	struct stat statbuf;
+	FILE* file;
+	int fd;
+
+	file_shared_update(file_ds, 1);
+
+	/* write into the file the path points to */
+	if ((path = realpath(file_ds->path, NULL)) == NULL) {
+		path = strdup(file_ds->path);
+	}
+	if (asprintf(&tmp_path, "%s"NCDS_COMPACT_SUFFIX"XXXXXX", path) == -1) {
+		ERROR("asprintf() failed (%s:%d).", __FILE__, __LINE__);
+		free(path);
+		return (EXIT_FAILURE);
+	}
+	if ((fd = mkstemp(tmp_path)) == -1 || (file = fdopen(fd, "w+")) == NULL) {
+		ERROR("%s: creating the file %s failed (%s)", __func__, tmp_path, strerror(errno));
+		if (fd != -1) {
+			close(fd);
+			unlink(tmp_path);
+		}
+		free(tmp_path);
+		free(path);
+		return (EXIT_FAILURE);
+	}
+	if (fstat(fileno(file_ds->file), &statbuf) == 0) {
+		/* keep the original access rights */
+		fchmod(fd, statbuf.st_mode & 07777);
+	}
+
+	if (xmlDocFormatDump(file, file_ds->xml, 1) == -1 || fflush(file) != 0 || rename(tmp_path, path) == -1) {
+		ERROR("%s: storing repository into the file %s failed.", __func__, path);
+		fclose(file);
+		unlink(tmp_path);
+		free(tmp_path);
+		free(path);
+		return (EXIT_FAILURE);
+	}
+	free(tmp_path);
+	free(path);
+
+	fclose(file_ds->file);
+	file_ds->file = file;
+	if (fstat(fileno(file_ds->file), &statbuf) == 0) {
+		file_identity_store(file_ds, &statbuf);
+	}
+
+	/* all the changes are in the datastore file now */
+	if (file_ds->journal_records != NULL) {
+		xmlBufferEmpty(file_ds->journal_records);
+	}
+	if (file_ds->journal_path != NULL && file_journal_reset(file_ds) != EXIT_SUCCESS) {
+		return (EXIT_FAILURE);
+	}
+
+	return (EXIT_SUCCESS);
+}
+
+/**
+ * @brief Write the journal records of the current operation. The whole
+ * configuration is written into the datastore file instead when the journal
+ * gets too big. This function MUST be called ONLY between file_ds_lock() and
+ * file_ds_unlock().
  *
  * @param file_ds Datastore to sync.
  *
@@ -611,22 +1532,42 @@ static int file_reload(struct ncds_ds_file* file_ds)
 static int file_sync(struct ncds_ds_file* file_ds)
 {
 	time_t t;
+	const char* data;
+	size_t len, written;
+	ssize_t r;
 
 	if (file_ds == NULL || !file_ds->ds_lock.holding_lock) {
 		ERROR("%s: invalid parameter.", __func__);
 		return EXIT_FAILURE;
 	}
 
-	/* erase actual config */
-	if (ftruncate (fileno(file_ds->file), 0) == -1) {
-		ERROR ("%s: truncate() of file %s failed (%s)", __func__, file_ds->path, strerror(errno));
-		return EXIT_FAILURE;
-	}
-	rewind (file_ds->file);
-
-	if(xmlDocFormatDump(file_ds->file, file_ds->xml, 1) == -1) {
-		ERROR("%s: storing repository into the file %s failed.", __func__, file_ds->path);
-		return (EXIT_FAILURE);
+	len = (file_ds->journal_records != NULL) ? xmlBufferLength(file_ds->journal_records) : 0;
+	if (file_ds->journal_path == NULL || len == 0 ||
+			(file_ds->journal_offset + len > NCDS_JOURNAL_MIN_SIZE && file_ds->journal_offset + len > file_ds->file_size)) {
+		/* rewrite the datastore file */
+		if (file_compact(file_ds)) {
+			return (EXIT_FAILURE);
+		}
+	} else {
+		/* append the changes into the journal */
+		file_shared_update(file_ds, 0);
+		data = (const char*) xmlBufferContent(file_ds->journal_records);
+		for (written = 0; written < len; written += r) {
+			if ((r = pwrite(file_ds->journal_fd, data + written, len - written, file_ds->journal_offset + written)) == -1) {
+				if (errno == EINTR) {
+					r = 0;
+					continue;
+				}
+				ERROR("%s: writing the journal %s failed (%s)", __func__, file_ds->journal_path, strerror(errno));
+				/* do not leave an incomplete record */
+				if (ftruncate(file_ds->journal_fd, file_ds->journal_offset) == -1) {
+					ERROR("%s: ftruncate() on the journal %s failed (%s).", __func__, file_ds->journal_path, strerror(errno));
+				}
+				return (EXIT_FAILURE);
+			}
+		}
+		file_ds->journal_offset += len;
+		xmlBufferEmpty(file_ds->journal_records);
 	}
 
 	/* update last access time */
@@ -639,6 +1580,12 @@ static int file_sync(struct ncds_ds_file* file_ds)
 	return EXIT_SUCCESS;
 }
 
+/**
+ * @brief Prepare the rollback backup for a new change of the target datastore.
+ * Instead of copying the whole configuration, the content replaced by the change
+ * is moved into the backup by file_replace_content(). This function MUST be
+ * called ONLY between file_ds_lock() and file_ds_unlock().
+ */
 static int file_rollback_store(struct ncds_ds_file* file_ds)
 {
 	if (file_ds == NULL) {
@@ -646,14 +1593,57 @@ static int file_rollback_store(struct ncds_ds_file* file_ds)
 		return (EXIT_FAILURE);
 	}
 
-	xmlFreeDoc(file_ds->xml_rollback);
-	file_ds->xml_rollback = xmlCopyDoc(file_ds->xml, 1);
+	file_rollback_drop(file_ds);
+
+	file_ds->xml_rollback = xmlNewDoc(BAD_CAST "1.0");
+	if (file_ds->xml_rollback == NULL) {
+		ERROR("%s: xmlNewDoc failed (%s:%d).", __func__, __FILE__, __LINE__);
+		return (EXIT_FAILURE);
+	}
+	/* the moved nodes keep their strings from the dictionary of the datastore document */
+	if (file_ds->xml->dict != NULL) {
+		file_ds->xml_rollback->dict = file_ds->xml->dict;
+		xmlDictReference(file_ds->xml_rollback->dict);
+	}
+	xmlDocSetRootElement(file_ds->xml_rollback, xmlNewDocNode(file_ds->xml_rollback, NULL, BAD_CAST "rollback", NULL));
+	if (file_ds->candidate != NULL) {
+		file_ds->rollback_modified = xmlGetProp(file_ds->candidate, BAD_CAST "modified");
+	}
 
 	return (EXIT_SUCCESS);
 }
 
+/**
+ * @brief Check that the datastore was not changed by another process since the
+ * last change of this process, so the rollback backup matches the xml and the
+ * journal ends where this process would append. This function MUST be called
+ * ONLY between file_ds_lock() and file_ds_unlock().
+ *
+ * @return non-zero if the datastore was not changed, zero else.
+ */
+static int file_rollback_current(struct ncds_ds_file* file_ds)
+{
+	struct stat st;
+
+	if (file_ds->shared != NULL) {
+		if (file_ds->shared->generation != file_ds->generation) {
+			return (0);
+		}
+	} else if (stat(file_ds->path, &st) == -1 || (file_ds->journal_path != NULL && file_identity_changed(file_ds, &st))) {
+		return (0);
+	}
+
+	if (file_ds->journal_path != NULL && (fstat(file_ds->journal_fd, &st) == -1 || st.st_size != file_ds->journal_offset)) {
+		return (0);
+	}
+
+	return (1);
+}
+
 static int file_rollback_restore(struct ncds_ds_file* file_ds)
 {
+	xmlNodePtr target_ds, root, aux_node;
+
 	if (file_ds == NULL || !file_ds->ds_lock.holding_lock) {
 		ERROR("%s: invalid parameter.", __func__);
 		return (EXIT_FAILURE);
@@ -664,12 +1654,37 @@ static int file_rollback_restore(struct ncds_ds_file* file_ds)
 		return (EXIT_FAILURE);
 	}
 
-	xmlFreeDoc(file_ds->xml);
-	file_ds->xml = file_ds->xml_rollback;
-	file_ds->xml_rollback = NULL;
-	file_ds->ds.last_access = 0;
+	if (!file_rollback_current(file_ds)) {
+		/* the backup does not describe the current content anymore and our
+		 * journal offset is stale, writing would overwrite the others' records */
+		ERROR("Datastore %d was changed by another process, unable to rollback.", file_ds->ds.id);
+		file_rollback_drop(file_ds);
+		return (EXIT_FAILURE);
+	}
 
-	file_fill_dsnodes(file_ds);
+	/* drop the records of a previous unfinished operation */
+	if (file_ds->journal_records != NULL) {
+		xmlBufferEmpty(file_ds->journal_records);
+	}
+
+	/* the backup is dropped whenever the xml is reloaded, so it shares its dictionary */
+	if ((target_ds = file_ds_node(file_ds, file_ds->rollback_target)) != NULL) {
+		while ((aux_node = target_ds->children) != NULL) {
+			xmlUnlinkNode(aux_node);
+			xmlFreeNode(aux_node);
+		}
+		root = xmlDocGetRootElement(file_ds->xml_rollback);
+		while ((aux_node = root->children) != NULL) {
+			xmlUnlinkNode(aux_node);
+			xmlAddChild(target_ds, aux_node);
+		}
+		file_journal_add_content(file_ds, file_ds->rollback_target);
+	}
+	if (file_ds->candidate != NULL && file_ds->rollback_modified != NULL) {
+		xmlSetProp(file_ds->candidate, BAD_CAST "modified", file_ds->rollback_modified);
+		file_journal_add_attr(file_ds, NC_DATASTORE_CANDIDATE, "modified", (char*) file_ds->rollback_modified);
+	}
+	file_rollback_drop(file_ds);
 
 	return (file_sync(file_ds));
 }
@@ -813,6 +1828,8 @@ int ncds_file_lock(struct ncds_ds* ds, const struct nc_session* session, NC_DATA
 		} else {
 			xmlSetProp (target_ds, BAD_CAST "lock", BAD_CAST session->session_id);
 			xmlSetProp (target_ds, BAD_CAST "locktime", BAD_CAST (t = nc_time2datetime(time(NULL), NULL)));
+			file_journal_add_attr(file_ds, target, "lock", session->session_id);
+			file_journal_add_attr(file_ds, target, "locktime", t);
 			free(t);
 			if (file_sync(file_ds)) {
 				*error = nc_err_new(NC_ERR_OP_FAILED);
@@ -895,14 +1912,18 @@ int ncds_file_unlock(struct ncds_ds* ds, const struct nc_session* session, NC_DA
 
 			/* copy running into candidate configuration */
 			xmlAddChildList(file_ds->candidate, xmlCopyNodeList(file_ds->running->children));
+			file_journal_add(file_ds, 'c', NC_DATASTORE_CANDIDATE, NC_DATASTORE_RUNNING, 0, NULL, NULL, 0);
 
 			/* mark candidate as not modified */
 			xmlSetProp (target_ds, BAD_CAST "modified", BAD_CAST "false");
+			file_journal_add_attr(file_ds, target, "modified", "false");
 		}
 
 		/* unlock datastore */
 		xmlSetProp (target_ds, BAD_CAST "lock", BAD_CAST "");
 		xmlSetProp (target_ds, BAD_CAST "locktime", BAD_CAST "");
+		file_journal_add_attr(file_ds, target, "lock", "");
+		file_journal_add_attr(file_ds, target, "locktime", "");
 		if (file_sync(file_ds)) {
 			*error = nc_err_new(NC_ERR_OP_FAILED);
 			nc_err_set(*error, NC_ERR_PARAM_MSG, "Datastore file synchronisation failed.");
@@ -925,11 +1946,24 @@ char* ncds_file_getconfig(struct ncds_ds* ds, const struct nc_session* UNUSED(se
 	struct ncds_ds_file* file_ds = (struct ncds_ds_file*)ds;
 	xmlNodePtr target_ds, aux_node;
 	xmlBufferPtr resultbuffer;
-	char* data = NULL;
+	char* data = NULL, **snapshot;
+	size_t* snapshot_len;
 	int ret;
 
 	assert(error);
 
+	/* copy the up to date snapshot in parallel with the other readers */
+	if (source >= NC_DATASTORE_RUNNING && source <= NC_DATASTORE_CANDIDATE && file_ds_rdlock(file_ds)) {
+		snapshot = &(file_ds->snapshot[source - NC_DATASTORE_RUNNING]);
+		if (*snapshot != NULL && (data = malloc(file_ds->snapshot_len[source - NC_DATASTORE_RUNNING] + 1)) != NULL) {
+			memcpy(data, *snapshot, file_ds->snapshot_len[source - NC_DATASTORE_RUNNING] + 1);
+		}
+		RDUNLOCK(file_ds);
+		if (data != NULL) {
+			return (data);
+		}
+	}
+
 	LOCK(file_ds, ret);
 	if (ret) {
 		*error = nc_err_new(NC_ERR_OP_FAILED);
@@ -962,23 +1996,114 @@ char* ncds_file_getconfig(struct ncds_ds* ds, const struct nc_session* UNUSED(se
 		break;
 	}
 
-	resultbuffer = xmlBufferCreate();
-	if (resultbuffer == NULL) {
+	/* serialize the datastore only when it changed since the last get-config */
+	snapshot = &(file_ds->snapshot[source - NC_DATASTORE_RUNNING]);
+	snapshot_len = &(file_ds->snapshot_len[source - NC_DATASTORE_RUNNING]);
+	if (*snapshot == NULL) {
+		resultbuffer = xmlBufferCreate();
+		if (resultbuffer == NULL) {
+			UNLOCK(file_ds);
+			ERROR("%s: xmlBufferCreate failed (%s:%d).", __func__, __FILE__, __LINE__);
+			*error = nc_err_new(NC_ERR_OP_FAILED);
+			return (NULL);
+		}
+		for (aux_node = target_ds->children; aux_node != NULL; aux_node = aux_node->next) {
+			xmlNodeDump(resultbuffer, file_ds->xml, aux_node, 2, 1);
+		}
+		*snapshot = nc_clrwspace((char *) xmlBufferContent(resultbuffer));
+		xmlBufferFree(resultbuffer);
+		if (*snapshot == NULL) {
+			UNLOCK(file_ds);
+			*error = nc_err_new(NC_ERR_OP_FAILED);
+			return (NULL);
+		}
+		*snapshot_len = strlen(*snapshot);
+	}
+
+	if ((data = malloc(*snapshot_len + 1)) == NULL) {
 		UNLOCK(file_ds);
-		ERROR("%s: xmlBufferCreate failed (%s:%d).", __func__, __FILE__, __LINE__);
+		ERROR("Memory allocation failed (%s:%d).", __FILE__, __LINE__);
 		*error = nc_err_new(NC_ERR_OP_FAILED);
 		return (NULL);
 	}
-	for (aux_node = target_ds->children; aux_node != NULL; aux_node = aux_node->next) {
-		xmlNodeDump(resultbuffer, file_ds->xml, aux_node, 2, 1);
-	}
-	data = nc_clrwspace((char *) xmlBufferContent(resultbuffer));
-	xmlBufferFree(resultbuffer);
+	memcpy(data, *snapshot, *snapshot_len + 1);
 
 	UNLOCK(file_ds);
 	return (data);
 }
 
+/**
+ * @brief Copy the configuration root elements of the datastore to the top level
+ * of a new document. The datastore xml is only read.
+ */
+static xmlDocPtr file_copy_content(xmlNodePtr target_ds)
+{
+	xmlNodePtr aux_node;
+	xmlDocPtr doc;
+
+	doc = xmlNewDoc(BAD_CAST "1.0");
+	for (aux_node = target_ds->children; doc != NULL && aux_node != NULL; aux_node = aux_node->next) {
+		if (aux_node->type != XML_ELEMENT_NODE) {
+			continue;
+		}
+		if (doc->children == NULL) {
+			xmlDocSetRootElement(doc, xmlDocCopyNode(aux_node, doc, 1));
+		} else {
+			xmlAddNextSibling(doc->last, xmlDocCopyNode(aux_node, doc, 1));
+		}
+	}
+
+	return (doc);
+}
+
+xmlDocPtr ncds_file_getconfig_xml(struct ncds_ds* ds, const struct nc_session* UNUSED(session), NC_DATASTORE source, struct nc_err** error)
+{
+	struct ncds_ds_file* file_ds = (struct ncds_ds_file*)ds;
+	xmlNodePtr target_ds;
+	xmlDocPtr doc;
+	int ret;
+
+	assert(error);
+
+	/* copy the up to date content in parallel with the other readers */
+	if (source >= NC_DATASTORE_RUNNING && source <= NC_DATASTORE_CANDIDATE && file_ds_rdlock(file_ds)) {
+		doc = file_copy_content(file_ds_node(file_ds, source));
+		RDUNLOCK(file_ds);
+		if (doc != NULL) {
+			return (doc);
+		}
+	}
+
+	LOCK(file_ds, ret);
+	if (ret) {
+		*error = nc_err_new(NC_ERR_OP_FAILED);
+		nc_err_set(*error, NC_ERR_PARAM_MSG, "Locking datastore file timeouted.");
+		return NULL;
+	}
+
+	if (file_reload (file_ds)) {
+		UNLOCK(file_ds);
+		return NULL;
+	}
+
+	if ((target_ds = file_ds_node(file_ds, source)) == NULL) {
+		UNLOCK(file_ds);
+		ERROR("%s: invalid target.", __func__);
+		*error = nc_err_new(NC_ERR_BAD_ELEM);
+		nc_err_set(*error, NC_ERR_PARAM_INFO_BADELEM, "source");
+		return (NULL);
+	}
+
+	doc = file_copy_content(target_ds);
+	UNLOCK(file_ds);
+
+	if (doc == NULL) {
+		ERROR("%s: xmlNewDoc failed (%s:%d).", __func__, __FILE__, __LINE__);
+		*error = nc_err_new(NC_ERR_OP_FAILED);
+	}
+	return (doc);
+}
+
 /**
  * @brief Copy the content of the datastore or externally send
  * the configuration to another datastore
@@ -1001,7 +2126,6 @@ int ncds_file_copyconfig(struct ncds_ds *ds, const struct nc_session *session, c
 	struct ncds_ds_file* file_ds = (struct ncds_ds_file*)ds;
 	xmlDocPtr config_doc = NULL, aux_doc;
 	xmlNodePtr target_ds, source_ds, aux_node, root;
-	keyList keys;
 	char *aux = NULL, *configp;
 	int r, ret = 0;
 
@@ -1138,7 +2262,6 @@ int ncds_file_copyconfig(struct ncds_ds *ds, const struct nc_session *session, c
 		 * the <copy-config> protocol operation.
 		 */
 		if (!(source == NC_DATASTORE_RUNNING && target == NC_DATASTORE_STARTUP)) {
-			keys = get_keynode_list(file_ds->ds.ext_model);
 			if (source == NC_DATASTORE_RUNNING || source == NC_DATASTORE_STARTUP || source == NC_DATASTORE_CANDIDATE) {
 				/* RFC 6536, sec 3.2.4., paragraph 3
 				 * If the source of the <copy-config> operation is a datastore,
@@ -1158,7 +2281,7 @@ int ncds_file_copyconfig(struct ncds_ds *ds, const struct nc_session *session, c
 				r = nacm_check_data(aux_doc->children, NACM_ACCESS_CREATE, rpc->nacm);
 			} else {
 				/* replacing an old configuration data */
-				r = edit_replace_nacmcheck(target_ds->children, aux_doc, file_ds->ds.ext_model, keys, rpc->nacm, error);
+				r = edit_replace_nacmcheck(target_ds->children, aux_doc, file_ds->ds.ext_model, file_ds->ds.ext_model_keys, rpc->nacm, error);
 			}
 
 			if (r != NACM_PERMIT) {
@@ -1173,24 +2296,23 @@ int ncds_file_copyconfig(struct ncds_ds *ds, const struct nc_session *session, c
 				}
 				UNLOCK(file_ds);
 				xmlFreeDoc(aux_doc);
-				keyListFree(keys);
 				xmlFreeDoc (config_doc);
 				return (EXIT_FAILURE);
 			}
-			keyListFree(keys);
 		}
 	}
 
-	/* drop current target configuration */
-	while ((aux_node = target_ds->children) != NULL) {
-		xmlUnlinkNode (target_ds->children);
-		xmlFreeNode (aux_node);
-	}
-
-	/* copy new target configuration */
-	xmlAddChildList(target_ds, xmlCopyNodeList(aux_doc->children));
+	/* replace current target configuration */
+	file_replace_content(file_ds, target_ds, aux_doc);
 	xmlFreeDoc(aux_doc);
 
+	if (source != NC_DATASTORE_CONFIG && (rpc == NULL || rpc->nacm == NULL || (source == NC_DATASTORE_RUNNING && target == NC_DATASTORE_STARTUP))) {
+		/* the target is an exact copy of the source datastore */
+		file_journal_add(file_ds, 'c', target, source, 0, NULL, NULL, 0);
+	} else {
+		file_journal_add_content(file_ds, target);
+	}
+
 finish:
 	/*
 	 * if we are changing candidate, mark it as modified, since we need
@@ -1200,8 +2322,10 @@ finish:
 	if (target == NC_DATASTORE_CANDIDATE) {
 		if (source == NC_DATASTORE_RUNNING) {
 			xmlSetProp (target_ds, BAD_CAST "modified", BAD_CAST "false");
+			file_journal_add_attr(file_ds, target, "modified", "false");
 		} else {
 			xmlSetProp (target_ds, BAD_CAST "modified", BAD_CAST "true");
+			file_journal_add_attr(file_ds, target, "modified", "true");
 		}
 	}
 
@@ -1230,7 +2354,7 @@ finish:
 int ncds_file_deleteconfig(struct ncds_ds * ds, const struct nc_session * session, NC_DATASTORE target, struct nc_err **error)
 {
 	struct ncds_ds_file * file_ds = (struct ncds_ds_file*)ds;
-	xmlNodePtr target_ds, del;
+	xmlNodePtr target_ds;
 	int ret;
 
 	assert(error);
@@ -1276,10 +2400,8 @@ int ncds_file_deleteconfig(struct ncds_ds * ds, const struct nc_session * sessio
 		return EXIT_FAILURE;
 	}
 
-	while ((del = target_ds->children) != NULL) {
-		xmlUnlinkNode (target_ds->children);
-		xmlFreeNode (del);
-	}
+	file_replace_content(file_ds, target_ds, NULL);
+	file_journal_add(file_ds, 'r', target, 0, 0, NULL, NULL, 0);
 
 	/*
 	 * if we are changing the candidate, mark it as modified, since we need
@@ -1288,6 +2410,7 @@ int ncds_file_deleteconfig(struct ncds_ds * ds, const struct nc_session * sessio
 	 */
 	if (target == NC_DATASTORE_CANDIDATE) {
 		xmlSetProp (target_ds, BAD_CAST "modified", BAD_CAST "true");
+		file_journal_add_attr(file_ds, target, "modified", "true");
 	}
 
 	if (file_sync (file_ds)) {
@@ -1317,7 +2440,7 @@ int ncds_file_deleteconfig(struct ncds_ds * ds, const struct nc_session * sessio
 int ncds_file_editconfig(struct ncds_ds *ds, const struct nc_session * session, const nc_rpc* rpc, NC_DATASTORE target, const char * config, NC_EDIT_DEFOP_TYPE defop, NC_EDIT_ERROPT_TYPE errop, struct nc_err **error)
 {
 	struct ncds_ds_file * file_ds = (struct ncds_ds_file *)ds;
-	xmlDocPtr config_doc, datastore_doc;
+	xmlDocPtr config_doc;
 	xmlNodePtr target_ds, aux_node, root;
 	int retval = EXIT_SUCCESS, ret;
 	char* aux = NULL;
@@ -1405,26 +2528,13 @@ int ncds_file_editconfig(struct ncds_ds *ds, const struct nc_session * session,
 	xmlUnlinkNode(root);
 	xmlFreeNode(root);
 
-	/* create an XML doc with a copy of the datastore configuration */
-	datastore_doc = xmlNewDoc (BAD_CAST "1.0");
-	xmlDocSetRootElement(datastore_doc, xmlCopyNode(target_ds->children, 1));
-	if (target_ds->children) {
-		for (root = target_ds->children->next; root != NULL; root = aux_node) {
-			aux_node = root->next;
-			xmlAddNextSibling(datastore_doc->last, xmlCopyNode(root, 1));
-		}
-	}
-
 	/* preform edit config */
-	if (edit_config(datastore_doc, config_doc, (struct ncds_ds*)file_ds, defop, errop, (rpc != NULL) ? rpc->nacm : NULL, error)) {
+	if (file_edit_apply(file_ds, target_ds, config_doc, defop, errop, (rpc != NULL) ? rpc->nacm : NULL,
+			(target == NC_DATASTORE_RUNNING) ? file_ds->ds.running_edit : NULL, error)) {
 		retval = EXIT_FAILURE;
 	} else {
-		/* replace datastore by edited configuration */
-		while ((aux_node = target_ds->children) != NULL) {
-			xmlUnlinkNode(aux_node);
-			xmlFreeNode(aux_node);
-		}
-		xmlAddChildList(target_ds, xmlCopyNodeList(datastore_doc->children));
+		/* only the edit is stored, not the whole edited configuration */
+		file_journal_add(file_ds, 'e', target, defop, errop, NULL, configp, strlen(configp));
 
 		/*
 		 * if we are changing candidate, mark it as modified, since we need
@@ -1433,6 +2543,7 @@ int ncds_file_editconfig(struct ncds_ds *ds, const struct nc_session * session,
 		 */
 		if (target == NC_DATASTORE_CANDIDATE) {
 			xmlSetProp(target_ds, BAD_CAST "modified", BAD_CAST "true");
+			file_journal_add_attr(file_ds, target, "modified", "true");
 		}
 
 		/* sync xml tree with file on the hdd */
@@ -1444,7 +2555,6 @@ int ncds_file_editconfig(struct ncds_ds *ds, const struct nc_session * session,
 	}
 	UNLOCK(file_ds);
 
-	xmlFreeDoc(datastore_doc);
 	xmlFreeDoc(config_doc);
 
 	return retval;
@@ -43,15 +43,55 @@
 #include "../../netconf_internal.h"
 #include "../datastore_internal.h"
 #include <semaphore.h>
+#include <pthread.h>
+#include <stdint.h>
 
 /* Unique name prefix of every semaphore created */
 #define NCDS_LOCK "/NCDS_FLOCK"
 
+/* Unique name prefix of every shared memory object with the datastore generation */
+#define NCDS_SHM "/NCDS_FSHM"
+
 /* Number of seconds waiting for a semaphore increment before
  * giving up and cancelling the locking
  */
 #define NCDS_LOCK_TIMEOUT 5
 
+/* Suffix of the journal file path, the journal is stored next to the datastore file */
+#define NCDS_JOURNAL_SUFFIX ".journal"
+
+/* Suffix of the temporary file written by the datastore compaction before it
+ * replaces the datastore file, the mkstemp() template follows it */
+#define NCDS_COMPACT_SUFFIX ".compact."
+
+/* The journal is merged into the datastore file when it gets bigger than
+ * the datastore file and than this size
+ */
+#define NCDS_JOURNAL_MIN_SIZE (64*1024)
+
+/**
+ * @brief Generation and lock of the file datastore shared by all the processes
+ * using it. Both counters are changed only by the holder of the lock.
+ */
+struct ncds_file_shared {
+	/**
+	 * @brief Incremented on every change of the datastore
+	 */
+	uint64_t generation;
+	/**
+	 * @brief Incremented when the datastore file is rewritten
+	 */
+	uint64_t file_generation;
+	/**
+	 * @brief Robust process-shared mutex serializing the changes of the datastore
+	 */
+	pthread_mutex_t lock;
+	/**
+	 * @brief Set when the lock is initialized
+	 */
+	int lock_ready;
+};
+
 /**
  * @brief File datastore implementation-specific ncds_ds structure.
  */
@@ -69,14 +109,62 @@ struct ncds_ds_file {
 	 * @brief File descriptor of an opened file containing the configuration data
 	 */
 	FILE* file;
+	/**
+	 * @brief Path to the journal of the changes made since the datastore file
+	 * was written.
+	 */
+	char* journal_path;
+	/**
+	 * @brief File descriptor of the opened journal
+	 */
+	int journal_fd;
+	/**
+	 * @brief Size of the journal part already applied to the xml
+	 */
+	off_t journal_offset;
+	/**
+	 * @brief Journal records of the current operation not yet written
+	 */
+	xmlBufferPtr journal_records;
+	/**
+	 * @brief Identification of the datastore file version loaded into the xml
+	 */
+	ino_t file_ino;
+	off_t file_size;
+	struct timespec file_mtime;
+	/**
+	 * @brief Datastore generation in the shared memory, NULL if not available
+	 */
+	struct ncds_file_shared* shared;
+	/**
+	 * @brief Generations of the datastore and the datastore file loaded into the xml
+	 */
+	uint64_t generation;
+	uint64_t file_generation;
+	/**
+	 * @brief Serialized content of the running, startup and candidate datastores
+	 * returned by get-config, NULL when not valid
+	 */
+	char* snapshot[3];
+	size_t snapshot_len[3];
 	/**
 	 * libxml2's document structure of the datastore
 	 */
 	xmlDocPtr xml;
 	/**
-	 * backup libxml2's document structure of the datastore for rollback
+	 * backup of the datastore content replaced by the last change for rollback,
+	 * the replaced nodes are moved under the root element of this document
 	 */
 	xmlDocPtr xml_rollback;
+	/**
+	 * datastore whose content is in xml_rollback, NC_DATASTORE_ERROR if the
+	 * last change has not replaced any content
+	 */
+	NC_DATASTORE rollback_target;
+	/**
+	 * value of the candidate's modified attribute before the last change
+	 */
+	xmlChar* rollback_modified;
 	/**
 	 * libxml2 Node pointers providing access to individual datastores
 	 */
@@ -86,9 +174,15 @@ struct ncds_ds_file {
 	 */
 	struct ds_lock_s {
 		/**
-		 * semaphore pointer
+		 * semaphore pointer, the semaphore serializes the processes only when
+		 * the lock in the shared memory is not available
 		 */
 		sem_t * lock;
+		/**
+		 * reader/writer lock of the threads of this process, readers share it
+		 * only while the xml is up to date
+		 */
+		pthread_rwlock_t rwlock;
 		/**
 		 * signal set before locked
 	 	 */
@@ -135,6 +229,17 @@ int ncds_file_rollback(struct ncds_ds* ds);
 */
 char* ncds_file_getconfig(struct ncds_ds* ds, const struct nc_session* session, NC_DATASTORE source, struct nc_err** error);
 
+/**
+ * @brief Perform get-config on the specified repository, without serializing the data.
+ *
+ * @param[in] ds File datastore structure from which the data will be obtained.
+ * @param[in] session Session originating the request.
+ * @param[in] source Datastore (running, startup, candidate) to get the data from.
+ * @param[out] error NETCONF error structure describing the experienced error.
+ * @return NULL on error, a copy of the configuration data on success.
+*/
+xmlDocPtr ncds_file_getconfig_xml(struct ncds_ds* ds, const struct nc_session* session, NC_DATASTORE source, struct nc_err** error);
+
 /**
  * @brief Get lock information about the specified NETCONF datastore
  * @param[in] ds File datastore structure that will be checked.
@@ -324,10 +324,22 @@ static int nc_shared_cleanup(int del_shm) {
 	} else {
 		while ((dr = readdir(dir))) {
 			if (strncmp(dr->d_name, lock_prefix, strlen(lock_prefix)) == 0) {
-				sprintf(path, "/dev/shm/%s", dr->d_name);
+				if (snprintf(path, sizeof(path), "/dev/shm/%s", dr->d_name) >= (int)sizeof(path)) {
+					/* not created by us, our names are short enough */
+					continue;
+				}
 				if (unlink(path) == -1) {
 					DBG("Failed to remove semaphore \"%s\" (%s).", path, strerror(errno));
 				}
+			} else if (strncmp(dr->d_name, NCDS_SHM + 1, strlen(NCDS_SHM) - 1) == 0) {
+				/* generation of the file datastore */
+				if (snprintf(path, sizeof(path), "/dev/shm/%s", dr->d_name) >= (int)sizeof(path)) {
+					/* not created by us, our names are short enough */
+					continue;
+				}
+				if (unlink(path) == -1) {
+					DBG("Failed to remove shared memory \"%s\" (%s).", path, strerror(errno));
+				}
 			}
 		}
 		closedir(dir);
@@ -118,6 +118,7 @@ static struct nc_filter *nc_filter_new_subtree(const xmlNodePtr filter)
 	}
 
 	retval->type = NC_FILTER_SUBTREE;
+	retval->compiled = NULL;
 	retval->subtree_filter = xmlNewNode(NULL, BAD_CAST "filter");
 	if (retval->subtree_filter == NULL) {
 		ERROR("xmlNewNode failed (%s:%d).", __FILE__, __LINE__);
@@ -219,6 +220,7 @@ API void nc_filter_free(struct nc_filter* filter)
 		if (filter->subtree_filter) {
 			xmlFreeNode(filter->subtree_filter);
 		}
+		ncxml_filter_compiled_free(filter->compiled);
 		free(filter);
 	}
 }
@@ -1478,6 +1480,7 @@ API struct nc_filter* nc_rpc_get_filter(const nc_rpc* rpc)
 
 	if (filter_node != NULL) {
 		retval = malloc(sizeof(struct nc_filter));
+		retval->compiled = NULL;
 		type_string = xmlGetProp(filter_node, BAD_CAST "type");
 		/* set filter type */
 		if (type_string == NULL || xmlStrcmp(type_string, BAD_CAST "subtree") == 0) {
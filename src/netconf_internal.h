@@ -164,6 +164,19 @@
  */
 #define NC_READ_SLEEP 100
 
+/**
+ * Size of the data block read from the transport at once, it is also the
+ * initial size of the session's receive buffer
+ */
+#define NC_READ_BUFSIZE 16384
+
+/**
+ * Size of the session's output buffer, the serialized message is written into
+ * the transport (as a single chunk in case of NETCONF 1.1) by the blocks of
+ * this size
+ */
+#define NC_WRITE_BUFSIZE 65536
+
 /*
  * global settings for options passed to xmlRead* functions
  */
@@ -360,6 +373,18 @@ struct nc_session {
 #endif
 	/**< @brief Output file descriptor for communication with (writing to) the other side of the NETCONF session */
 	int fd_output;
+	/**< @brief Buffer for the data read from the transport but not yet processed */
+	char *rbuf;
+	/**< @brief Allocated size of the receive buffer */
+	size_t rbuf_size;
+	/**< @brief Offset of the first unprocessed byte in the receive buffer */
+	size_t rbuf_start;
+	/**< @brief Offset after the last unprocessed byte in the receive buffer */
+	size_t rbuf_end;
+	/**< @brief Buffer for the serialized message being sent, NC_WRITE_BUFSIZE long */
+	char *wbuf;
+	/**< @brief Number of bytes waiting in the output buffer */
+	size_t wbuf_len;
 	/**< @brief Transport protocol identifier */
 	NC_TRANSPORT transport;
 #ifndef DISABLE_LIBSSH
@@ -411,6 +436,8 @@ struct nc_session {
 	int ntf_active;
 	/**< @brief flag for stopping notification subscription on the session */
 	int ntf_stop;
+	/**< @brief signal of the stream the notification dispatcher waits on */
+	struct stream_signal *ntf_signal;
 	/**< @brief thread lock for notifications */
 	pthread_mutex_t mut_ntf;
 	/**< @brief flag for NACM Recovery session - set if session user ID is 0 */
@@ -534,9 +561,16 @@ struct nc_msg {
 	NC_DATASTORE target;
 };
 
+struct nc_filter_compiled;
+
 struct nc_filter {
 	NC_FILTER_TYPE type;
 	xmlNodePtr subtree_filter;
+	/**
+	 * @brief Subtree filter compiled by ncxml_filter_compile(), NULL if not
+	 * compiled yet.
+	 */
+	struct nc_filter_compiled* compiled;
 };
 
 struct nc_cpblts {
@@ -610,14 +644,33 @@ int ncdflt_edit_remove_default(xmlDocPtr config, const xmlDocPtr model);
  */
 struct nc_err* nc_err_parse(nc_reply* reply);
 
+struct model_keys;
+
 /**
  * @brief Apply filter on the given XML document.
  * @param data XML document to be filtered.
  * @param filter Filter to apply. Only 'subtree' filters are supported.
  * @param data_model Data model of the filtered document.
+ * @param keys Compiled list keys of the data model, NULL if not available.
  * @return 0 on success,\n non-zero else
  */
-int ncxml_filter(xmlNodePtr old, const struct nc_filter * filter, xmlNodePtr *new, const xmlDocPtr data_model);
+int ncxml_filter(xmlNodePtr old, const struct nc_filter * filter, xmlNodePtr *new, const xmlDocPtr data_model, struct model_keys* keys);
+
+/**
+ * @brief Compile the subtree filter to be applied by ncxml_filter(). The
+ * compiled filter is kept in the filter structure and it is not modified by
+ * ncxml_filter(), so it can be shared by the datastores and threads processing
+ * the same request.
+ * @param filter Filter to compile. Only 'subtree' filters are supported.
+ * @return 0 on success,\n non-zero else
+ */
+int ncxml_filter_compile(struct nc_filter* filter);
+
+/**
+ * @brief Free the subtree filter compiled by ncxml_filter_compile().
+ * @param compiled Compiled filter to free.
+ */
+void ncxml_filter_compiled_free(struct nc_filter_compiled* compiled);
 
 /**
  * @brief Get state information about sessions. Only information about monitored
@@ -646,11 +699,24 @@ const char* nc_session_term_string(NC_SESSION_TERM_REASON reason);
  */
 void nc_session_close (struct nc_session* session, NC_SESSION_TERM_REASON reason);
 
+/**
+ * @brief Send the notification already serialized by ncntf_dispatch_send().
+ *
+ * @param[in] session NETCONF session to send the notification to.
+ * @param[in] text Serialized \<notification\> message.
+ * @param[in] len Length of the text.
+ * @return EXIT_SUCCESS or EXIT_FAILURE
+ */
+int nc_session_send_notif_text(struct nc_session* session, const char* text, size_t len);
+
 #ifndef DISABLE_NOTIFICATIONS
 
 /* sleep time in dispatch loops in microseconds */
 #define NCNTF_DISPATCH_SLEEP 10000
 
+/* maximal time in milliseconds to wait for a new event before checking the subscription */
+#define NCNTF_DISPATCH_TIMEOUT 1000
+
 /**
  * @brief Initiate the NETCONF Notifications environment
  * @return 0 on success, non-zero value else
@@ -666,6 +732,13 @@ void ncntf_close(void);
 int *ncntf_dispatch_location(void);
 #define ncntf_dispatch (*ncntf_dispatch_location())
 
+/**
+ * @brief Wake up the ncntf_dispatch_send() waiting for new events on the
+ * session, e.g. to let it notice the ntf_stop flag.
+ * @param[in] session Session with the active notification subscription.
+ */
+void ncntf_dispatch_wakeup(struct nc_session *session);
+
 #endif /* DISABLE_NOTIFICATIONS */
 
 /**
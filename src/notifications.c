@@ -55,8 +55,14 @@
 #include <stdarg.h>
 #include <poll.h>
 #include <pthread.h>
+#include <limits.h>
+#include <sys/syscall.h>
+#ifdef __linux__
+#include <linux/futex.h>
+#endif
 
 #include <libxml/tree.h>
+#include <libxml/hash.h>
 #include <libxml/xpath.h>
 #include <libxml/xpathInternals.h>
 
@@ -90,10 +96,26 @@ static char* streams_path = NULL;
 /* access to the NACM statistics */
 extern struct nc_shared_info *nc_info;
 
+/* minimal length of a stream file mapping, it is doubled when the file outgrows it */
+#define NCNTF_STREAM_MAP_MIN (1024*1024)
+
+/*
+ * memory mapping of a stream file, it reaches beyond the end of the file so
+ * the appended events are accessible without mapping the file again
+ */
+struct stream_map {
+	char* addr;
+	size_t length; /* length of the mapping */
+	size_t size; /* part of the file known to be written, only this part is accessed */
+};
+
 struct stream_offset {
 	const char* stream;
 	off_t eof_offset;
 	off_t cur_offset;
+	unsigned int lap; /* lap in which the record at cur_offset was written */
+	int replay_seek; /* replay start was not yet searched in the stream index */
+	struct stream_map map; /* thread's own mapping of the stream file */
 	struct stream_offset* next;
 };
 
@@ -111,6 +133,9 @@ static void ncntf_replay_ends_free(void* data)
 	while (list != NULL) {
 		item = list;
 		list = list->next;
+		if (item->map.addr != NULL) {
+			munmap(item->map.addr, item->map.length);
+		}
 		free(item);
 	}
 }
@@ -133,26 +158,108 @@ static void ncntf_replay_ends_free(void* data)
 #define MAGIC_NAME "NCSTREAM"
 #define MAGIC_VERSION 0xFF01
 
+/*
+ * STREAM INDEX FILE FORMAT
+ * char[8] == "NCSINDEX"
+ * struct index_entry[] entries; - sorted by the offset
+ *
+ * Index is sparse, a new entry is added when the stream file grows by
+ * NCNTF_INDEX_GAP bytes since the last entry. It allows to skip the old
+ * events when the replay starts without reading the whole stream file.
+ */
+#define MAGIC_INDEX "NCSINDEX"
+#define NCNTF_INDEX_GAP (64*1024)
+
+struct index_entry {
+	uint64_t offset; /* offset of a record in the stream file */
+	uint64_t maxtime; /* none of the events stored before the offset is newer */
+};
+
+/*
+ * Events are stored into the stream by a single writer at a time (write_mut
+ * inside the process, file lock between processes) while the readers do not
+ * lock at all. Readers access only the records before the current_offset,
+ * which is published by the writer after the record is completely written.
+ *
+ * If the stream file size is limited, the writer starts again from the
+ * beginning of the records when the file is full and increases the lap
+ * counter. Before overwriting anything, the writer publishes the end of the
+ * file part being overwritten (together with the lap in a single write_pos
+ * value) and readers check after reading a record from the previous lap
+ * that it was not overwritten in the meantime.
+ */
+#define WRITE_POS(lap, end) (((uint64_t)(lap) << 32) | (uint32_t)(end))
+#define WRITE_POS_LAP(pos) ((unsigned int)((pos) >> 32))
+#define WRITE_POS_END(pos) ((unsigned int)((pos) & 0xffffffff))
+
+/*
+ * Readers waiting for new events sleep on the seq counter of the stream, so
+ * they are woken up by the writers in the same process. Like the
+ * current_offset and write_pos, the signal is process-local: a process does
+ * not see the events stored by other processes until it opens the stream
+ * again.
+ */
+struct stream_signal {
+	uint32_t seq; /* changed with every stored event */
+	uint32_t waiters; /* number of readers sleeping on seq */
+};
+
+/*
+ * Events recently read from the stream are shared by all the readers in the
+ * process, so an event is copied from the stream file, parsed and serialized
+ * only once no matter how many subscribers it is sent to. A record is
+ * identified by its offset and the lap in which it was written. The cache
+ * holds a reference to each of its events, the readers get their own
+ * references.
+ */
+#define NCNTF_EVENT_CACHE_SIZE 64
+
+struct ncntf_event {
+	unsigned int lap;
+	off_t offset;
+	int32_t len;
+	uint64_t time;
+	char* text; /* event as stored in the stream */
+	int refs;
+	pthread_mutex_t lock; /* to build the following members only once */
+	int parsed;
+	xmlDocPtr doc; /* parsed text, shared by the readers and never modified */
+	xmlBufferPtr data; /* doc serialized the same way as when sent */
+};
+
 struct stream {
 	int fd_events;
 	int fd_rules;
+	int fd_index;
+	struct stream_signal signal;
+	struct stream_map map; /* writer's mapping of the stream file */
+	pthread_mutex_t write_mut;
 	char* name;
 	char* desc;
 	uint8_t replay;
 	time_t created;
 	int locked;
 	char* rules;
+	pthread_rwlock_t rules_lock;
+	xmlHashTablePtr rules_set; /* event names allowed by the rules */
+	size_t rules_len; /* length of the rules added into the rules_set */
 	unsigned int data;
-	unsigned int current_offset;
+	unsigned int current_offset; /* end of the last stored record */
+	uint64_t write_pos; /* current lap and the end of the file part being written */
+	pthread_mutex_t cache_mut;
+	struct ncntf_event *cache[NCNTF_EVENT_CACHE_SIZE];
 	struct stream *next;
 };
 
 /* status information of the stream configuration */
 static xmlDocPtr ncntf_config = NULL;
 
-/* internal list of used streams with a mutex to control access to the list */
+/*
+ * internal list of used streams with a lock to control access to the list,
+ * items are only added into the list until ncntf_close()
+ */
 static struct stream *streams = NULL;
-static pthread_mutex_t *streams_mut = NULL;
+static pthread_rwlock_t *streams_lock = NULL;
 
 /* local function declaration */
 static int ncntf_event_isallowed(const char* stream, const char* event);
@@ -366,6 +473,42 @@ static int map_rules(struct stream *s)
 	}
 }
 
+/*
+ * Wake up all the readers waiting for new events in the stream.
+ */
+static void ncntf_signal_wake(struct stream_signal *signal)
+{
+	__atomic_add_fetch(&(signal->seq), 1, __ATOMIC_SEQ_CST);
+#ifdef __linux__
+	if (__atomic_load_n(&(signal->waiters), __ATOMIC_SEQ_CST) != 0) {
+		syscall(SYS_futex, &(signal->seq), FUTEX_WAKE_PRIVATE, INT_MAX, NULL, NULL, 0);
+	}
+#endif
+}
+
+/*
+ * Sleep until the signal's seq differs from the given value or until the
+ * timeout (in milliseconds) elapses.
+ */
+static void ncntf_signal_wait(struct stream_signal *signal, uint32_t seq, int timeout)
+{
+#ifdef __linux__
+	struct timespec ts;
+
+	ts.tv_sec = timeout / 1000;
+	ts.tv_nsec = (timeout % 1000) * 1000000;
+
+	__atomic_add_fetch(&(signal->waiters), 1, __ATOMIC_SEQ_CST);
+	syscall(SYS_futex, &(signal->seq), FUTEX_WAIT_PRIVATE, seq, &ts, NULL, 0);
+	__atomic_sub_fetch(&(signal->waiters), 1, __ATOMIC_SEQ_CST);
+#else
+	/* no futex, poll the signal */
+	for (; timeout > 0 && __atomic_load_n(&(signal->seq), __ATOMIC_ACQUIRE) == seq; timeout -= NCNTF_DISPATCH_SLEEP / 1000) {
+		usleep(NCNTF_DISPATCH_SLEEP);
+	}
+#endif
+}
+
 static unsigned int ncntf_last_notification_offset(struct stream* s)
 {
 	uint64_t t = 0;
@@ -408,32 +551,6 @@ static unsigned int ncntf_last_notification_offset(struct stream* s)
 	return offset;
 }
 
-static int ncntf_check_file_ended(struct stream* s)
-{
-	int r = 0;
-	uint64_t t = 0;
-	uint32_t size = 0, end_marker = 0;
-	unsigned int actual_offset = lseek(s->fd_events, 0, SEEK_CUR);
-
-	if ((r = read(s->fd_events, &(size), sizeof(size))) < 0) {
-		return -1;
-	}
-
-	if (size == MAGIC_MARKER_SIZE) {
-		if ((r = read(s->fd_events, &(t), sizeof(t))) < 0) {
-			return -1;
-		}
-		if ((r = read(s->fd_events, &(end_marker), sizeof(end_marker))) < 0) {
-			return -1;
-		}
-		if (end_marker == MAGIC_EOF_MARKER) {
-			return 1;
-		}
-	}
-	lseek(s->fd_events, actual_offset, SEEK_SET);
-	return 0;
-}
-
 static int ncntf_write_end_marker(struct stream* s, uint64_t etime64, uint32_t magic)
 {
 	uint32_t r = 0;
@@ -453,6 +570,409 @@ static int ncntf_write_end_marker(struct stream* s, uint64_t etime64, uint32_t m
 	return 0;
 }
 
+/*
+ * Make sure that the stream file is mapped into memory at least up to the
+ * given size. The file is growing with every stored event, so it is mapped
+ * again only when it outgrows the mapping, which is then doubled. Returns
+ * EXIT_FAILURE also if the file is shorter than the requested size.
+ */
+static int ncntf_stream_map(struct stream *s, struct stream_map *map, size_t size)
+{
+	struct stat st;
+	char* addr;
+	size_t length;
+
+	if (map->addr != NULL && map->size >= size) {
+		/* the requested part of the file is already mapped */
+		return (EXIT_SUCCESS);
+	}
+
+	if (fstat(s->fd_events, &st) == -1) {
+		ERROR("fstat() on the stream file \'%s\' failed (%s).", s->name, strerror(errno));
+		return (EXIT_FAILURE);
+	}
+	if ((size_t)st.st_size < size) {
+		return (EXIT_FAILURE);
+	}
+	if (map->addr != NULL && map->length >= (size_t)st.st_size) {
+		/* the appended events are already covered by the mapping */
+		map->size = st.st_size;
+		return (EXIT_SUCCESS);
+	}
+
+	for (length = (map->length == 0) ? NCNTF_STREAM_MAP_MIN : 2 * map->length; length < (size_t)st.st_size; length *= 2);
+	addr = mmap(NULL, length, PROT_READ, MAP_SHARED, s->fd_events, 0);
+	if (addr == MAP_FAILED) {
+		ERROR("mmapping the Events stream file failed (%s)", strerror(errno));
+		return (EXIT_FAILURE);
+	}
+	if (map->addr != NULL) {
+		munmap(map->addr, map->length);
+	}
+	map->addr = addr;
+	map->length = length;
+	map->size = st.st_size;
+
+	return (EXIT_SUCCESS);
+}
+
+/*
+ * Get the record stored in the stream file at the given offset. Returns
+ * pointer to the record's data in the mapped stream file, NULL on error.
+ */
+static const char* ncntf_stream_record(struct stream *s, struct stream_map *map, off_t offset, int32_t *len, uint64_t *t)
+{
+	const size_t hlen = sizeof(int32_t) + sizeof(uint64_t);
+
+	if (ncntf_stream_map(s, map, offset + hlen) != 0) {
+		return (NULL);
+	}
+	memcpy(len, map->addr + offset, sizeof(int32_t));
+	memcpy(t, map->addr + offset + sizeof(int32_t), sizeof(uint64_t));
+	if (*len < 0 || ncntf_stream_map(s, map, offset + hlen + *len) != 0) {
+		return (NULL);
+	}
+
+	return (map->addr + offset + hlen);
+}
+
+/*
+ * Check that the record read from the given offset in the given lap was not
+ * overwritten by the writer in the meantime. Returns 1 if the read record is
+ * valid, 0 if the reader has to start again from the beginning of the records.
+ */
+static int ncntf_stream_record_valid(struct stream *s, unsigned int lap, off_t offset)
+{
+	uint64_t pos;
+
+	/* all the record data have to be read before the check */
+	__atomic_thread_fence(__ATOMIC_ACQUIRE);
+	pos = __atomic_load_n(&(s->write_pos), __ATOMIC_ACQUIRE);
+
+	if (WRITE_POS_LAP(pos) == lap) {
+		return (1);
+	} else if (WRITE_POS_LAP(pos) == lap + 1 && offset >= (off_t)WRITE_POS_END(pos)) {
+		/* the writer is in the next lap, but it is still before the record */
+		return (1);
+	}
+	return (0);
+}
+
+/*
+ * Remove all the entries from the stream index file
+ */
+static int ncntf_index_reset(struct stream *s)
+{
+	ssize_t r;
+
+	if (s->fd_index == -1) {
+		return (EXIT_FAILURE);
+	}
+
+	if (ftruncate(s->fd_index, 0) == -1) {
+		ERROR("ftruncate() on the stream index file \'%s\' failed (%s).", s->name, strerror(errno));
+		return (EXIT_FAILURE);
+	}
+	while (((r = pwrite(s->fd_index, MAGIC_INDEX, strlen(MAGIC_INDEX), 0)) == -1) && (errno == EAGAIN ||errno == EINTR));
+	if (r != (ssize_t)strlen(MAGIC_INDEX)) {
+		WARN("Writing a stream index file header failed (%s).", strerror(errno));
+		return (EXIT_FAILURE);
+	}
+
+	return (EXIT_SUCCESS);
+}
+
+/*
+ * Open the index file of the stream. If the index file does not exist or it
+ * does not correspond to the stream file, an empty index is created. Without
+ * the index, the stream still works, only the replay has to read the stream
+ * file from its beginning.
+ */
+static int ncntf_index_open(struct stream *s)
+{
+	char* filepath = NULL;
+	char magic[strlen(MAGIC_INDEX)];
+	struct index_entry entry;
+	struct stat st;
+	mode_t mask;
+
+	if (streams_path == NULL) {
+		return (EXIT_FAILURE);
+	}
+
+	if (s->fd_index == -1) {
+		if (asprintf(&filepath, "%s/%s.index", streams_path, s->name) == -1) {
+			ERROR("asprintf() failed (%s:%d).", __FILE__, __LINE__);
+			return (EXIT_FAILURE);
+		}
+		mask = umask(0000);
+		s->fd_index = open(filepath, O_RDWR | O_CREAT, FILE_PERM);
+		umask(mask);
+		if (s->fd_index == -1) {
+			WARN("Unable to open the Events stream index file %s (%s)", filepath, strerror(errno));
+			free(filepath);
+			return (EXIT_FAILURE);
+		}
+		free(filepath);
+	}
+
+	/* check the index content */
+	if (fstat(s->fd_index, &st) == -1 ||
+			st.st_size < (off_t)strlen(MAGIC_INDEX) ||
+			(st.st_size - strlen(MAGIC_INDEX)) % sizeof(struct index_entry) != 0 ||
+			pread(s->fd_index, magic, strlen(MAGIC_INDEX), 0) != (ssize_t)strlen(MAGIC_INDEX) ||
+			strncmp(magic, MAGIC_INDEX, strlen(MAGIC_INDEX)) != 0) {
+		return (ncntf_index_reset(s));
+	}
+	if ((size_t)st.st_size > strlen(MAGIC_INDEX)) {
+		if (pread(s->fd_index, &entry, sizeof(entry), st.st_size - sizeof(entry)) != sizeof(entry) ||
+				entry.offset < s->data || entry.offset > s->current_offset) {
+			/* index does not correspond to the stream file */
+			return (ncntf_index_reset(s));
+		}
+	}
+
+	return (EXIT_SUCCESS);
+}
+
+/*
+ * Add a new entry into the stream index if the record stored at the given
+ * offset is far enough from the last indexed record. The caller is supposed
+ * to be the stream writer.
+ */
+static void ncntf_index_update(struct stream *s, off_t offset)
+{
+	struct index_entry entry = {s->data, 0};
+	struct stat st;
+	off_t pos;
+	int32_t len;
+	uint64_t t;
+	ssize_t r;
+
+	if (s->fd_index == -1 || fstat(s->fd_index, &st) == -1) {
+		return;
+	}
+
+	/* get the last index entry */
+	if ((size_t)st.st_size >= strlen(MAGIC_INDEX) + sizeof(entry)) {
+		if (pread(s->fd_index, &entry, sizeof(entry), st.st_size - sizeof(entry)) != sizeof(entry)) {
+			return;
+		}
+	}
+	if ((uint64_t)offset < entry.offset + NCNTF_INDEX_GAP) {
+		return;
+	}
+
+	/* get the newest event stored since the last index entry */
+	for (pos = entry.offset; pos < offset; pos += sizeof(int32_t) + sizeof(uint64_t) + len) {
+		if (ncntf_stream_record(s, &(s->map), pos, &len, &t) == NULL || len == 0) {
+			WARN("Unable to update the index of the stream \'%s\'.", s->name);
+			return;
+		}
+		if (t > entry.maxtime) {
+			entry.maxtime = t;
+		}
+	}
+	entry.offset = offset;
+
+	while (((r = pwrite(s->fd_index, &entry, sizeof(entry), st.st_size)) == -1) && (errno == EAGAIN ||errno == EINTR));
+	if (r != sizeof(entry)) {
+		WARN("Writing into the stream index file failed (%s).", strerror(errno));
+		ncntf_index_reset(s);
+	}
+}
+
+/*
+ * Find the offset in the stream file where the replay from the specified
+ * start time should begin. All the events stored before the returned offset
+ * are older than the start time. Offset is never behind the given end
+ * of replay.
+ */
+static off_t ncntf_index_seek(struct stream *s, time_t start, off_t end)
+{
+	struct index_entry entry;
+	struct stat st;
+	size_t l, r, m;
+	off_t offset = s->data;
+
+	/*
+	 * the index is read by pread() instead of mapping it, since the writer
+	 * can truncate the index file anytime
+	 */
+	if (s->fd_index == -1 || fstat(s->fd_index, &st) == -1 ||
+			(size_t)st.st_size < strlen(MAGIC_INDEX) + sizeof(struct index_entry)) {
+		return (offset);
+	}
+
+	/* binary search for the first entry with some event not older than start */
+	l = 0;
+	r = (st.st_size - strlen(MAGIC_INDEX)) / sizeof(struct index_entry);
+	while (l < r) {
+		m = (l + r) / 2;
+		if (pread(s->fd_index, &entry, sizeof(entry), strlen(MAGIC_INDEX) + m * sizeof(entry)) != sizeof(entry)) {
+			/* index was truncated */
+			return (offset);
+		}
+		if ((time_t)entry.maxtime < start) {
+			l = m + 1;
+		} else {
+			r = m;
+		}
+	}
+	if (l > 0) {
+		/* events before the previous entry are all older than start */
+		if (pread(s->fd_index, &entry, sizeof(entry), strlen(MAGIC_INDEX) + (l - 1) * sizeof(entry)) != sizeof(entry)) {
+			return (offset);
+		}
+		offset = entry.offset;
+	}
+
+	return ((offset > end) ? end : offset);
+}
+
+/*
+ * Create a new event with a single reference held by the caller.
+ */
+static struct ncntf_event* ncntf_event_create(const char* text, int32_t len, uint64_t t)
+{
+	struct ncntf_event *ev;
+
+	if ((ev = malloc(sizeof(struct ncntf_event))) == NULL || (ev->text = malloc(len * sizeof(char))) == NULL) {
+		ERROR("Memory allocation failed - %s (%s:%d).", strerror (errno), __FILE__, __LINE__);
+		free(ev);
+		return (NULL);
+	}
+	memcpy(ev->text, text, len);
+	ev->len = len;
+	ev->time = t;
+	ev->lap = 0;
+	ev->offset = -1;
+	ev->refs = 1;
+	pthread_mutex_init(&(ev->lock), NULL);
+	ev->parsed = 0;
+	ev->doc = NULL;
+	ev->data = NULL;
+
+	return (ev);
+}
+
+static void ncntf_event_release(struct ncntf_event *ev)
+{
+	if (ev == NULL || __atomic_sub_fetch(&(ev->refs), 1, __ATOMIC_ACQ_REL) != 0) {
+		return;
+	}
+
+	free(ev->text);
+	if (ev->doc != NULL) {
+		xmlFreeDoc(ev->doc);
+	}
+	if (ev->data != NULL) {
+		xmlBufferFree(ev->data);
+	}
+	pthread_mutex_destroy(&(ev->lock));
+	free(ev);
+}
+
+/*
+ * Get the parsed event. The document is shared by all the holders of the
+ * event, so it must not be modified.
+ */
+static xmlDocPtr ncntf_event_doc(struct ncntf_event *ev)
+{
+	xmlDocPtr doc;
+
+	pthread_mutex_lock(&(ev->lock));
+	if (!ev->parsed) {
+		ev->doc = xmlReadMemory(ev->text, strlen(ev->text), NULL, NULL, NC_XMLREAD_OPTIONS);
+		ev->parsed = 1;
+	}
+	doc = ev->doc;
+	pthread_mutex_unlock(&(ev->lock));
+
+	return (doc);
+}
+
+/*
+ * Get the event serialized as a <notification> message, it is exactly what
+ * nc_session_send_notif() would send with the parsed event.
+ */
+static xmlBufferPtr ncntf_event_data(struct ncntf_event *ev)
+{
+	xmlDocPtr doc;
+	xmlBufferPtr data;
+	xmlOutputBufferPtr out;
+
+	if ((doc = ncntf_event_doc(ev)) == NULL) {
+		return (NULL);
+	}
+
+	pthread_mutex_lock(&(ev->lock));
+	if (ev->data == NULL && (data = xmlBufferCreate()) != NULL) {
+		if ((out = xmlOutputBufferCreateBuffer(data, NULL)) == NULL ||
+				xmlSaveFormatFileTo(out, doc, NULL, NC_CONTENT_FORMATTED) < 0) {
+			/* the output buffer is closed by the function */
+			ERROR("Serializing an event failed (%s:%d).", __FILE__, __LINE__);
+			xmlBufferFree(data);
+		} else {
+			ev->data = data;
+		}
+	}
+	data = ev->data;
+	pthread_mutex_unlock(&(ev->lock));
+
+	return (data);
+}
+
+static unsigned int ncntf_event_cache_slot(unsigned int lap, off_t offset)
+{
+	return ((((uint32_t)offset + lap) * 2654435761U) % NCNTF_EVENT_CACHE_SIZE);
+}
+
+/*
+ * Get a new reference to the cached event stored at the offset in the lap.
+ */
+static struct ncntf_event* ncntf_event_cache_get(struct stream *s, unsigned int lap, off_t offset)
+{
+	struct ncntf_event *ev;
+
+	pthread_mutex_lock(&(s->cache_mut));
+	ev = s->cache[ncntf_event_cache_slot(lap, offset)];
+	if (ev != NULL && ev->lap == lap && ev->offset == offset) {
+		__atomic_add_fetch(&(ev->refs), 1, __ATOMIC_RELAXED);
+	} else {
+		ev = NULL;
+	}
+	pthread_mutex_unlock(&(s->cache_mut));
+
+	return (ev);
+}
+
+/*
+ * Put the event into the cache. If another reader cached the same record
+ * meanwhile, the caller's reference is released and a reference to the
+ * cached event is returned instead.
+ */
+static struct ncntf_event* ncntf_event_cache_add(struct stream *s, struct ncntf_event *ev)
+{
+	struct ncntf_event *old;
+	unsigned int slot = ncntf_event_cache_slot(ev->lap, ev->offset);
+
+	pthread_mutex_lock(&(s->cache_mut));
+	old = s->cache[slot];
+	if (old != NULL && old->lap == ev->lap && old->offset == ev->offset) {
+		__atomic_add_fetch(&(old->refs), 1, __ATOMIC_RELAXED);
+		pthread_mutex_unlock(&(s->cache_mut));
+		ncntf_event_release(ev);
+		return (old);
+	}
+	/* reference held by the cache */
+	__atomic_add_fetch(&(ev->refs), 1, __ATOMIC_RELAXED);
+	s->cache[slot] = ev;
+	pthread_mutex_unlock(&(s->cache_mut));
+
+	ncntf_event_release(old);
+	return (ev);
+}
 
 /*
  * Create a new stream file and write the header corresponding to the given
@@ -567,6 +1087,7 @@ static int write_fileheader(struct stream *s)
 	/* set where the data starts */
 	s->data = lseek(s->fd_events, 0, SEEK_CUR);
 	s->current_offset = s->data;
+	s->write_pos = WRITE_POS(0, s->data);
 
 	//add end of end marker
 	while (((r = write(s->fd_events, &MAGIC_END_MARKER, MAGIC_MARKER_SIZE)) == -1) && (errno == EAGAIN ||errno == EINTR));
@@ -574,6 +1095,11 @@ static int write_fileheader(struct stream *s)
 		return (EXIT_FAILURE);
 	}
 
+	/* start with an empty index, the stream works even without it */
+	if (ncntf_index_open(s) == 0) {
+		ncntf_index_reset(s);
+	}
+
 	return (EXIT_SUCCESS);
 }
 
@@ -608,6 +1134,7 @@ static struct stream *read_fileheader(const char* filepath)
 	}
 	if (strncmp(magic_name, MAGIC_NAME, strlen(MAGIC_NAME)) != 0) {
 		/* file is not of libnetconf's stream file format */
+		close(fd);
 		free(s);
 		return (NULL);
 	}
@@ -644,12 +1171,28 @@ static struct stream *read_fileheader(const char* filepath)
 
 	s->locked = 0;
 	s->rules = NULL;
+	s->signal.seq = 0;
+	s->signal.waiters = 0;
 	s->fd_rules = -1;
+	s->fd_index = -1;
+	s->map.addr = NULL;
+	s->map.length = 0;
+	s->map.size = 0;
+	pthread_mutex_init(&(s->write_mut), NULL);
+	pthread_mutex_init(&(s->cache_mut), NULL);
+	pthread_rwlock_init(&(s->rules_lock), NULL);
+	s->rules_set = NULL;
+	s->rules_len = 0;
+	memset(s->cache, 0, sizeof(s->cache));
 	s->next = NULL;
 
 	/* move to last notification */
 	s->data = lseek(s->fd_events, 0, SEEK_CUR);
 	s->current_offset = ncntf_last_notification_offset(s);
+	s->write_pos = WRITE_POS(0, s->current_offset);
+
+	/* the stream works even without the index */
+	ncntf_index_open(s);
 
 	return (s);
 
@@ -665,6 +1208,8 @@ read_fail:
  */
 static void ncntf_stream_free(struct stream *s)
 {
+	int i;
+
 	if (s == NULL) {
 		return;
 	}
@@ -678,11 +1223,45 @@ static void ncntf_stream_free(struct stream *s)
 	if (s->fd_events != -1) {
 		close(s->fd_events);
 	}
+	if (s->fd_index != -1) {
+		close(s->fd_index);
+	}
+	if (s->map.addr != NULL) {
+		munmap(s->map.addr, s->map.length);
+	}
+	for (i = 0; i < NCNTF_EVENT_CACHE_SIZE; i++) {
+		ncntf_event_release(s->cache[i]);
+	}
+	pthread_mutex_destroy(&(s->cache_mut));
+	if (s->rules_set != NULL) {
+		xmlHashFree(s->rules_set, NULL);
+	}
+	pthread_rwlock_destroy(&(s->rules_lock));
+	pthread_mutex_destroy(&(s->write_mut));
 	free(s);
 }
 
 /*
- * Get the stream structure based on the given stream name
+ * Search for the stream in the list of streams, the caller is supposed to
+ * hold the streams_lock.
+ */
+static struct stream* ncntf_stream_find(const char* stream)
+{
+	struct stream *s;
+
+	for (s = streams; s != NULL; s = s->next) {
+		if (strcmp(s->name, stream) == 0) {
+			break;
+		}
+	}
+
+	return (s);
+}
+
+/*
+ * Get the stream structure based on the given stream name. The stream
+ * structures are not removed from the list until ncntf_close(), so the
+ * returned structure can be used without holding the streams_lock.
  */
 static struct stream* ncntf_stream_get(const char* stream)
 {
@@ -694,21 +1273,29 @@ static struct stream* ncntf_stream_get(const char* stream)
 	}
 
 	/* search for the specified stream in the list according to the name */
-	for (s = streams; s != NULL; s = s->next) {
-		if (strcmp(s->name, stream) == 0) {
-			/* the specified stream does exist */
-			return (s);
-		}
+	DBG_LOCK("streams_lock");
+	pthread_rwlock_rdlock(streams_lock);
+	s = ncntf_stream_find(stream);
+	DBG_UNLOCK("streams_lock");
+	pthread_rwlock_unlock(streams_lock);
+	if (s != NULL) {
+		/* the specified stream does exist */
+		return (s);
 	}
 
 	/*
 	 * the stream was not found in the current list - try to look at the
 	 * stream directory if the stream file wasn't created meanwhile
 	 */
-	if (s == NULL) {
+	DBG_LOCK("streams_lock");
+	pthread_rwlock_wrlock(streams_lock);
+	/* someone could add the stream before we got the write lock */
+	if ((s = ncntf_stream_find(stream)) == NULL) {
 		/* try to localize so far unrecognized stream file */
 		if (asprintf(&filepath, "%s/%s.events", streams_path, stream) == -1) {
 			ERROR("asprintf() failed (%s:%d).", __FILE__, __LINE__);
+			DBG_UNLOCK("streams_lock");
+			pthread_rwlock_unlock(streams_lock);
 			return (NULL);
 		}
 		if (((s = read_fileheader(filepath)) != NULL) && (map_rules(s) == 0)) {
@@ -722,13 +1309,15 @@ static struct stream* ncntf_stream_get(const char* stream)
 		}
 		free(filepath);
 	}
+	DBG_UNLOCK("streams_lock");
+	pthread_rwlock_unlock(streams_lock);
 
 	return (s);
 }
 
 /*
- * Lock the stream file to avoid concurrent writing/reading from different
- * processes.
+ * Lock the stream file to avoid concurrent writing from different processes.
+ * Readers do not lock the file, see the struct stream description.
  */
 static int ncntf_stream_lock(struct stream *s)
 {
@@ -800,15 +1389,15 @@ static int ncntf_streams_init(void)
 	 * lock the whole initialize operation, not only streams variable
 	 * manipulation since this starts a complete work with the streams
 	 */
-	DBG_LOCK("stream_mut");
-	pthread_mutex_lock(streams_mut);
+	DBG_LOCK("streams_lock");
+	pthread_rwlock_wrlock(streams_lock);
 
 	/* explore the stream directory */
 	n = scandir(streams_path, &filelist, NULL, alphasort);
 	if (n < 0) {
 		ERROR("Unable to read from the Events streams directory %s (%s).", streams_path, strerror(errno));
-		DBG_UNLOCK("streams_mut");
-		pthread_mutex_unlock(streams_mut);
+		DBG_UNLOCK("streams_lock");
+		pthread_rwlock_unlock(streams_lock);
 		return (EXIT_FAILURE);
 	}
 	/* keep only regular files that could store the events stream */
@@ -839,8 +1428,8 @@ static int ncntf_streams_init(void)
 		free(filelist[n]);
 	}
 
-	DBG_UNLOCK("streams_mut");
-	pthread_mutex_unlock(streams_mut);
+	DBG_UNLOCK("streams_lock");
+	pthread_rwlock_unlock(streams_lock);
 	free(filelist);
 
 	/* dump streams into xml status data */
@@ -863,50 +1452,39 @@ static void ncntf_streams_close(void)
 {
 	struct stream *s;
 
-	DBG_LOCK("stream_mut");
-	pthread_mutex_lock(streams_mut);
+	DBG_LOCK("streams_lock");
+	pthread_rwlock_wrlock(streams_lock);
 	s = streams;
 	while(s != NULL) {
 		streams = s->next;
 		ncntf_stream_free(s);
 		s = streams;
 	}
-	DBG_UNLOCK("streams_mut");
-	pthread_mutex_unlock(streams_mut);
+	DBG_UNLOCK("streams_lock");
+	pthread_rwlock_unlock(streams_lock);
 }
 
 int ncntf_init(void)
 {
 	int ret, r;
-	pthread_mutexattr_t mattr;
 
 	if (ncntf_config != NULL) {
 		/* we are already initialized */
 		return(EXIT_SUCCESS);
 	}
 
-	/* init streams' mutex if needed */
-	if (streams_mut == NULL) {
-		if (pthread_mutexattr_init(&mattr) != 0) {
+	/* init streams' lock if needed */
+	if (streams_lock == NULL) {
+		if ((streams_lock = malloc(sizeof(pthread_rwlock_t))) == NULL) {
 			ERROR("Memory allocation failed (%s:%d).", __FILE__, __LINE__);
 			return (EXIT_FAILURE);
 		}
-		if ((streams_mut = malloc(sizeof(pthread_mutex_t))) == NULL) {
-			ERROR("Memory allocation failed (%s:%d).", __FILE__, __LINE__);
-			pthread_mutexattr_destroy(&mattr);
-			return (EXIT_FAILURE);
-		}
-		/*
-		 * mutex MUST be recursive since we use it to cover update
-		 * operation and it internally calls sequence of close and init
-		 */
-		pthread_mutexattr_settype(&mattr, PTHREAD_MUTEX_RECURSIVE);
-		if ((r = pthread_mutex_init(streams_mut, &mattr)) != 0) {
-			ERROR("Mutex initialization failed (%s).", strerror(r));
-			pthread_mutexattr_destroy(&mattr);
+		if ((r = pthread_rwlock_init(streams_lock, NULL)) != 0) {
+			ERROR("Lock initialization failed (%s).", strerror(r));
+			free(streams_lock);
+			streams_lock = NULL;
 			return (EXIT_FAILURE);
 		}
-		pthread_mutexattr_destroy(&mattr);
 	}
 
 	pthread_key_create(&ncntf_replay_ends, ncntf_replay_ends_free);
@@ -934,9 +1512,9 @@ void ncntf_close(void)
 		ncntf_config = NULL;
 
 		ncntf_streams_close();
-		pthread_mutex_destroy(streams_mut);
-		free(streams_mut);
-		streams_mut = NULL;
+		pthread_rwlock_destroy(streams_lock);
+		free(streams_lock);
+		streams_lock = NULL;
 	}
 }
 
@@ -949,24 +1527,22 @@ API int ncntf_stream_new(const char* name, const char* desc, int replay)
 		return (EXIT_FAILURE);
 	}
 
-	DBG_LOCK("stream_mut");
-	pthread_mutex_lock(streams_mut);
+	DBG_LOCK("streams_lock");
+	pthread_rwlock_wrlock(streams_lock);
 
 	/* check the stream name if the requested stream already exists */
-	for (s = streams; s != NULL; s = s->next) {
-		if (strcmp(name, s->name) == 0) {
-			WARN("Requested new stream \'%s\' already exists.", name);
-			DBG_UNLOCK("streams_mut");
-			pthread_mutex_unlock(streams_mut);
-			return (EXIT_FAILURE);
-		}
+	if (ncntf_stream_find(name) != NULL) {
+		WARN("Requested new stream \'%s\' already exists.", name);
+		DBG_UNLOCK("streams_lock");
+		pthread_rwlock_unlock(streams_lock);
+		return (EXIT_FAILURE);
 	}
 
 	s = malloc(sizeof(struct stream));
 	if (s == NULL) {
 		ERROR("Memory allocation failed - %s (%s:%d).", strerror (errno), __FILE__, __LINE__);
-		DBG_UNLOCK("streams_mut");
-		pthread_mutex_unlock(streams_mut);
+		DBG_UNLOCK("streams_lock");
+		pthread_rwlock_unlock(streams_lock);
 		return (EXIT_FAILURE);
 	}
 	s->name = strdup(name);
@@ -976,19 +1552,31 @@ API int ncntf_stream_new(const char* name, const char* desc, int replay)
 	s->locked = 0;
 	s->next = NULL;
 	s->rules = NULL;
+	s->signal.seq = 0;
+	s->signal.waiters = 0;
 	s->fd_events = -1;
 	s->fd_rules = -1;
+	s->fd_index = -1;
+	s->map.addr = NULL;
+	s->map.length = 0;
+	s->map.size = 0;
+	pthread_mutex_init(&(s->write_mut), NULL);
+	pthread_mutex_init(&(s->cache_mut), NULL);
+	pthread_rwlock_init(&(s->rules_lock), NULL);
+	s->rules_set = NULL;
+	s->rules_len = 0;
+	memset(s->cache, 0, sizeof(s->cache));
 	if (write_fileheader(s) != 0 || map_rules(s) != 0) {
 		ncntf_stream_free(s);
-		DBG_UNLOCK("streams_mut");
-		pthread_mutex_unlock(streams_mut);
+		DBG_UNLOCK("streams_lock");
+		pthread_rwlock_unlock(streams_lock);
 		return (EXIT_FAILURE);
 	} else {
 		/* add created stream into the list */
 		s->next = streams;
 		streams = s;
-		DBG_UNLOCK("streams_mut");
-		pthread_mutex_unlock(streams_mut);
+		DBG_UNLOCK("streams_lock");
+		pthread_rwlock_unlock(streams_lock);
 		oldconfig = ncntf_config;
 		ncntf_config = streams_to_xml();
 		xmlFreeDoc(oldconfig);
@@ -1022,6 +1610,10 @@ API int ncntf_stream_allow_events(const char* stream, const char* event)
 	} else {
 		end++;
 	}
+	if ((size_t)(end - s->rules) + strlen(event) + 2 > NCNTF_RULES_SIZE) {
+		ERROR("No space left for the rules of the stream %s.", stream);
+		return (EXIT_FAILURE);
+	}
 	strcpy(end, event);
 	strcpy(end + strlen(event), "\n");
 
@@ -1038,22 +1630,22 @@ API char** ncntf_stream_list(void)
 		return (NULL);
 	}
 
-	DBG_LOCK("stream_mut");
-	pthread_mutex_lock(streams_mut);
+	DBG_LOCK("streams_lock");
+	pthread_rwlock_rdlock(streams_lock);
 
 	for (s = streams, i = 0; s != NULL; s = s->next, i++);
 	list = calloc(i + 1, sizeof(char*));
 	if (list == NULL) {
 		ERROR("Memory allocation failed - %s (%s:%d).", strerror (errno), __FILE__, __LINE__);
-		DBG_UNLOCK("streams_mut");
-		pthread_mutex_unlock(streams_mut);
+		DBG_UNLOCK("streams_lock");
+		pthread_rwlock_unlock(streams_lock);
 		return (NULL);
 	}
 	for (s = streams, i = 0; s != NULL; s = s->next, i++) {
 		list[i] = strdup(s->name);
 	}
-	DBG_UNLOCK("streams_mut");
-	pthread_mutex_unlock(streams_mut);
+	DBG_UNLOCK("streams_lock");
+	pthread_rwlock_unlock(streams_lock);
 
 	return(list);
 }
@@ -1066,35 +1658,23 @@ API int ncntf_stream_isavailable(const char* name)
 		return(0);
 	}
 
-	DBG_LOCK("stream_mut");
-	pthread_mutex_lock(streams_mut);
-	for (s = streams; s != NULL; s = s->next) {
-		if (strcmp(s->name, name) == 0) {
-			/* the specified stream does exist */
-			DBG_UNLOCK("streams_mut");
-			pthread_mutex_unlock(streams_mut);
-			return (1);
-		}
-	}
-	DBG_UNLOCK("streams_mut");
-	pthread_mutex_unlock(streams_mut);
+	DBG_LOCK("streams_lock");
+	pthread_rwlock_rdlock(streams_lock);
+	s = ncntf_stream_find(name);
+	DBG_UNLOCK("streams_lock");
+	pthread_rwlock_unlock(streams_lock);
 
-	return (0); /* the stream does not exist */
+	/* 0 if the stream does not exist */
+	return ((s == NULL) ? 0 : 1);
 }
 
 API int ncntf_stream_info(const char* stream, char** desc, char** start)
 {
 	struct stream *s;
 
-	DBG_LOCK("stream_mut");
-	pthread_mutex_lock(streams_mut);
 	if ((s = ncntf_stream_get(stream)) == NULL) {
-		DBG_UNLOCK("streams_mut");
-		pthread_mutex_unlock(streams_mut);
 		return (EXIT_FAILURE);
 	}
-	DBG_UNLOCK("streams_mut");
-	pthread_mutex_unlock(streams_mut);
 
 	if (desc != NULL) {
 		*desc = strdup(s->desc);
@@ -1131,25 +1711,22 @@ API void ncntf_stream_iter_start(const char* stream)
 	off_list = (struct stream_offset*)pthread_getspecific(ncntf_replay_ends);
 	if (off_list == NULL || (str_off = get_stream_offset_struct(stream, off_list)) == NULL) {
 		/* the list of opened streams is empty */
-		str_off = malloc(sizeof(struct stream_offset));
+		str_off = calloc(1, sizeof(struct stream_offset));
 		str_off->stream = stream;
 		str_off->next = off_list;
 		pthread_setspecific(ncntf_replay_ends, (void*)str_off);
 	}
 
-	DBG_LOCK("stream_mut");
-	pthread_mutex_lock(streams_mut);
 	if ((s = ncntf_stream_get(stream)) == NULL) {
-		DBG_UNLOCK("streams_mut");
-		pthread_mutex_unlock(streams_mut);
 		return;
 	}
 	/* remember the current end of file position */
-	str_off->eof_offset = s->current_offset;
+	str_off->lap = WRITE_POS_LAP(__atomic_load_n(&(s->write_pos), __ATOMIC_ACQUIRE));
+	str_off->eof_offset = __atomic_load_n(&(s->current_offset), __ATOMIC_ACQUIRE);
 	/* and the thread's specific position in the file (start of stream file records section) */
 	str_off->cur_offset = s->data;
-	DBG_UNLOCK("streams_mut");
-	pthread_mutex_unlock(streams_mut);
+	/* replay start time is known when reading the events */
+	str_off->replay_seek = 1;
 }
 
 API void ncntf_stream_iter_finish(const char* stream)
@@ -1161,23 +1738,45 @@ API void ncntf_stream_iter_finish(const char* stream)
 	if (str_off) {
 		str_off->eof_offset = 0;
 		str_off->cur_offset = 0;
+		str_off->replay_seek = 0;
 	}
 }
 
 /*
- * Pop the next event record from the stream file.
- *
+ * The stream writer has overwritten the records the thread was going to
+ * read, continue from the beginning of the records.
  */
-API char* ncntf_stream_iter_next(const char* stream, time_t start, time_t stop, time_t *event_time)
+static void ncntf_stream_iter_restart(struct stream *s, struct stream_offset *str_off)
+{
+	WARN("Some events in the stream %s were overwritten before reading them.", s->name);
+	str_off->lap = WRITE_POS_LAP(__atomic_load_n(&(s->write_pos), __ATOMIC_ACQUIRE));
+	str_off->cur_offset = s->data;
+}
+
+void ncntf_dispatch_wakeup(struct nc_session *session)
+{
+	/* caller holds mut_ntf */
+	if (session->ntf_signal != NULL) {
+		ncntf_signal_wake(session->ntf_signal);
+	}
+}
+
+/*
+ * Pop the next event record from the stream file, the caller gets its own
+ * reference to the event.
+ */
+static struct ncntf_event* ncntf_stream_iter_event(const char* stream, time_t start, time_t stop)
 {
 	struct stream *s;
 	int32_t len;
 	uint64_t t;
 	char* text = NULL;
+	struct ncntf_event *ev = NULL;
+	const char* data;
 	off_t* replay_end;
 	char* time_s;
 	time_t tnow;
-	int r;
+	unsigned int lap;
 	struct stream_offset *str_off, *off_list;
 
 	if (ncntf_config == NULL) {
@@ -1189,11 +1788,7 @@ API char* ncntf_stream_iter_next(const char* stream, time_t start, time_t stop,
 		return (NULL);
 	}
 
-	DBG_LOCK("stream_mut");
-	pthread_mutex_lock(streams_mut);
 	if ((s = ncntf_stream_get(stream)) == NULL) {
-		DBG_UNLOCK("streams_mut");
-		pthread_mutex_unlock(streams_mut);
 		return (NULL);
 	}
 
@@ -1202,11 +1797,10 @@ API char* ncntf_stream_iter_next(const char* stream, time_t start, time_t stop,
 	str_off = get_stream_offset_struct(stream, off_list);
 	if (str_off == NULL) {
 		ncntf_stream_iter_start(stream);
+		off_list = (struct stream_offset*)pthread_getspecific(ncntf_replay_ends);
 		str_off = get_stream_offset_struct(stream, off_list);
 		if (str_off == NULL) {
 			ERROR("Unable to start iteration on stream \"%s\".", stream);
-			DBG_UNLOCK("streams_mut");
-			pthread_mutex_unlock(streams_mut);
 			return (NULL);
 		}
 	}
@@ -1222,6 +1816,24 @@ API char* ncntf_stream_iter_next(const char* stream, time_t start, time_t stop,
 		*replay_end = 0;
 	}
 
+	if (str_off->replay_seek) {
+		if ((start != -1) && (s->replay == 1) && (*replay_end != 0)) {
+			/* skip the events older than the start time using the stream index */
+			lap = str_off->lap;
+			str_off->cur_offset = ncntf_index_seek(s, start, *replay_end);
+			if (lap != WRITE_POS_LAP(__atomic_load_n(&(s->write_pos), __ATOMIC_ACQUIRE))) {
+				/* index could have been rewritten meanwhile */
+				str_off->cur_offset = s->data;
+			}
+		}
+		str_off->replay_seek = 0;
+	}
+
+	/*
+	 * no lock is needed, records before the current_offset are not
+	 * modified and records from the previous lap are checked after
+	 * reading them
+	 */
 	while (1) {
 		/* condition to read events from file (use replay):
 		 * 1) startTime is specified
@@ -1233,9 +1845,6 @@ API char* ncntf_stream_iter_next(const char* stream, time_t start, time_t stop,
 			if (str_off->cur_offset >= *replay_end) {
 				/* we are getting out of replay */
 
-				DBG_UNLOCK("streams_mut");
-				pthread_mutex_unlock(streams_mut);
-
 				/* send replayComplete notification */
 				if (asprintf(&text, "<notification xmlns=\"urn:ietf:params:xml:ns:netconf:notification:1.0\">"
 							"<eventTime>%s</eventTime><replayComplete xmlns=\"urn:ietf:params:xml:ns:netmod:notification\"/></notification>", time_s = nc_time2datetime(tnow = time(NULL), NULL)) == -1) {
@@ -1244,109 +1853,120 @@ API char* ncntf_stream_iter_next(const char* stream, time_t start, time_t stop,
 					text = NULL;
 				}
 				free(time_s);
-				if (event_time != NULL) {
-					*event_time = tnow;
-				}
 				*replay_end = 0;
-				return (text);
+				if (text == NULL) {
+					return (NULL);
+				}
+				ev = ncntf_event_create(text, strlen(text) + 1, tnow);
+				free(text);
+				return (ev);
 			} else {
 				/* reading data from the stream file as replay */
 			}
 		}
 
 		/* check that we have something to read */
-		if (str_off->cur_offset == s->current_offset) {
+		lap = WRITE_POS_LAP(__atomic_load_n(&(s->write_pos), __ATOMIC_ACQUIRE));
+		if (str_off->lap == lap && str_off->cur_offset == __atomic_load_n(&(s->current_offset), __ATOMIC_ACQUIRE)) {
 			/* nothing to read */
-			DBG_UNLOCK("streams_mut");
-			pthread_mutex_unlock(streams_mut);
 			return(NULL);
+		} else if (str_off->lap + 1 < lap) {
+			/* the writer is more than one lap ahead, all the records are lost */
+			ncntf_stream_iter_restart(s, str_off);
+			continue;
 		}
-		/* move file offset to the read position */
-		lseek(s->fd_events, str_off->cur_offset, SEEK_SET);
 
-		if (ncntf_stream_lock(s) == 0) {
-			int ret = ncntf_check_file_ended(s);
-			if (ret == 1) {
-				str_off->cur_offset = s->data;
-				ncntf_stream_unlock(s);
+		/* the record could have been already read by another reader */
+		if ((ev = ncntf_event_cache_get(s, str_off->lap, str_off->cur_offset)) != NULL) {
+			str_off->cur_offset += sizeof(int32_t) + sizeof(uint64_t) + ev->len;
+			if (((start != -1) && (start > (time_t)ev->time)) || ((stop != -1) && (stop < (time_t)ev->time))) {
+				ncntf_event_release(ev);
+				ev = NULL;
 				continue;
 			}
-			else if(ret == -1) {
-				DBG_UNLOCK("streams_mut");
-				pthread_mutex_unlock(streams_mut);
-				return(NULL);
-			} else {
-				//not need to switch, continue reading
-			}
-			if ((r = read(s->fd_events, &len, sizeof(int32_t))) <= 0) {
-				ERROR("Reading the stream file failed (%s).", (r < 0) ? strerror(errno) : "Unexpected end of file");
-				DBG_UNLOCK("streams_mut");
-				ncntf_stream_iter_finish(stream);
-				pthread_mutex_unlock(streams_mut);
-				return (NULL);
-			}
-			str_off->cur_offset += r;
-			if ((r = read(s->fd_events, &t, sizeof(uint64_t))) <= 0) {
-				ERROR("Reading the stream file failed (%s).", (r < 0) ? strerror(errno) : "Unexpected end of file");
-				DBG_UNLOCK("streams_mut");
-				ncntf_stream_iter_finish(stream);
-				pthread_mutex_unlock(streams_mut);
-				return (NULL);
-			}
-			str_off->cur_offset += r;
-			str_off->cur_offset += len;
+			break;
+		}
 
-			/* check boundaries */
-			if ((start != -1) && (start > (time_t)t)) {
-				/*
-				 * we're not interested in this event, it
-				 * happened before specified start time
-				 */
-				/* read another event */
-				ncntf_stream_unlock(s);
+		if ((data = ncntf_stream_record(s, &(str_off->map), str_off->cur_offset, &len, &t)) == NULL) {
+			if (!ncntf_stream_record_valid(s, str_off->lap, str_off->cur_offset)) {
+				ncntf_stream_iter_restart(s, str_off);
 				continue;
 			}
-			if ((stop != -1) && (stop < (time_t)t)) {
-				/*
-				 * we're not interested in this event, it
-				 * happened after specified stop time
-				 */
-				/* read another event */
-				ncntf_stream_unlock(s);
+			ERROR("Reading the stream file %s failed.", s->name);
+			ncntf_stream_iter_finish(stream);
+			return (NULL);
+		}
+		if (len == (int32_t)MAGIC_MARKER_SIZE && memcmp(data, &MAGIC_EOF_MARKER, MAGIC_MARKER_SIZE) == 0) {
+			if (!ncntf_stream_record_valid(s, str_off->lap, str_off->cur_offset)) {
+				ncntf_stream_iter_restart(s, str_off);
 				continue;
+			} else if (str_off->lap == lap) {
+				/* the writer has not started the new lap yet */
+				return (NULL);
 			}
+			/* the stream file is full, continue from its beginning */
+			str_off->cur_offset = s->data;
+			str_off->lap++;
+			continue;
+		}
 
+		if (((start != -1) && (start > (time_t)t)) || ((stop != -1) && (stop < (time_t)t))) {
+			/*
+			 * we're not interested in this event, it happened
+			 * before specified start time or after specified stop
+			 * time
+			 */
+			ev = NULL;
+		} else {
 			/* we're interested, read content */
-			text = malloc(len * sizeof(char));
-			if ((r = read(s->fd_events, text, len)) <= 0) {
-				ERROR("Reading the stream file failed (%s).", (r < 0) ? strerror(errno) : "Unexpected end of file");
-				DBG_UNLOCK("streams_mut");
+			if ((ev = ncntf_event_create(data, len, t)) == NULL) {
 				ncntf_stream_iter_finish(stream);
-				pthread_mutex_unlock(streams_mut);
-				free(text);
 				return (NULL);
 			}
-			ncntf_stream_unlock(s);
+			ev->lap = str_off->lap;
+			ev->offset = str_off->cur_offset;
+		}
+
+		if (!ncntf_stream_record_valid(s, str_off->lap, str_off->cur_offset)) {
+			ncntf_event_release(ev);
+			ev = NULL;
+			ncntf_stream_iter_restart(s, str_off);
+			continue;
+		}
+		str_off->cur_offset += sizeof(int32_t) + sizeof(uint64_t) + len;
+
+		if (ev != NULL) {
+			/* share the event with other readers */
+			ev = ncntf_event_cache_add(s, ev);
 			break; /* end the reading loop */
-		} else {
-			ERROR("Unable to read an event from the stream file %s (locking failed).", s->name);
-			DBG_UNLOCK("streams_mut");
-			ncntf_stream_iter_finish(stream);
-			pthread_mutex_unlock(streams_mut);
-			return (NULL);
 		}
+		/* read another event */
 	}
 
-	DBG_UNLOCK("streams_mut");
-	pthread_mutex_unlock(streams_mut);
+	return (ev);
+}
 
-	if (event_time != NULL) {
-		*event_time = (time_t)t;
+API char* ncntf_stream_iter_next(const char* stream, time_t start, time_t stop, time_t *event_time)
+{
+	struct ncntf_event *ev;
+	char* text;
+
+	if ((ev = ncntf_stream_iter_event(stream, start, stop)) == NULL) {
+		return (NULL);
 	}
+
+	if ((text = strdup(ev->text)) == NULL) {
+		ERROR("Memory allocation failed - %s (%s:%d).", strerror (errno), __FILE__, __LINE__);
+	} else if (event_time != NULL) {
+		*event_time = (time_t)ev->time;
+	}
+	ncntf_event_release(ev);
+
 	return (text);
 }
 
 
+
 static void ncntf_event_stdoutprint (time_t eventtime, const char* content)
 {
 	char* t = NULL;
@@ -1357,21 +1977,69 @@ static void ncntf_event_stdoutprint (time_t eventtime, const char* content)
 	}
 }
 
+/*
+ * Add the rules appended to the rules file (by any process) since the last
+ * update into the stream's set of allowed events. The caller is supposed to
+ * hold the rules_lock for writing.
+ */
+static void ncntf_stream_rules_update(struct stream* s)
+{
+	char *rule, *end, *name;
+
+	if (s->rules_set == NULL && (s->rules_set = xmlHashCreate(16)) == NULL) {
+		ERROR("Creating the set of the stream %s rules failed.", s->name);
+		return;
+	}
+
+	/* rules are only appended, process only the complete lines */
+	for (rule = s->rules + s->rules_len; (end = strchr(rule, '\n')) != NULL; rule = end + 1) {
+		if (end != rule && (name = strndup(rule, end - rule)) != NULL) {
+			/* the rules file is shared, so do not modify it in place */
+			xmlHashAddEntry(s->rules_set, BAD_CAST name, s);
+			free(name);
+		}
+		s->rules_len = (end + 1) - s->rules;
+	}
+}
+
+/*
+ * Check if the event is allowed to be stored into the stream.
+ */
+static int ncntf_stream_isallowed(struct stream* s, const char* event)
+{
+	int ret;
+
+	if (strcmp(s->name, NCNTF_STREAM_DEFAULT) == 0) {
+		/*
+		 * The default stream contains all NETCONF XML event notifications
+		 * supported by the NETCONF server.
+		 */
+		return (1);
+	}
+
+	pthread_rwlock_rdlock(&(s->rules_lock));
+	if (s->rules_set == NULL || s->rules[s->rules_len] != '\0') {
+		/* there are some new rules */
+		pthread_rwlock_unlock(&(s->rules_lock));
+		pthread_rwlock_wrlock(&(s->rules_lock));
+		ncntf_stream_rules_update(s);
+	}
+	ret = (s->rules_set != NULL && xmlHashLookup(s->rules_set, BAD_CAST event) != NULL) ? 1 : 0;
+	pthread_rwlock_unlock(&(s->rules_lock));
+
+	return (ret);
+}
+
 static int ncntf_event_isallowed(const char* stream, const char* event)
 {
 	struct stream* s;
-	char* token;
-	char* rules;
 
 	if (stream == NULL || event == NULL) {
 		return (0);
 	}
 
 	if (strcmp(stream, NCNTF_STREAM_DEFAULT) == 0) {
-		/*
-		 * The default stream contains all NETCONF XML event notifications
-		 * supported by the NETCONF server.
-		 */
+		/* shortcut for the default stream */
 		return (1);
 	}
 
@@ -1380,30 +2048,71 @@ static int ncntf_event_isallowed(const char* stream, const char* event)
 		return (0);
 	}
 
-	rules = strdup(s->rules);
-	for (token = strtok(rules, "\n"); token != NULL; token = strtok(NULL, "\n")) {
-		if (strcmp(event, token) == 0) {
-			free(rules);
-			return(1);
-		}
+	return (ncntf_stream_isallowed(s, event));
+}
+
+/*
+ * SAX callback remembering the (local) name of the root element.
+ */
+static void ncntf_event_name_start(void *ctx, const xmlChar *localname, const xmlChar *UNUSED(prefix), const xmlChar *UNUSED(URI),
+		int UNUSED(nb_namespaces), const xmlChar **UNUSED(namespaces), int UNUSED(nb_attributes), int UNUSED(nb_defaulted),
+		const xmlChar **UNUSED(attributes))
+{
+	char **name = (char **) ctx;
+
+	if (*name == NULL) {
+		*name = strdup((const char*) localname);
 	}
-	free(rules);
+}
 
-	/* specified event is not allowed in the stream */
-	return (0);
+/*
+ * Get the (local) name of the event's root element and check that the event
+ * content is a well-formed XML. The content is only scanned by the SAX parser,
+ * no document is built.
+ */
+static char* ncntf_event_name(const char* content)
+{
+	xmlSAXHandler sax;
+	xmlParserCtxtPtr ctxt;
+	char *name = NULL;
+	int wellformed;
+
+	memset(&sax, 0, sizeof(xmlSAXHandler));
+	sax.initialized = XML_SAX2_MAGIC;
+	sax.startElementNs = ncntf_event_name_start;
+	if ((ctxt = xmlCreatePushParserCtxt(&sax, &name, NULL, 0, NULL)) == NULL) {
+		ERROR("Unable to create the XML parser context (%s:%d).", __FILE__, __LINE__);
+		return (NULL);
+	}
+	xmlCtxtUseOptions(ctxt, NC_XMLREAD_OPTIONS);
+	wellformed = (xmlParseChunk(ctxt, content, (int) strlen(content), 1) == 0 && ctxt->wellFormed);
+	xmlFreeParserCtxt(ctxt);
+
+	if (!wellformed) {
+		free(name);
+		return (NULL);
+	}
+	return (name);
 }
 
-static int ncntf_event_store(time_t etime, const char* content)
+/*
+ * Store the event into all the streams allowing it. The event name is the
+ * name of the content's root element, if not known by the caller (NULL), it
+ * is read from the content.
+ */
+static int ncntf_event_store(time_t etime, const char* event, const char* content)
 {
 	int ret = EXIT_SUCCESS;
-	char *event_time = NULL, *aux1 = NULL;
+	char *event_time = NULL;
 	char *record = NULL, *ename = NULL;
+	const char *name;
 	struct stream* s;
 	uint64_t etime64;
-	xmlDocPtr edoc;
 	int32_t len;
 	ssize_t r;
 	off_t offset;
+	size_t size;
+	unsigned int lap;
 
 	if (content == NULL) {
 		return (EXIT_FAILURE);
@@ -1426,18 +2135,14 @@ static int ncntf_event_store(time_t etime, const char* content)
 	etime64 = (uint64_t)etime;
 
 	/* get event name string for filter on streams */
-	if ((edoc = xmlReadMemory(content, strlen(content), NULL, NULL, NC_XMLREAD_OPTIONS)) == NULL) {
-		ERROR("xmlReadMemory failed (%s:%d)", __FILE__, __LINE__);
-		ret = EXIT_FAILURE;
-		goto cleanup;
-	}
-	if ((aux1 = (char*)((xmlDocGetRootElement(edoc))->name)) == NULL) {
-		ERROR("xmlDocGetRootElement failed (%s:%d)", __FILE__, __LINE__);
-		ret = EXIT_FAILURE;
-		goto cleanup;
+	if ((name = event) == NULL) {
+		if ((ename = ncntf_event_name(content)) == NULL) {
+			ERROR("Invalid event content, it is not a well-formed XML (%s:%d)", __FILE__, __LINE__);
+			ret = EXIT_FAILURE;
+			goto cleanup;
+		}
+		name = ename;
 	}
-	ename = strdup(aux1);
-	xmlFreeDoc(edoc);
 
 	/* complete the event text */
 	len = (int32_t) asprintf(&record, "<?xml version=\"1.0\" encoding=\"UTF-8\"?>"
@@ -1454,20 +2159,23 @@ static int ncntf_event_store(time_t etime, const char* content)
 	len++; /* include termination null byte */
 
 	/* write the event into the stream file(s) */
-	DBG_LOCK("stream_mut");
-	pthread_mutex_lock(streams_mut);
+	DBG_LOCK("streams_lock");
+	pthread_rwlock_rdlock(streams_lock);
 	for (s = streams; s != NULL; s = s->next) {
 		if (s->replay == 0) {
 			continue;
 		}
 
-		if (ncntf_event_isallowed(s->name, ename) != 0) {
-			/* log the event to the stream file */
+		if (ncntf_stream_isallowed(s, name) != 0) {
+			/* log the event to the stream file, readers are not blocked */
+			pthread_mutex_lock(&(s->write_mut));
 			if (ncntf_stream_lock(s) == 0) {
 				offset = s->current_offset;
+				lap = WRITE_POS_LAP(s->write_pos);
+				size = len + sizeof(int32_t) + sizeof(uint64_t);
 				lseek(s->fd_events, offset, SEEK_SET);
 
-				if ((NCNTF_STREAMS_MAX_SIZE != 0) && ((offset + MAGIC_MARKER_SIZE + len + sizeof(int32_t) + sizeof(uint64_t)) >= NCNTF_STREAMS_MAX_SIZE)) {
+				if ((NCNTF_STREAMS_MAX_SIZE != 0) && ((offset + MAGIC_MARKER_SIZE + size) >= NCNTF_STREAMS_MAX_SIZE)) {
 					VERB("EOF found, starting from the begining");
 					if ((r = ncntf_write_end_marker(s, etime64, MAGIC_EOF_MARKER)) == -1) {
 						goto write_failed;
@@ -1475,42 +2183,54 @@ static int ncntf_event_store(time_t etime, const char* content)
 
 					offset = s->data;
 					lseek(s->fd_events, offset, SEEK_SET);
+
+					/* start a new lap, the old records are going to be overwritten */
+					__atomic_store_n(&(s->current_offset), offset, __ATOMIC_RELAXED);
+					lap++;
+					ncntf_index_reset(s);
 				}
+				/* announce the part of the file being overwritten before writing */
+				__atomic_store_n(&(s->write_pos), WRITE_POS(lap, offset + size + (2 * MAGIC_MARKER_SIZE) + sizeof(uint64_t)), __ATOMIC_RELEASE);
+				__atomic_thread_fence(__ATOMIC_SEQ_CST);
 
 				while (((r = write(s->fd_events, &len, sizeof(int32_t))) == -1) && (errno == EAGAIN ||errno == EINTR));
 				if (r == -1) {
-                    goto write_failed;
+					goto write_failed;
 				}
 				while (((r = write(s->fd_events, &etime64, sizeof(uint64_t))) == -1) && (errno == EAGAIN ||errno == EINTR));
 				if (r == -1) {
-                    goto write_failed;
+					goto write_failed;
 				}
 				while (((r = write(s->fd_events, record, len)) == -1) && (errno == EAGAIN ||errno == EINTR));
 				if (r == -1) {
-                    goto write_failed;
+					goto write_failed;
 				}
 				if ((r = ncntf_write_end_marker(s, etime64, MAGIC_END_MARKER)) == -1) {
 					goto write_failed;
 				}
-				s->current_offset = (offset + len + sizeof(int32_t) + sizeof(uint64_t)); // do not include END MARKER
+				/* publish the record to the readers */
+				__atomic_store_n(&(s->current_offset), offset + size, __ATOMIC_RELEASE); // do not include END MARKER
+				ncntf_signal_wake(&(s->signal));
+				ncntf_index_update(s, offset);
 
 write_failed:
 				if (r == -1) {
 					WARN("Writing an event into the stream file failed (%s).", strerror(errno));
-					/* revert changes */
-					if (ftruncate(s->fd_events, offset) == -1) {
+					/* revert changes, but keep the records from the previous lap */
+					if ((NCNTF_STREAMS_MAX_SIZE == 0) && (ftruncate(s->fd_events, offset) == -1)) {
 						ERROR("ftruncate() on the stream file \'%s\' failed (%s).", s->name, strerror(errno));
 					}
 				}
 				lseek(s->fd_events, offset, SEEK_SET);
 				ncntf_stream_unlock(s);
 			} else {
-				WARN("Unable to write the event %s into the stream file %s (locking failed).", ename, s->name);
+				WARN("Unable to write the event %s into the stream file %s (locking failed).", name, s->name);
 			}
+			pthread_mutex_unlock(&(s->write_mut));
 		}
 	}
-	DBG_UNLOCK("streams_mut");
-	pthread_mutex_unlock(streams_mut);
+	DBG_UNLOCK("streams_lock");
+	pthread_rwlock_unlock(streams_lock);
 
 cleanup:
 	/* final cleanup */
@@ -1570,6 +2290,7 @@ static int _event_new(time_t etime, NCNTF_EVENT event, va_list params)
 {
 	char *content = NULL;
 	char *aux1 = NULL, *aux2 = NULL, *newstr;
+	const char *ename = NULL;
 	NC_DATASTORE ds;
 	NCNTF_EVENT_BY by;
 	const struct nc_cpblts *old, *new;
@@ -1650,6 +2371,7 @@ static int _event_new(time_t etime, NCNTF_EVENT event, va_list params)
 			return (EXIT_FAILURE);
 		}
 		free(aux2);
+		ename = "netconf-config-change";
 
 		break;
 	case NCNTF_BASE_CPBLT_CHANGE:
@@ -1822,6 +2544,7 @@ static int _event_new(time_t etime, NCNTF_EVENT event, va_list params)
 		}
 		free(aux1);
 		free(aux2);
+		ename = "netconf-capability-change";
 		break;
 	case NCNTF_BASE_SESSION_START:
 		session = va_arg(params, const struct nc_session*);
@@ -1839,6 +2562,7 @@ static int _event_new(time_t etime, NCNTF_EVENT event, va_list params)
 			ERROR("asprintf() failed (%s:%d).", __FILE__, __LINE__);
 			return (EXIT_FAILURE);
 		}
+		ename = "netconf-session-start";
 
 		break;
 	case NCNTF_BASE_SESSION_END:
@@ -1886,6 +2610,7 @@ static int _event_new(time_t etime, NCNTF_EVENT event, va_list params)
 		}
 		free(aux2);
 		free(aux1);
+		ename = "netconf-session-end";
 
 		break;
 	default:
@@ -1894,7 +2619,7 @@ static int _event_new(time_t etime, NCNTF_EVENT event, va_list params)
 		break;
 	}
 
-	ret = ncntf_event_store(etime, content);
+	ret = ncntf_event_store(etime, ename, content);
 	free(content);
 	return (ret);
 }
@@ -1929,7 +2654,8 @@ API int ncxmlntf_event_new(time_t etime, NCNTF_EVENT event, ...)
 			va_end(argp);
 			return (EXIT_FAILURE);
 		}
-		retval = ncntf_event_store(etime, content);
+		/* the event name is known from the data */
+		retval = ncntf_event_store(etime, (data->type == XML_ELEMENT_NODE) ? (const char*)data->name : NULL, content);
 		free(content);
 	} else {
 		retval = _event_new(etime, event, argp);
@@ -2398,11 +3124,7 @@ API nc_reply* ncntf_subscription_check(const nc_rpc* subscribe_rpc)
 	}
 
 	/* check existence of the stream */
-	DBG_LOCK("stream_mut");
-	pthread_mutex_lock(streams_mut);
 	if ((s = ncntf_stream_get(stream)) == NULL) {
-		DBG_UNLOCK("streams_mut");
-		pthread_mutex_unlock(streams_mut);
 		e = nc_err_new(NC_ERR_INVALID_VALUE);
 		if (asprintf(&auxs, "Requested stream \'%s\' does not exist.", stream) == -1) {
 			auxs = strdup("Requested stream does not exist");
@@ -2411,8 +3133,6 @@ API nc_reply* ncntf_subscription_check(const nc_rpc* subscribe_rpc)
 		free(auxs);
 		goto cleanup;
 	}
-	DBG_UNLOCK("streams_mut");
-	pthread_mutex_unlock(streams_mut);
 
 	/* check start and stop times */
 	if ((stop != -1) && (start == -1)) {
@@ -2472,9 +3192,14 @@ API long long int ncntf_dispatch_send(struct nc_session* session, const nc_rpc*
 	long long int count = 0;
 	char* stream = NULL, *event = NULL, *time_s = NULL;
 	struct nc_filter *filter = NULL;
-	time_t start, stop;
+	struct stream *s;
+	struct ncntf_event *ev;
+	uint32_t seq;
+	time_t start, stop, now;
 	xmlDocPtr event_doc, filter_doc;
 	xmlNodePtr event_node, aux_node, nodelist = NULL;
+	xmlBufferPtr data;
+	int ret;
 	nc_ntf* ntf;
 	nc_reply *reply;
 
@@ -2500,6 +3225,10 @@ API long long int ncntf_dispatch_send(struct nc_session* session, const nc_rpc*
 		ERROR("Parsing create-subscription for parameters failed.");
 		return (-1);
 	}
+	if (filter != NULL && filter->type == NC_FILTER_SUBTREE) {
+		/* compile the filter once for all the events */
+		ncxml_filter_compile(filter);
+	}
 
 	/* check if there is another notification subscription */
 	DBG_LOCK("mut_ntf");
@@ -2524,8 +3253,19 @@ API long long int ncntf_dispatch_send(struct nc_session* session, const nc_rpc*
 	filter_doc = xmlNewDoc(BAD_CAST "1.0");
 	filter_doc->encoding = xmlStrdup(BAD_CAST UTF8);
 
+	/* the subscription check guarantees that the stream exists */
+	s = ncntf_stream_get(stream);
+	DBG_LOCK("mut_ntf");
+	pthread_mutex_lock(&(session->mut_ntf));
+	session->ntf_signal = &(s->signal);
+	DBG_UNLOCK("mut_ntf");
+	pthread_mutex_unlock(&(session->mut_ntf));
+
 	ncntf_stream_iter_start(stream);
 	while(ncntf_config != NULL) {
+		/* get the signal state before checking for new events to not miss a wake up */
+		seq = __atomic_load_n(&(s->signal.seq), __ATOMIC_ACQUIRE);
+
 		DBG_LOCK("mut_ntf");
 		pthread_mutex_lock(&(session->mut_ntf));
 		if (session->ntf_stop) {
@@ -2536,18 +3276,26 @@ API long long int ncntf_dispatch_send(struct nc_session* session, const nc_rpc*
 		DBG_UNLOCK("mut_ntf");
 		pthread_mutex_unlock(&(session->mut_ntf));
 
-		if ((event = ncntf_stream_iter_next(stream, start, stop, NULL)) == NULL) {
-			if ((stop == -1) || ((stop != -1) && (stop > time(NULL)))) {
-				usleep(NCNTF_DISPATCH_SLEEP);
+		if ((ev = ncntf_stream_iter_event(stream, start, stop)) == NULL) {
+			if ((stop == -1) || ((stop != -1) && (stop > (now = time(NULL))))) {
+				/* wait for a new event, but not after the stop time */
+				ncntf_signal_wait(&(s->signal), seq, ((stop == -1) || (stop - now) * 1000 > NCNTF_DISPATCH_TIMEOUT) ? NCNTF_DISPATCH_TIMEOUT : (stop - now) * 1000);
 				continue;
 			} else {
 				DBG("stream iter end: stop=%ld, time=%ld", stop, time(NULL));
 				break;
 			}
 		}
-		if ((event_doc = xmlReadMemory(event, strlen(event), NULL, NULL, NC_XMLREAD_OPTIONS)) != NULL) {
+		/* the event is parsed only once for all the subscribers */
+		if ((event_doc = ncntf_event_doc(ev)) != NULL) {
 			/* apply filter */
 			if (filter != NULL) {
+				/* the parsed event is shared, filter a private copy */
+				if ((event_doc = xmlCopyDoc(event_doc, 1)) == NULL) {
+					ERROR("Copying an event failed (%s:%d).", __FILE__, __LINE__);
+					ncntf_event_release(ev);
+					continue;
+				}
 
 				/* filter all content nodes in notification */
 				event_node = event_doc->children->children; /* doc -> <notification> -> <something> */
@@ -2568,7 +3316,7 @@ API long long int ncntf_dispatch_send(struct nc_session* session, const nc_rpc*
 					/* do not filter replayComplete notification */
 					if (xmlStrcmp(event_node->name, BAD_CAST "replayComplete")) {
 						/* filter the data */
-						if (ncxml_filter(event_node, filter, &aux_node, NULL) != 0) {
+						if (ncxml_filter(event_node, filter, &aux_node, NULL, NULL) != 0) {
 							ERROR("Filter failed.");
 							aux_node = xmlCopyNode(event_node, 1);
 						}
@@ -2593,7 +3341,7 @@ API long long int ncntf_dispatch_send(struct nc_session* session, const nc_rpc*
 				} else {
 					/* nothing to send */
 					xmlFreeDoc(event_doc);
-					free(event);
+					ncntf_event_release(ev);
 					continue;
 				}
 			}
@@ -2604,9 +3352,14 @@ API long long int ncntf_dispatch_send(struct nc_session* session, const nc_rpc*
 				DBG_LOCK("mut_ntf");
 				pthread_mutex_lock(&(session->mut_ntf));
 				session->ntf_active = 0;
+				session->ntf_signal = NULL;
 				ncntf_dispatch = 0;
 				DBG_UNLOCK("mut_ntf");
 				pthread_mutex_unlock(&(session->mut_ntf));
+				if (filter != NULL) {
+					xmlFreeDoc(event_doc);
+				}
+				ncntf_event_release(ev);
 				nc_filter_free(filter);
 				free(stream);
 				return (-1);
@@ -2625,12 +3378,17 @@ API long long int ncntf_dispatch_send(struct nc_session* session, const nc_rpc*
 				DBG_LOCK("mut_ntf");
 				pthread_mutex_lock(&(session->mut_ntf));
 				session->ntf_active = 0;
+				session->ntf_signal = NULL;
 				ncntf_dispatch = 0;
 				DBG_UNLOCK("mut_ntf");
 				pthread_mutex_unlock(&(session->mut_ntf));
 				nc_filter_free(filter);
 				free(stream);
+				if (filter == NULL) {
+					ntf->doc = NULL;
+				}
 				ncntf_notif_free(ntf);
+				ncntf_event_release(ev);
 				return (-1);
 			}
 
@@ -2640,12 +3398,17 @@ API long long int ncntf_dispatch_send(struct nc_session* session, const nc_rpc*
 				DBG_LOCK("mut_ntf");
 				pthread_mutex_lock(&(session->mut_ntf));
 				session->ntf_active = 0;
+				session->ntf_signal = NULL;
 				ncntf_dispatch = 0;
 				DBG_UNLOCK("mut_ntf");
 				pthread_mutex_unlock(&(session->mut_ntf));
 				nc_filter_free(filter);
 				free(stream);
+				if (filter == NULL) {
+					ntf->doc = NULL;
+				}
 				ncntf_notif_free(ntf);
+				ncntf_event_release(ev);
 				return (-1);
 			}
 
@@ -2658,14 +3421,25 @@ API long long int ncntf_dispatch_send(struct nc_session* session, const nc_rpc*
 				if (!session->ntf_stop) {
 					DBG_UNLOCK("mut_ntf");
 					pthread_mutex_unlock(&(session->mut_ntf));
-					if (nc_session_send_notif(session, ntf) != EXIT_SUCCESS) {
+					if (filter == NULL && (data = ncntf_event_data(ev)) != NULL) {
+						/* send the event serialized only once for all the subscribers */
+						ret = nc_session_send_notif_text(session, (const char*)xmlBufferContent(data), xmlBufferLength(data));
+					} else {
+						ret = nc_session_send_notif(session, ntf);
+					}
+					if (ret != EXIT_SUCCESS) {
 						ERROR("Sending a notification failed.");
 						/* cleanup */
 						session->ntf_active = 0;
+						session->ntf_signal = NULL;
 						ncntf_dispatch = 0;
 						nc_filter_free(filter);
 						free(stream);
+						if (filter == NULL) {
+							ntf->doc = NULL;
+						}
 						ncntf_notif_free(ntf);
+						ncntf_event_release(ev);
 
 						DBG_UNLOCK("mut_session");
 						pthread_mutex_unlock(&(session->mut_session));
@@ -2686,11 +3460,15 @@ API long long int ncntf_dispatch_send(struct nc_session* session, const nc_rpc*
 				}
 			}
 
+			if (filter == NULL) {
+				/* the document belongs to the shared event */
+				ntf->doc = NULL;
+			}
 			ncntf_notif_free(ntf);
 		} else {
 			WARN("Invalid format of a stored event, skipping.");
 		}
-		free(event);
+		ncntf_event_release(ev);
 	}
 	xmlFreeDoc(filter_doc);
 	ncntf_stream_iter_finish(stream);
@@ -2702,6 +3480,7 @@ API long long int ncntf_dispatch_send(struct nc_session* session, const nc_rpc*
 	DBG_LOCK("mut_ntf");
 	pthread_mutex_lock(&(session->mut_ntf));
 	session->ntf_active = 0;
+	session->ntf_signal = NULL;
 	if (!session->ntf_stop) {
 		/* if not finished by external stop, send notificationComplete Notification */
 		ntf = calloc(1, sizeof(nc_rpc));
@@ -47,6 +47,8 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <sys/mman.h>
+#include <sys/epoll.h>
+#include <sys/uio.h>
 #include <dirent.h>
 #include <fcntl.h>
 #include <errno.h>
@@ -54,6 +56,7 @@
 #include <pthread.h>
 #include <pwd.h>
 #include <ctype.h>
+#include <time.h>
 
 #ifndef DISABLE_LIBSSH
 #	include <libssh/libssh.h>
@@ -140,54 +143,6 @@ struct session_list_map {
 static int session_list_fd = -1;
 static struct session_list_map *session_list = NULL;
 
-#ifdef DISABLE_LIBSSH
-#ifdef ENABLE_TLS
-#define NC_WRITE(session,buf,c,ret) \
-	if (session->fd_output != -1) {ret = write (session->fd_output, (buf), strlen(buf)); \
-		if (ret > 0) {c += ret;} \
-	} else if (session->tls){ \
-		ret = SSL_write(session->tls, (buf), strlen(buf)); \
-		if (ret > 0) {c += ret;} \
-	} else { \
-		ret = -1; \
-	}
-#else /* not ENABLE_TLS (but DISABLE_LIBSSH) */
-#define NC_WRITE(session,buf,c,ret) \
-	if (session->fd_output != -1) {ret = write (session->fd_output, (buf), strlen(buf)); \
-		if (ret > 0) {c += ret;} \
-	} else { \
-		ret = -1; \
-	}
-#endif /* not ENABLE_TLS */
-#else /* not DISABLE_LIBSSH */
-#ifdef ENABLE_TLS
-#define NC_WRITE(session,buf,c,ret) \
-	if(session->ssh_chan){ \
-		ret = ssh_channel_write (session->ssh_chan, (buf), strlen(buf)); \
-		if (ret > 0) {c += ret;} \
-	} else if (session->tls){ \
-		ret = SSL_write(session->tls, (buf), strlen(buf)); \
-		if (ret > 0) {c += ret;} \
-	} else if (session->fd_output != -1) { \
-		ret = write (session->fd_output, (buf), strlen(buf)); \
-		if (ret > 0) {c += ret;} \
-	} else { \
-		ret = -1; \
-	}
-#else /* not ENABLE_TLS */
-#define NC_WRITE(session,buf,c,ret) \
-	if(session->ssh_chan){ \
-		ret = ssh_channel_write (session->ssh_chan, (buf), strlen(buf)); \
-		if (ret > 0) {c += ret;} \
-	} else if (session->fd_output != -1) { \
-		ret = write (session->fd_output, (buf), strlen(buf)); \
-		if (ret > 0) {c += ret;} \
-	} else { \
-		ret = -1; \
-	}
-#endif /* not ENABLE_TLS */
-#endif /* not DISABLE_LIBSSH */
-
 int nc_session_monitoring_init(void)
 {
 	struct stat fdinfo;
@@ -1196,6 +1151,7 @@ static void ncntf_dispatch_stop(struct nc_session *session)
 	pthread_mutex_lock(&(session->mut_ntf));
 	if (session != NULL && session->ntf_active) {
 		session->ntf_stop = 1;
+		ncntf_dispatch_wakeup(session);
 		while (session->ntf_active) {
 			DBG_UNLOCK("mut_ntf");
 			pthread_mutex_unlock(&(session->mut_ntf));
@@ -1430,6 +1386,8 @@ API void nc_session_free(struct nc_session* session)
 		free(session->stats);
 	}
 
+	free(session->rbuf);
+	free(session->wbuf);
 	free (session);
 }
 
@@ -1442,17 +1400,208 @@ API NC_SESSION_STATUS nc_session_get_status (const struct nc_session* session)
 	return (session->status);
 }
 
-static int nc_session_send(struct nc_session* session, struct nc_msg *msg)
+/**
+ * @brief Wait until the data can be written into the session's transport.
+ *
+ * @param[in] session NETCONF session to write to.
+ * @return 0 if the caller can try to write again, -1 on error.
+ */
+static int nc_session_write_wait(struct nc_session* session)
 {
-	ssize_t c = 0;
-	int len, status;
-	char *text;
+	struct pollfd fds;
+	int status;
+
+	fds.fd = -1;
+	if (session->transport_socket != -1) {
+		fds.fd = session->transport_socket;
+	} else if (session->fd_output != -1) {
+		fds.fd = session->fd_output;
+	}
 #ifndef DISABLE_LIBSSH
-	const char *emsg;
+	else if (session->ssh_chan != NULL) {
+		fds.fd = ssh_get_fd(ssh_channel_get_session(session->ssh_chan));
+	}
+#endif
+#ifdef ENABLE_TLS
+	else if (session->tls != NULL) {
+		fds.fd = SSL_get_fd(session->tls);
+	}
+#endif
+	if (fds.fd == -1) {
+		ERROR("Invalid transport channel.");
+		return (-1);
+	}
+	fds.events = POLLOUT;
+	fds.revents = 0;
+
+	status = poll(&fds, 1, READ_TIMEOUT * 1000);
+	if (status == -1 && errno != EINTR) {
+		ERROR("Poll on output communication file descriptor failed (%s)", strerror(errno));
+		return (-1);
+	} else if (status == 0) {
+		ERROR("Writing timeout elapsed.");
+		return (-1);
+	}
+	return (0);
+}
+
+/**
+ * @brief Write all the given data blocks into the session's transport.
+ *
+ * @param[in] session NETCONF session to write to.
+ * @param[in] iov Data blocks to write, the array is modified.
+ * @param[in] iovcnt Number of the data blocks.
+ * @return EXIT_SUCCESS or EXIT_FAILURE
+ */
+static int nc_session_write_iov(struct nc_session* session, struct iovec *iov, int iovcnt)
+{
+	ssize_t c;
+	const char *emsg = NULL;
+#ifdef ENABLE_TLS
+	int r;
+#endif
+
+	while (iovcnt > 0) {
+		if (iov->iov_len == 0) {
+			iov++;
+			iovcnt--;
+			continue;
+		}
+
+#ifndef DISABLE_LIBSSH
+		if (session->ssh_chan) {
+			/* libssh does not support scatter-gather output */
+			c = ssh_channel_write(session->ssh_chan, iov->iov_base, iov->iov_len);
+			if (c == SSH_ERROR) {
+				emsg = (session->ssh_sess != NULL) ? ssh_get_error(session->ssh_sess) : "description not available";
+			}
+		} else
+#endif
+#ifdef ENABLE_TLS
+		if (session->tls) {
+			/* neither OpenSSL does */
+			c = SSL_write(session->tls, iov->iov_base, iov->iov_len);
+			if (c <= 0) {
+				r = SSL_get_error(session->tls, c);
+				if (r == SSL_ERROR_WANT_WRITE || r == SSL_ERROR_WANT_READ) {
+					c = 0;
+				} else if (r == SSL_ERROR_SYSCALL) {
+					emsg = strerror(errno);
+				} else {
+					emsg = ERR_reason_error_string(ERR_get_error());
+				}
+			}
+		} else
 #endif
-	char buf[1024];
+		if (session->fd_output != -1) {
+			c = writev(session->fd_output, iov, iovcnt);
+			if (c == -1) {
+				if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) {
+					c = 0;
+				} else {
+					emsg = strerror(errno);
+				}
+			}
+		} else {
+			emsg = "no output channel";
+			c = -1;
+		}
+
+		if (emsg != NULL || c < 0) {
+			VERB("Writing data into the communication channel failed (%s).", emsg ? emsg : "description not available");
+			return (EXIT_FAILURE);
+		} else if (c == 0) {
+			if (nc_session_write_wait(session) != 0) {
+				return (EXIT_FAILURE);
+			}
+			continue;
+		}
+
+		/* skip the written data */
+		while (c > 0 && (size_t) c >= iov->iov_len) {
+			c -= iov->iov_len;
+			iov++;
+			iovcnt--;
+		}
+		if (c > 0) {
+			iov->iov_base = (char*) iov->iov_base + c;
+			iov->iov_len -= c;
+		}
+	}
+
+	return (EXIT_SUCCESS);
+}
+
+/**
+ * @brief Write the content of the session's output buffer as a single chunk
+ * (in case of NETCONF 1.1) into the transport.
+ *
+ * @param[in] session NETCONF session to write to.
+ * @param[in] last Flag for the end of the message, the end marker is added.
+ * @return EXIT_SUCCESS or EXIT_FAILURE
+ */
+static int nc_session_wbuf_flush(struct nc_session* session, int last)
+{
+	struct iovec iov[3];
+	char header[24];
+	int i = 0;
+
+	if (session->version == NETCONFV11 && session->wbuf_len > 0) {
+		iov[i].iov_base = header;
+		iov[i].iov_len = snprintf(header, sizeof(header), "\n#%zu\n", session->wbuf_len);
+		i++;
+	}
+	iov[i].iov_base = session->wbuf;
+	iov[i].iov_len = session->wbuf_len;
+	i++;
+	if (last) {
+		iov[i].iov_base = (session->version == NETCONFV11) ? NC_V11_END_MSG : NC_V10_END_MSG;
+		iov[i].iov_len = strlen(iov[i].iov_base);
+		i++;
+	}
+
+	session->wbuf_len = 0;
+	return (nc_session_write_iov(session, iov, i));
+}
+
+/**
+ * @brief libxml2 output callback storing the serialized message into the
+ * session's output buffer, full buffer is written into the transport.
+ */
+static int nc_session_wbuf_write(void *context, const char *buffer, int len)
+{
+	struct nc_session *session = (struct nc_session*) context;
+	size_t n;
+	int rest = len;
+
+	while (rest > 0) {
+		n = NC_WRITE_BUFSIZE - session->wbuf_len;
+		if ((size_t) rest < n) {
+			n = rest;
+		}
+		memcpy(&(session->wbuf[session->wbuf_len]), buffer, n);
+		session->wbuf_len += n;
+		buffer += n;
+		rest -= n;
+
+		if (session->wbuf_len == NC_WRITE_BUFSIZE && nc_session_wbuf_flush(session, 0) != EXIT_SUCCESS) {
+			return (-1);
+		}
+	}
+
+	return (len);
+}
+
+/**
+ * @brief Check that the session is able to send a message.
+ *
+ * @param[in] session NETCONF session to write to.
+ * @return EXIT_SUCCESS or EXIT_FAILURE
+ */
+static int nc_session_send_ready(struct nc_session* session)
+{
+	int status;
 	struct pollfd fds;
-	int ret;
 
 	if (session->fd_output == -1 && session->transport_socket == -1
 #ifndef DISABLE_LIBSSH
@@ -1521,459 +1670,514 @@ static int nc_session_send(struct nc_session* session, struct nc_msg *msg)
 		break;
 	}
 
-	/* lock the session for sending the data */
+	return (EXIT_SUCCESS);
+}
+
+static int nc_session_send(struct nc_session* session, struct nc_msg *msg)
+{
+	int len, ret;
+	xmlChar *text;
+	xmlOutputBufferPtr out;
+
+	if (nc_session_send_ready(session) != EXIT_SUCCESS) {
+		return (EXIT_FAILURE);
+	}
 
-	xmlDocDumpFormatMemory (msg->doc, (xmlChar**) (&text), &len, NC_CONTENT_FORMATTED);
-	DBG("Writing message (session %s): %s", session->session_id, text);
+	if (verbose_level >= NC_VERB_DEBUG) {
+		xmlDocDumpFormatMemory(msg->doc, &text, &len, NC_CONTENT_FORMATTED);
+		DBG("Writing message (session %s): %s", session->session_id, (char*) text);
+		xmlFree(text);
+	}
 
+	/* lock the session for sending the data */
 	DBG_LOCK("mut_channel");
 	session->mut_channel_flag = 1;
 	pthread_mutex_lock(session->mut_channel);
-	/* if v1.1 send chunk information before message */
-	if (session->version == NETCONFV11) {
-		snprintf (buf, 1024, "\n#%d\n", (int) strlen (text));
-		c = 0;
-		do {
-			NC_WRITE(session, &(buf[c]), c, ret);
-			if (ret < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
-				usleep(10);
-				continue;
-			}
-#ifndef DISABLE_LIBSSH
-			if (ret == SSH_ERROR) {
-				DBG_UNLOCK("mut_channel");
-				session->mut_channel_flag = 0;
-				pthread_mutex_unlock(session->mut_channel);
-				if (!session->ssh_chan) {
-					emsg = strerror(errno);
-				} else if (session->ssh_chan && session->ssh_sess) {
-					emsg = ssh_get_error(session->ssh_sess);
-				} else {
-					emsg = "description not available";
-				}
-				VERB("Writing data into the communication channel failed (%s).", emsg);
-				free (text);
-				return (EXIT_FAILURE);
-			}
-#endif
-			if (ret <= 0) {
-				DBG_UNLOCK("mut_channel");
-				session->mut_channel_flag = 0;
-				pthread_mutex_unlock(session->mut_channel);
-				free (text);
-				return (EXIT_FAILURE);
-			}
-		} while (c < (ssize_t) strlen (buf));
-	}
 
-	/* write the message */
-	c = 0;
-	do {
-		NC_WRITE(session, &(text[c]), c, ret);
-		if (ret < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
-			usleep(10);
-			continue;
-		}
-#ifndef DISABLE_LIBSSH
-		if (ret == SSH_ERROR) {
-			DBG_UNLOCK("mut_channel");
-			session->mut_channel_flag = 0;
-			pthread_mutex_unlock(session->mut_channel);
-			if (!session->ssh_chan) {
-				emsg = strerror(errno);
-			} else if (session->ssh_chan && session->ssh_sess) {
-				emsg = ssh_get_error(session->ssh_sess);
-			} else {
-				emsg = "description not available";
-			}
-			VERB("Writing data into the communication channel failed (%s).", emsg);
-			free (text);
-			return (EXIT_FAILURE);
-		}
-#endif
-		if (ret <= 0) {
-			DBG_UNLOCK("mut_channel");
-			session->mut_channel_flag = 0;
-			pthread_mutex_unlock(session->mut_channel);
-			free (text);
-			return (EXIT_FAILURE);
-		}
-	} while (c < (ssize_t) strlen (text));
-	free (text);
+	if (session->wbuf == NULL && (session->wbuf = malloc(NC_WRITE_BUFSIZE)) == NULL) {
+		ERROR("Memory allocation failed (%s:%d).", __FILE__, __LINE__);
+		ret = EXIT_FAILURE;
+		goto cleanup;
+	}
+	session->wbuf_len = 0;
 
-	/* close message */
-	if (session->version == NETCONFV11) {
-		text = NC_V11_END_MSG;
-	} else { /* NETCONFV10 */
-		text = NC_V10_END_MSG;
+	/*
+	 * serialize the message directly into the session's output buffer, it
+	 * is written into the transport (as a chunk in case of NETCONF 1.1)
+	 * whenever it gets full
+	 */
+	if ((out = xmlOutputBufferCreateIO(nc_session_wbuf_write, NULL, session, NULL)) == NULL) {
+		ERROR("Unable to create the output buffer (%s:%d).", __FILE__, __LINE__);
+		ret = EXIT_FAILURE;
+		goto cleanup;
 	}
-	c = 0;
-	do {
-		NC_WRITE(session, &(text[c]), c, ret);
-		if (ret < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
-			usleep(10);
-			continue;
-		}
-#ifndef DISABLE_LIBSSH
-		if (ret == SSH_ERROR) {
-			DBG_UNLOCK("mut_channel");
-			session->mut_channel_flag = 0;
-			pthread_mutex_unlock(session->mut_channel);
-			if (!session->ssh_chan) {
-				emsg = strerror(errno);
-			} else if (session->ssh_chan && session->ssh_sess) {
-				emsg = ssh_get_error(session->ssh_sess);
-			} else {
-				emsg = "description not available";
-			}
-			VERB("Writing data into the communication channel failed (%s).", emsg);
-			return (EXIT_FAILURE);
-		}
-#endif
-		if (ret <= 0) {
-			DBG_UNLOCK("mut_channel");
-			session->mut_channel_flag = 0;
-			pthread_mutex_unlock(session->mut_channel);
-			return (EXIT_FAILURE);
-		}
-	} while (c < (ssize_t) strlen (text));
+	if (xmlSaveFormatFileTo(out, msg->doc, NULL, NC_CONTENT_FORMATTED) < 0) {
+		/* the output buffer is closed by the function */
+		ret = EXIT_FAILURE;
+		goto cleanup;
+	}
+
+	/* write the rest of the message and close it */
+	ret = nc_session_wbuf_flush(session, 1);
 
+cleanup:
 	/* unlock the session's output */
 	DBG_UNLOCK("mut_channel");
 	session->mut_channel_flag = 0;
 	pthread_mutex_unlock(session->mut_channel);
 
-	return (EXIT_SUCCESS);
+	return (ret);
 }
 
-static int nc_session_read_len(struct nc_session* session, size_t chunk_length, char **text, size_t *len)
+/**
+ * @brief Send an already serialized message.
+ *
+ * @param[in] session NETCONF session to write to.
+ * @param[in] text Serialized message without the NETCONF framing.
+ * @param[in] len Length of the text.
+ * @return EXIT_SUCCESS or EXIT_FAILURE
+ */
+static int nc_session_send_text(struct nc_session* session, const char* text, size_t len)
 {
-	char *buf;
-	ssize_t c;
-	size_t rd = 0;
-	long sleep_count = 0;
-#ifdef ENABLE_TLS
-	int r;
-#endif
+	int ret;
 
-	/* check if we can work with the session */
-	if (session->status != NC_SESSION_STATUS_WORKING &&
-			session->status != NC_SESSION_STATUS_CLOSING) {
+	if (nc_session_send_ready(session) != EXIT_SUCCESS) {
 		return (EXIT_FAILURE);
 	}
 
-	buf = malloc ((chunk_length + 1) * sizeof(char));
-	if (buf == NULL) {
-		ERROR("Memory reallocation failed (%s:%d).", __FILE__, __LINE__);
-		*len = 0;
-		*text = NULL;
-		return (EXIT_FAILURE);
+	DBG("Writing message (session %s): %.*s", session->session_id, (int) len, text);
+
+	/* lock the session for sending the data */
+	DBG_LOCK("mut_channel");
+	session->mut_channel_flag = 1;
+	pthread_mutex_lock(session->mut_channel);
+
+	if (session->wbuf == NULL && (session->wbuf = malloc(NC_WRITE_BUFSIZE)) == NULL) {
+		ERROR("Memory allocation failed (%s:%d).", __FILE__, __LINE__);
+		ret = EXIT_FAILURE;
+		goto cleanup;
 	}
+	session->wbuf_len = 0;
+
+	/* the same chunking as when serializing the message into the buffer */
+	if (nc_session_wbuf_write(session, text, len) != (int) len) {
+		ret = EXIT_FAILURE;
+		goto cleanup;
+	}
+	ret = nc_session_wbuf_flush(session, 1);
+
+cleanup:
+	/* unlock the session's output */
+	DBG_UNLOCK("mut_channel");
+	session->mut_channel_flag = 0;
+	pthread_mutex_unlock(session->mut_channel);
+
+	return (ret);
+}
+
+/**
+ * @brief Read a block of data from the session's transport.
+ *
+ * @param[in] session NETCONF session to read from.
+ * @param[out] buf Buffer for the read data.
+ * @param[in] size Maximal number of bytes to read.
+ * @return Number of read bytes, 0 if there are no data available at the moment
+ * (the caller is supposed to try it again later) and -1 on error.
+ */
+static ssize_t nc_session_read_block(struct nc_session* session, char *buf, size_t size)
+{
+	ssize_t c;
+#ifdef ENABLE_TLS
+	int r;
+#endif
 
-	while (rd < chunk_length) {
-		if ((READ_TIMEOUT * 1000000) / NC_READ_SLEEP == sleep_count) {
-			ERROR("Reading timeout elapsed.");
-			free(buf);
-			*len = 0;
-			*text = NULL;
-			return (EXIT_FAILURE);
-		}
 #ifndef DISABLE_LIBSSH
-		if (session->ssh_chan) {
-			/* read via libssh */
-			c = ssh_channel_read(session->ssh_chan, &(buf[rd]), chunk_length - rd, 0);
-			if (c == SSH_AGAIN) {
-				usleep (NC_READ_SLEEP);
-				++sleep_count;
-				continue;
-			} else if (c == SSH_ERROR) {
+	if (session->ssh_chan) {
+		/* read via libssh */
+		c = ssh_channel_read_nonblocking(session->ssh_chan, buf, size, 0);
+		if (c == SSH_AGAIN) {
+			return (0);
+		} else if (c == SSH_ERROR) {
+			if (session->ssh_sess != NULL) {
 				ERROR("Reading from the SSH channel failed (%zd: %s)", ssh_get_error_code(session->ssh_sess), ssh_get_error(session->ssh_sess));
-				free (buf);
-				*len = 0;
-				*text = NULL;
-				return (EXIT_FAILURE);
-			} else if (c == 0) {
-				if (ssh_channel_is_eof(session->ssh_chan)) {
-					ERROR("Server has closed the communication socket");
-					free (buf);
-					*len = 0;
-					*text = NULL;
-					return (EXIT_FAILURE);
-				}
-				usleep (NC_READ_SLEEP);
-				++sleep_count;
-				continue;
+			} else {
+				ERROR("Reading from the SSH channel failed");
 			}
-		} else
+			return (-1);
+		} else if (c == 0 && ssh_channel_is_eof(session->ssh_chan)) {
+			ERROR("Server has closed the communication socket");
+			return (-1);
+		}
+		return (c);
+	}
 #endif
 #ifdef ENABLE_TLS
-		if (session->tls) {
-			/* read via OpenSSL */
-			c = SSL_read(session->tls, &(buf[rd]), chunk_length - rd);
-			if (c <= 0 && (r = SSL_get_error(session->tls, c))) {
-				if (r == SSL_ERROR_WANT_READ) {
-					usleep(NC_READ_SLEEP);
-					++sleep_count;
-					continue;
-				} else {
-					if (r == SSL_ERROR_SYSCALL) {
-						ERROR("Reading from the TLS session failed (%s)", strerror(errno));
-					} else if (r == SSL_ERROR_SSL) {
-						ERROR("Reading from the TLS session failed (%s)", ERR_error_string(r, NULL));
-					} else {
-						ERROR("Reading from the TLS session failed (SSL code %d)", r);
-					}
-					free (buf);
-					if (len != NULL) {
-						*len = 0;
-					}
-					if (text != NULL) {
-						*text = NULL;
-					}
-					return (EXIT_FAILURE);
-				}
+	if (session->tls) {
+		/* read via OpenSSL */
+		c = SSL_read(session->tls, buf, size);
+		if (c <= 0 && (r = SSL_get_error(session->tls, c))) {
+			if (r == SSL_ERROR_WANT_READ) {
+				return (0);
 			}
-		} else
+			if (r == SSL_ERROR_SYSCALL) {
+				ERROR("Reading from the TLS session failed (%s)", strerror(errno));
+			} else if (r == SSL_ERROR_SSL) {
+				ERROR("Reading from the TLS session failed (%s)", ERR_error_string(r, NULL));
+			} else {
+				ERROR("Reading from the TLS session failed (SSL code %d)", r);
+			}
+			return (-1);
+		}
+		return (c);
+	}
 #endif
-		if (session->fd_input != -1) {
-			/* read via file descriptor */
-			c = read (session->fd_input, &(buf[rd]), chunk_length - rd);
-			if (c == -1) {
-				if (errno == EAGAIN) {
-					usleep (NC_READ_SLEEP);
-					++sleep_count;
-					continue;
-				} else {
-					ERROR("Reading from an input file descriptor failed (%s)", strerror(errno));
-					free (buf);
-					*len = 0;
-					*text = NULL;
-					return (EXIT_FAILURE);
-				}
+	if (session->fd_input != -1) {
+		/* read via file descriptor */
+		c = read(session->fd_input, buf, size);
+		if (c == -1) {
+			if (errno == EAGAIN || errno == EINTR) {
+				return (0);
 			}
-		} else {
-			ERROR("No way to read the input, fatal error.");
-			free (buf);
-			*len = 0;
-			*text = NULL;
-			return (EXIT_FAILURE);
+			ERROR("Reading from an input file descriptor failed (%s)", strerror(errno));
+			return (-1);
+		} else if (c == 0) {
+			ERROR("EOF received");
+			return (-1);
 		}
-
-		rd += c;
+		return (c);
 	}
 
-	/* add terminating null byte */
-	buf[rd] = 0;
-
-	*len = rd;
-	*text = buf;
-	return (EXIT_SUCCESS);
+	ERROR("No way to read the input, fatal error.");
+	return (-1);
 }
 
-static int nc_session_read_until(struct nc_session* session, const char* endtag, unsigned int limit, char **text, size_t *len)
+/**
+ * @brief Wait until there are some data to read on the session's transport.
+ *
+ * @param[in] session NETCONF session to wait on.
+ * @param[in] deadline Absolute (CLOCK_MONOTONIC) time limit for reading the
+ * whole message.
+ * @return 0 if the caller can try to read the data again, -1 on error or if
+ * the deadline has elapsed.
+ */
+static int nc_session_read_wait(struct nc_session* session, const struct timespec *deadline)
 {
-	size_t rd = 0;
-	ssize_t c;
-	char *buf = NULL;
-	size_t buflen = 0;
-	long sleep_count = 0;
-#ifdef ENABLE_TLS
-	int r;
-#endif
+	struct timespec now;
+	struct pollfd fds;
+	long timeout;
+	int status;
 
-	/* check if we can work with the session */
-	if (session->status != NC_SESSION_STATUS_WORKING &&
-			session->status != NC_SESSION_STATUS_CLOSING) {
-		return (EXIT_FAILURE);
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	timeout = (deadline->tv_sec - now.tv_sec) * 1000 + (deadline->tv_nsec - now.tv_nsec) / 1000000;
+	if (timeout <= 0) {
+		ERROR("Reading timeout elapsed.");
+		return (-1);
 	}
 
-	if (endtag == NULL) {
-		return (EXIT_FAILURE);
-	}
+#ifndef DISABLE_LIBSSH
+	if (session->ssh_chan) {
+		/* the SSH session can be shared by more channels, so ask libssh */
+		status = ssh_channel_poll_timeout(session->ssh_chan, (int) timeout, 0);
+		if (status == SSH_ERROR) {
+			ERROR("Polling the SSH channel failed (%s)", (session->ssh_sess != NULL) ? ssh_get_error(session->ssh_sess) : "description not available");
+			return (-1);
+		}
+		/* EOF is detected by the following read */
+		return (0);
+	}
+#endif
 
-	/* set starting buffer size */
-	buflen = 1024;
-	buf = (char*) malloc (buflen * sizeof(char));
-	if (buf == NULL) {
-		ERROR("Memory reallocation failed (%s:%d).", __FILE__, __LINE__);
-		return (EXIT_FAILURE);
+	fds.fd = -1;
+#ifdef ENABLE_TLS
+	if (session->tls) {
+		fds.fd = SSL_get_fd(session->tls);
+	} else
+#endif
+	if (session->fd_input != -1) {
+		fds.fd = session->fd_input;
+	}
+	if (fds.fd == -1) {
+		ERROR("Invalid transport channel.");
+		return (-1);
 	}
+	fds.events = POLLIN;
+	fds.revents = 0;
 
-	for (rd = 0;;) {
-		if (limit > 0 && rd > limit) {
-			free(buf);
-			WARN("%s: reading limit reached.", __func__);
-			return (EXIT_FAILURE);
+	status = poll(&fds, 1, (int) timeout);
+	if (status == -1 && errno != EINTR) {
+		ERROR("Poll on input communication file descriptor failed (%s)", strerror(errno));
+		return (-1);
+	}
+	/* timeout is checked by the next call, POLLHUP and POLLERR by the following read */
+	return (0);
+}
+
+/**
+ * @brief Read the next block of data from the transport into the session's
+ * receive buffer. Unprocessed data are kept at the beginning of the buffer.
+ *
+ * @param[in] session NETCONF session to read from.
+ * @return Number of newly buffered bytes, 0 if there are no data available at
+ * the moment and -1 on error.
+ */
+static ssize_t nc_session_rbuf_fill(struct nc_session* session)
+{
+	char *tmp;
+	size_t size;
+	ssize_t c;
+
+	/* move the unprocessed data to the beginning of the buffer */
+	if (session->rbuf_start > 0) {
+		memmove(session->rbuf, &(session->rbuf[session->rbuf_start]), session->rbuf_end - session->rbuf_start);
+		session->rbuf_end -= session->rbuf_start;
+		session->rbuf_start = 0;
+	}
+
+	/* get more space for the data if needed */
+	if (session->rbuf_size - session->rbuf_end < NC_READ_BUFSIZE / 2) {
+		size = (session->rbuf_size == 0) ? NC_READ_BUFSIZE : 2 * session->rbuf_size;
+		tmp = realloc(session->rbuf, size);
+		if (tmp == NULL) {
+			ERROR("Memory reallocation failed (%s:%d).", __FILE__, __LINE__);
+			return (-1);
 		}
+		session->rbuf = tmp;
+		session->rbuf_size = size;
+	}
 
-		if ((READ_TIMEOUT * 1000000) / NC_READ_SLEEP == sleep_count) {
-			free(buf);
-			ERROR("Reading timeout elapsed.");
-			return (EXIT_FAILURE);
+	c = nc_session_read_block(session, &(session->rbuf[session->rbuf_end]), session->rbuf_size - session->rbuf_end);
+	if (c > 0) {
+		session->rbuf_end += c;
+	}
+	return (c);
+}
+
+/**
+ * @brief Mark the given number of the buffered bytes as processed.
+ *
+ * @param[in] session NETCONF session with the receive buffer.
+ * @param[in] count Number of the processed bytes.
+ */
+static void nc_session_rbuf_consume(struct nc_session* session, size_t count)
+{
+	session->rbuf_start += count;
+	if (session->rbuf_start == session->rbuf_end) {
+		/* all data processed */
+		session->rbuf_start = session->rbuf_end = 0;
+		if (session->rbuf_size > 4 * NC_READ_BUFSIZE) {
+			/* do not hold the memory after some large message */
+			free(session->rbuf);
+			session->rbuf = NULL;
+			session->rbuf_size = 0;
 		}
-#ifndef DISABLE_LIBSSH
-		if (session->ssh_chan) {
-			/* read via libssh */
-			c = ssh_channel_read(session->ssh_chan, &(buf[rd]), 1, 0);
-			if (c == SSH_AGAIN) {
-				usleep (NC_READ_SLEEP);
-				++sleep_count;
-				continue;
-			} else if (c == SSH_ERROR) {
-				if (session->ssh_sess != NULL) {
-					ERROR("Reading from the SSH channel failed (%zd: %s)", ssh_get_error_code(session->ssh_sess), ssh_get_error(session->ssh_sess));
-				} else {
-					ERROR("Reading from the SSH channel failed");
-				}
-				free (buf);
-				if (len != NULL) {
-					*len = 0;
-				}
-				if (text != NULL) {
-					*text = NULL;
-				}
+	}
+}
+
+/**
+ * @brief State of the incremental parsing of a message being received.
+ */
+struct nc_msg_parser {
+	/**< @brief libxml2 push parser context */
+	xmlParserCtxtPtr ctxt;
+	/**< @brief Number of bytes passed to the parser */
+	unsigned long long int size;
+	/**< @brief Flag if the leading whitespaces were already skipped */
+	int started;
+};
+
+/**
+ * @brief Pass the next part of the received message to the XML parser.
+ *
+ * @param[in] parser Parser of the message.
+ * @param[in] data Part of the message.
+ * @param[in] len Length of the data.
+ * @return EXIT_SUCCESS or EXIT_FAILURE if the data are not valid XML or the
+ * message exceeds MAX_MSG_SIZE.
+ */
+static int nc_msg_parser_feed(struct nc_msg_parser *parser, const char *data, size_t len)
+{
+	if (!parser->started) {
+		/* skip leading whitespaces */
+		while (len > 0 && isspace(*data)) {
+			data++;
+			len--;
+		}
+		if (len == 0) {
+			return (EXIT_SUCCESS);
+		}
+		parser->started = 1;
+	}
+
+	parser->size += len;
+	if (MAX_MSG_SIZE > 0 && parser->size > MAX_MSG_SIZE) {
+		ERROR("Received message exceeds the maximal size (%llu bytes).", (unsigned long long int) MAX_MSG_SIZE);
+		return (EXIT_FAILURE);
+	}
+
+	if (xmlParseChunk(parser->ctxt, data, (int) len, 0) != 0 || !parser->ctxt->wellFormed) {
+		ERROR("Invalid XML data received.");
+		return (EXIT_FAILURE);
+	}
+
+	return (EXIT_SUCCESS);
+}
+
+/**
+ * @brief Read a NETCONF 1.0 message (up to the end tag) and pass it to the
+ * parser as it is being read.
+ *
+ * @param[in] session NETCONF session to read from.
+ * @param[in] deadline Absolute (CLOCK_MONOTONIC) time limit for reading the message.
+ * @param[in] parser Parser of the message.
+ * @return EXIT_SUCCESS or EXIT_FAILURE
+ */
+static int nc_session_read_msg10(struct nc_session* session, const struct timespec *deadline, struct nc_msg_parser *parser)
+{
+	size_t taglen, pending, len;
+	ssize_t c;
+	char *found;
+
+	taglen = strlen(NC_V10_END_MSG);
+	while (1) {
+		pending = session->rbuf_end - session->rbuf_start;
+		found = memmem(&(session->rbuf[session->rbuf_start]), pending, NC_V10_END_MSG, taglen);
+		if (found != NULL) {
+			len = found - &(session->rbuf[session->rbuf_start]);
+			if (nc_msg_parser_feed(parser, &(session->rbuf[session->rbuf_start]), len) != 0) {
 				return (EXIT_FAILURE);
-			} else if (c == 0) {
-				if (ssh_channel_is_eof (session->ssh_chan)) {
-					ERROR("Server has closed the communication socket");
-					free (buf);
-					if (len != NULL) {
-						*len = 0;
-					}
-					if (text != NULL) {
-						*text = NULL;
-					}
-					return (EXIT_FAILURE);
-				}
-				usleep (NC_READ_SLEEP);
-				++sleep_count;
-				continue;
 			}
-		} else
-#endif
-#ifdef ENABLE_TLS
-		if (session->tls) {
-			/* read via OpenSSL */
-			c = SSL_read(session->tls, &(buf[rd]), 1);
-			if (c <= 0 && (r = SSL_get_error(session->tls, c))) {
-				if (r == SSL_ERROR_WANT_READ) {
-					usleep(NC_READ_SLEEP);
-					++sleep_count;
-					continue;
-				} else {
-					if (r == SSL_ERROR_SYSCALL) {
-						ERROR("Reading from the TLS session failed (%s)", strerror(errno));
-					} else if (r == SSL_ERROR_SSL) {
-						ERROR("Reading from the TLS session failed (%s)", ERR_error_string(r, NULL));
-					} else {
-						ERROR("Reading from the TLS session failed (SSL code %d)", r);
-					}
-					free (buf);
-					if (len != NULL) {
-						*len = 0;
-					}
-					if (text != NULL) {
-						*text = NULL;
-					}
-					return (EXIT_FAILURE);
-				}
-			}
-		} else
-#endif
-		if (session->fd_input != -1) {
-			/* read via file descriptor */
-			c = read (session->fd_input, &(buf[rd]), 1);
-			if (c == -1) {
-				if (errno == EAGAIN) {
-					usleep (NC_READ_SLEEP);
-					++sleep_count;
-					continue;
-				} else {
-					ERROR("Reading from an input file descriptor failed (%s)", strerror(errno));
-					free (buf);
-					if (len != NULL) {
-						*len = 0;
-					}
-					if (text != NULL) {
-						*text = NULL;
-					}
-					return (EXIT_FAILURE);
-				}
-			} else if (c == 0) {
-				ERROR("EOF received (%s)", strerror(errno));
-				free(buf);
-				if (len != NULL ) {
-					*len = 0;
-				}
-				if (text != NULL ) {
-					*text = NULL;
-				}
+			nc_session_rbuf_consume(session, len + taglen);
+			return (EXIT_SUCCESS);
+		}
+
+		/* pass the data to the parser, except a possible beginning of the end tag */
+		if (pending >= taglen) {
+			len = pending - (taglen - 1);
+			if (nc_msg_parser_feed(parser, &(session->rbuf[session->rbuf_start]), len) != 0) {
 				return (EXIT_FAILURE);
 			}
-		} else {
-			ERROR("No way to read the input, fatal error.");
-			free (buf);
-			if (len != NULL) {
-				*len = 0;
-			}
-			if (text != NULL) {
-				*text = NULL;
-			}
+			nc_session_rbuf_consume(session, len);
+		}
+
+		c = nc_session_rbuf_fill(session);
+		if (c < 0 || (c == 0 && nc_session_read_wait(session, deadline) != 0)) {
 			return (EXIT_FAILURE);
 		}
+	}
+}
 
-		rd += c; /* should be rd++ */
-		buf[rd] = '\0';
+/**
+ * @brief Read a NETCONF 1.1 chunk of the given size and pass it to the parser.
+ *
+ * @param[in] session NETCONF session to read from.
+ * @param[in] chunk_length Size of the chunk.
+ * @param[in] deadline Absolute (CLOCK_MONOTONIC) time limit for reading the message.
+ * @param[in] parser Parser of the message.
+ * @return EXIT_SUCCESS or EXIT_FAILURE
+ */
+static int nc_session_read_chunk(struct nc_session* session, size_t chunk_length, const struct timespec *deadline, struct nc_msg_parser *parser)
+{
+	size_t len;
+	ssize_t c;
 
-		if ((rd) < strlen (endtag)) {
-			/* not enough data to compare with endtag */
-			continue;
-		} else {
-			/* compare with endtag */
-			if (strcmp (endtag, &(buf[rd - strlen (endtag)])) == 0) {
-				/* end tag found */
-				if (len != NULL) {
-					*len = rd;
-				}
-				if (text != NULL) {
-					*text = buf;
-				} else {
-					free(buf);
-				}
-				return (EXIT_SUCCESS);
-			}
-		}
+	/* check if we can work with the session */
+	if (session->status != NC_SESSION_STATUS_WORKING &&
+			session->status != NC_SESSION_STATUS_CLOSING) {
+		return (EXIT_FAILURE);
+	}
 
-		/* resize buffer if needed */
-		if (rd == (buflen-1)) {
-			/* get more memory for the text */
-			void *tmp = realloc (buf, (2 * buflen) * sizeof(char));
-			if (tmp == NULL) {
-				ERROR("Memory reallocation failed (%s:%d).", __FILE__, __LINE__);
-				if (len != NULL) {
-					*len = 0;
-				}
-				if (text != NULL) {
-					*text = NULL;
-				}
-				free(buf);
+	while (chunk_length > 0) {
+		len = session->rbuf_end - session->rbuf_start;
+		if (len == 0) {
+			c = nc_session_rbuf_fill(session);
+			if (c < 0 || (c == 0 && nc_session_read_wait(session, deadline) != 0)) {
 				return (EXIT_FAILURE);
 			}
-			buf = tmp;
-			buflen = 2 * buflen;
+			continue;
 		}
+
+		if (len > chunk_length) {
+			len = chunk_length;
+		}
+		if (nc_msg_parser_feed(parser, &(session->rbuf[session->rbuf_start]), len) != 0) {
+			return (EXIT_FAILURE);
+		}
+		nc_session_rbuf_consume(session, len);
+		chunk_length -= len;
 	}
 
-	/* no one could be here */
-	ERROR("Reading NETCONF message fatal failure");
-	free (buf);
+	return (EXIT_SUCCESS);
+}
+
+static int nc_session_read_until(struct nc_session* session, const char* endtag, unsigned int limit, const struct timespec *deadline, char **text, size_t *len)
+{
+	size_t taglen, pending, scanned = 0, msglen = 0;
+	ssize_t c;
+	char *buf, *found;
+
 	if (len != NULL) {
 		*len = 0;
 	}
 	if (text != NULL) {
 		*text = NULL;
 	}
-	return (EXIT_FAILURE);
+
+	/* check if we can work with the session */
+	if (session->status != NC_SESSION_STATUS_WORKING &&
+			session->status != NC_SESSION_STATUS_CLOSING) {
+		return (EXIT_FAILURE);
+	}
+
+	if (endtag == NULL) {
+		return (EXIT_FAILURE);
+	}
+	taglen = strlen(endtag);
+
+	while (1) {
+		/* look for the endtag in the part of the buffered data not checked yet */
+		pending = session->rbuf_end - session->rbuf_start;
+		if (pending >= taglen) {
+			found = memmem(&(session->rbuf[session->rbuf_start + scanned]), pending - scanned, endtag, taglen);
+			if (found != NULL) {
+				msglen = (found - &(session->rbuf[session->rbuf_start])) + taglen;
+				break;
+			}
+			/* the endtag can be split between the current and the next block */
+			scanned = pending - (taglen - 1);
+		}
+
+		if (limit > 0 && pending > limit) {
+			WARN("%s: reading limit reached.", __func__);
+			return (EXIT_FAILURE);
+		}
+
+		c = nc_session_rbuf_fill(session);
+		if (c < 0 || (c == 0 && nc_session_read_wait(session, deadline) != 0)) {
+			return (EXIT_FAILURE);
+		}
+	}
+
+	if (limit > 0 && msglen > limit + 1) {
+		WARN("%s: reading limit reached.", __func__);
+		return (EXIT_FAILURE);
+	}
+
+	if (text != NULL) {
+		buf = malloc((msglen + 1) * sizeof(char));
+		if (buf == NULL) {
+			ERROR("Memory reallocation failed (%s:%d).", __FILE__, __LINE__);
+			return (EXIT_FAILURE);
+		}
+		memcpy(buf, &(session->rbuf[session->rbuf_start]), msglen);
+		buf[msglen] = '\0';
+		*text = buf;
+	}
+	if (len != NULL) {
+		*len = msglen;
+	}
+	nc_session_rbuf_consume(session, msglen);
+
+	return (EXIT_SUCCESS);
 }
 
 /**
@@ -2010,11 +2214,14 @@ static NC_MSG_TYPE nc_session_receive(struct nc_session* session, int timeout, s
 	nc_reply* reply;
 	const char* id;
 	const char *emsg;
-	char *text = NULL, *tmp_text, *chunk = NULL;
+	char *chunk = NULL;
+	xmlChar *text;
+	int text_len;
 	size_t len;
-	unsigned long long int text_size = 0, total_len = 0;
 	size_t chunk_length;
+	struct nc_msg_parser parser = {NULL, 0, 0};
 	struct pollfd fds;
+	struct timespec deadline;
 	int status;
 	unsigned long int revents;
 	NC_MSG_TYPE msgtype;
@@ -2038,8 +2245,11 @@ static NC_MSG_TYPE nc_session_receive(struct nc_session* session, int timeout, s
 	DBG_LOCK("mut_channel");
 	pthread_mutex_lock(session->mut_channel);
 
-	/* use while for possibility of repeating test */
-	while(1) {
+	/*
+	 * use while for possibility of repeating test, there is no need to wait
+	 * for the data if some are already buffered from the previous reading
+	 */
+	while (session->rbuf_start == session->rbuf_end) {
 		revents = 0;
 #ifndef DISABLE_LIBSSH
 		if (session->ssh_chan != NULL) {
@@ -2135,26 +2345,29 @@ static NC_MSG_TYPE nc_session_receive(struct nc_session* session, int timeout, s
 		break;
 	}
 
+	/* the whole message is supposed to be read in READ_TIMEOUT */
+	clock_gettime(CLOCK_MONOTONIC, &deadline);
+	deadline.tv_sec += READ_TIMEOUT;
+
+	/* the message is parsed as it is being read */
+	if ((parser.ctxt = xmlCreatePushParserCtxt(NULL, NULL, NULL, 0, NULL)) == NULL) {
+		ERROR("Unable to create the XML parser context (%s:%d).", __FILE__, __LINE__);
+		goto malformed_msg_channels_unlock;
+	}
+	xmlCtxtUseOptions(parser.ctxt, NC_XMLREAD_OPTIONS);
+
 	switch (session->version) {
 	case NETCONFV10:
-		if (nc_session_read_until (session, NC_V10_END_MSG, 0, &text, &len) != 0) {
+		if (nc_session_read_msg10(session, &deadline, &parser) != 0) {
 			goto malformed_msg_channels_unlock;
 		}
-		text[len - strlen (NC_V10_END_MSG)] = 0;
-		DBG("Received message (session %s): %s", session->session_id, text);
 		break;
 	case NETCONFV11:
 		do {
-			if (nc_session_read_until (session, "\n#", 2, NULL, NULL) != 0) {
-				if (total_len > 0) {
-					free (text);
-				}
+			if (nc_session_read_until (session, "\n#", 2, &deadline, NULL, NULL) != 0) {
 				goto malformed_msg_channels_unlock;
 			}
-			if (nc_session_read_until (session, "\n", 0, &chunk, &len) != 0) {
-				if (total_len > 0) {
-					free (text);
-				}
+			if (nc_session_read_until (session, "\n", 0, &deadline, &chunk, &len) != 0) {
 				goto malformed_msg_channels_unlock;
 			}
 			if (strcmp (chunk, "#\n") == 0) {
@@ -2165,44 +2378,18 @@ static NC_MSG_TYPE nc_session_receive(struct nc_session* session, int timeout, s
 
 			/* convert string to the size of the following chunk */
 			chunk_length = strtoul (chunk, (char **) NULL, 10);
+			free (chunk);
+			chunk = NULL;
 			if (chunk_length == 0) {
 				ERROR("Invalid frame chunk size detected, fatal error.");
 				goto malformed_msg_channels_unlock;
 			}
-			free (chunk);
-			chunk = NULL;
 
 			/* now we have size of next chunk, so read the chunk */
-			if (nc_session_read_len (session, chunk_length, &chunk, &len) != 0) {
-				if (total_len > 0) {
-					free (text);
-				}
+			if (nc_session_read_chunk (session, chunk_length, &deadline, &parser) != 0) {
 				goto malformed_msg_channels_unlock;
 			}
-
-			/*
-			 * realloc resulting text buffer if needed (always needed now)
-			 * don't forget count terminating null byte
-			 * */
-			if (text_size < (total_len + len + 1)) {
-				char *tmp = realloc (text, total_len + len + 1);
-				if (tmp == NULL) {
-					ERROR("Memory reallocation failed (%s:%d).", __FILE__, __LINE__);
-					free(text);
-					goto malformed_msg_channels_unlock;
-				}
-				text = tmp;
-				text[total_len] = '\0';
-				text_size = total_len + len + 1;
-			}
-			memcpy(text + total_len, chunk, len);
-			total_len += len;
-			text[total_len] = '\0';
-			free (chunk);
-			chunk = NULL;
-
 		} while (1);
-		DBG("Received message (session %s): %s", session->session_id, text);
 		break;
 	default:
 		ERROR("Unsupported NETCONF protocol version (%d)", session->version);
@@ -2213,7 +2400,7 @@ static NC_MSG_TYPE nc_session_receive(struct nc_session* session, int timeout, s
 	DBG_UNLOCK("mut_channel");
 	pthread_mutex_unlock(session->mut_channel);
 
-	if (text == NULL) {
+	if (parser.size == 0) {
 		ERROR("Empty message received (session %s)", session->session_id);
 		goto malformed_msg;
 	}
@@ -2221,24 +2408,27 @@ static NC_MSG_TYPE nc_session_receive(struct nc_session* session, int timeout, s
 	retval = calloc (1, sizeof(struct nc_msg));
 	if (retval == NULL) {
 		ERROR("Memory reallocation failed (%s:%d).", __FILE__, __LINE__);
-		free (text);
 		goto malformed_msg;
 	}
 
-	/* skip leading whitespaces */
-	tmp_text=text;
-	while (isspace(*tmp_text)) {
-		tmp_text++;
-	}
-	/* store the received message in libxml2 format */
-	retval->doc = xmlReadDoc (BAD_CAST tmp_text, NULL, NULL, NC_XMLREAD_OPTIONS);
-	if (retval->doc == NULL) {
+	/* finish the parsing and take the received message in libxml2 format */
+	xmlParseChunk(parser.ctxt, NULL, 0, 1);
+	retval->doc = parser.ctxt->myDoc;
+	parser.ctxt->myDoc = NULL;
+	if (retval->doc == NULL || !parser.ctxt->wellFormed || xmlDocGetRootElement(retval->doc) == NULL) {
+		xmlFreeDoc(retval->doc);
 		free (retval);
-		free (text);
 		ERROR("Invalid XML data received.");
 		goto malformed_msg;
 	}
-	free (text);
+	xmlFreeParserCtxt(parser.ctxt);
+	parser.ctxt = NULL;
+
+	if (verbose_level >= NC_VERB_DEBUG) {
+		xmlDocDumpMemory(retval->doc, &text, &text_len);
+		DBG("Received message (session %s): %s", session->session_id, (char*) text);
+		xmlFree(text);
+	}
 
 	/* create xpath evaluation context */
 	if ((retval->ctxt = xmlXPathNewContext(retval->doc)) == NULL) {
@@ -2327,6 +2517,10 @@ malformed_msg_channels_unlock:
 	pthread_mutex_unlock(session->mut_channel);
 
 malformed_msg:
+	if (parser.ctxt != NULL) {
+		xmlFreeDoc(parser.ctxt->myDoc);
+		xmlFreeParserCtxt(parser.ctxt);
+	}
 	if (session->version == NETCONFV11 && session->ssh_sess == NULL) {
 		/* NETCONF version 1.1 define sending error reply from the server */
 		reply = nc_reply_error(nc_err_new(NC_ERR_MALFORMED_MSG));
@@ -2507,6 +2701,39 @@ API int nc_session_send_notif(struct nc_session* session, const nc_ntf* ntf)
 	return (ret);
 }
 
+int nc_session_send_notif_text(struct nc_session* session, const char* text, size_t len)
+{
+	int ret;
+
+	DBG_LOCK("mut_session");
+	pthread_mutex_lock(&(session->mut_session));
+
+	if (session->status != NC_SESSION_STATUS_WORKING && session->status != NC_SESSION_STATUS_CLOSING) {
+		ERROR("Invalid session to send <notification>.");
+		DBG_UNLOCK("mut_session");
+		pthread_mutex_unlock(&(session->mut_session));
+		return (EXIT_FAILURE);
+	}
+
+	/* send message */
+	ret = nc_session_send_text(session, text, len);
+
+	DBG_UNLOCK("mut_session");
+	pthread_mutex_unlock(&(session->mut_session));
+
+	if (ret == EXIT_SUCCESS) {
+		/* update stats */
+		session->stats->out_notifications++;
+		if (nc_info) {
+			pthread_rwlock_wrlock(&(nc_info->lock));
+			nc_info->stats.counters.out_notifications++;
+			pthread_rwlock_unlock(&(nc_info->lock));
+		}
+	}
+
+	return (ret);
+}
+
 API NC_MSG_TYPE nc_session_recv_notif(struct nc_session* session, int timeout, nc_ntf** ntf)
 {
 	struct nc_msg *msg_aux, *msg=NULL;
@@ -2749,6 +2976,458 @@ replyerror:
 	return (NC_MSG_NONE); /* message processed internally */
 }
 
+/**
+ * @brief Maximal number of epoll events processed by one epoll_wait() call
+ */
+#define NC_POLL_SET_EVENTS 64
+
+/**
+ * @brief Session registered in the poll set, sessions sharing the same file
+ * descriptor (SSH channels of the same SSH session) are chained.
+ */
+struct nc_poll_set_item {
+	struct nc_session *session;
+	struct nc_poll_set_item *next;
+};
+
+struct nc_session_poll_set {
+	/**< @brief epoll instance watching the sessions' file descriptors */
+	int epfd;
+	/**< @brief lock for the items and ready lists */
+	pthread_mutex_t lock;
+	/**< @brief registered sessions indexed by their file descriptor */
+	struct nc_poll_set_item **items;
+	/**< @brief size of the items array */
+	int items_size;
+	/**< @brief number of the registered sessions */
+	int sessions_count;
+	/**< @brief sessions which can have another message buffered, each at most once */
+	struct nc_session **ready;
+	/**< @brief number of the sessions in the ready list */
+	int ready_count;
+	/**< @brief size of the ready array, always big enough for all the registered sessions */
+	int ready_size;
+};
+
+/**
+ * @brief Get the file descriptor to wait on for the session's input.
+ */
+static int nc_session_input_fd(const struct nc_session* session)
+{
+	if (session->transport_socket != -1) {
+		return (session->transport_socket);
+	} else if (session->fd_input != -1) {
+		return (session->fd_input);
+	}
+#ifndef DISABLE_LIBSSH
+	else if (session->ssh_chan != NULL) {
+		return (ssh_get_fd(ssh_channel_get_session(session->ssh_chan)));
+	}
+#endif
+#ifdef ENABLE_TLS
+	else if (session->tls != NULL) {
+		return (SSL_get_fd(session->tls));
+	}
+#endif
+
+	return (-1);
+}
+
+/**
+ * @brief Check if there is a complete NETCONF message in the session's
+ * receive buffer. Malformed framing is reported as a complete message, the
+ * error is then detected when the message is received.
+ */
+static int nc_session_rbuf_complete(const struct nc_session* session)
+{
+	const char *data, *end;
+	char *aux;
+	unsigned long int chunk_length;
+
+	data = &(session->rbuf[session->rbuf_start]);
+	end = &(session->rbuf[session->rbuf_end]);
+
+	switch (session->version) {
+	case NETCONFV10:
+		return (memmem(data, end - data, NC_V10_END_MSG, strlen(NC_V10_END_MSG)) != NULL);
+	case NETCONFV11:
+		while (1) {
+			/* chunk header "\n#<size>\n" or end of message "\n##\n" */
+			if (end - data < 4) {
+				return (0);
+			}
+			if (data[0] != '\n' || data[1] != '#') {
+				return (1);
+			}
+			if (data[2] == '#') {
+				return (data[3] == '\n');
+			}
+			if (memchr(&(data[2]), '\n', end - &(data[2])) == NULL) {
+				return (0);
+			}
+			chunk_length = strtoul(&(data[2]), &aux, 10);
+			if (chunk_length == 0 || *aux != '\n') {
+				return (1);
+			}
+			if ((unsigned long int) (end - (aux + 1)) < chunk_length) {
+				return (0);
+			}
+			data = aux + 1 + chunk_length;
+		}
+		break;
+	default:
+		return (1);
+	}
+}
+
+/**
+ * @brief Read the data available on the session's transport and check if
+ * a complete message is ready to be received.
+ */
+static int nc_session_poll_set_check(struct nc_session* session, uint32_t events)
+{
+	int ret;
+#ifndef DISABLE_LIBSSH
+	int avail;
+	ssize_t c;
+#endif
+
+	if (session->status != NC_SESSION_STATUS_WORKING) {
+		return (1);
+	}
+	if (events & (EPOLLHUP | EPOLLERR)) {
+		/* let the receive function detect the problem */
+		return (1);
+	}
+#ifdef ENABLE_TLS
+	if (session->tls != NULL) {
+		/*
+		 * SSL_read() could block on an incomplete TLS record, so only the
+		 * beginning of the message is detected here
+		 */
+		return (1);
+	}
+#endif
+
+	DBG_LOCK("mut_channel");
+	pthread_mutex_lock(session->mut_channel);
+	if (nc_session_rbuf_fill(session) < 0) {
+		ret = 1;
+	} else {
+		ret = nc_session_rbuf_complete(session);
+	}
+#ifndef DISABLE_LIBSSH
+	/*
+	 * libssh may have already drained the socket into the channel buffer,
+	 * epoll would not report the rest of the message then
+	 */
+	while (!ret && session->ssh_chan != NULL && (avail = ssh_channel_poll(session->ssh_chan, 0)) != 0) {
+		if (avail < 0 || (c = nc_session_rbuf_fill(session)) < 0) {
+			/* EOF or error, let the receive function detect the problem */
+			ret = 1;
+		} else if (c == 0) {
+			break;
+		} else {
+			ret = nc_session_rbuf_complete(session);
+		}
+	}
+#endif
+	DBG_UNLOCK("mut_channel");
+	pthread_mutex_unlock(session->mut_channel);
+
+	return (ret);
+}
+
+API struct nc_session_poll_set* nc_session_poll_set_new(void)
+{
+	struct nc_session_poll_set *set;
+
+	set = calloc(1, sizeof(struct nc_session_poll_set));
+	if (set == NULL) {
+		ERROR("Memory allocation failed (%s:%d).", __FILE__, __LINE__);
+		return (NULL);
+	}
+
+	set->epfd = epoll_create1(EPOLL_CLOEXEC);
+	if (set->epfd == -1) {
+		ERROR("Creating epoll instance failed (%s).", strerror(errno));
+		free(set);
+		return (NULL);
+	}
+	pthread_mutex_init(&(set->lock), NULL);
+
+	return (set);
+}
+
+API void nc_session_poll_set_free(struct nc_session_poll_set* set)
+{
+	struct nc_poll_set_item *item;
+	int i;
+
+	if (set == NULL) {
+		return;
+	}
+
+	for (i = 0; i < set->items_size; i++) {
+		while (set->items[i] != NULL) {
+			item = set->items[i];
+			set->items[i] = item->next;
+			free(item);
+		}
+	}
+	free(set->items);
+	free(set->ready);
+	close(set->epfd);
+	pthread_mutex_destroy(&(set->lock));
+	free(set);
+}
+
+API int nc_session_poll_set_add(struct nc_session_poll_set* set, struct nc_session* session)
+{
+	struct nc_poll_set_item *item;
+	struct epoll_event ev;
+	void *aux;
+	int fd, size;
+
+	if (set == NULL || session == NULL) {
+		ERROR("%s: Invalid parameters.", __func__);
+		return (EXIT_FAILURE);
+	}
+
+	if ((fd = nc_session_input_fd(session)) == -1) {
+		ERROR("Invalid NETCONF session input file descriptor.");
+		return (EXIT_FAILURE);
+	}
+
+	pthread_mutex_lock(&(set->lock));
+
+	if (fd >= set->items_size) {
+		size = (fd + 1 > 2 * set->items_size) ? fd + 1 : 2 * set->items_size;
+		aux = realloc(set->items, size * sizeof(struct nc_poll_set_item*));
+		if (aux == NULL) {
+			ERROR("Memory reallocation failed (%s:%d).", __FILE__, __LINE__);
+			pthread_mutex_unlock(&(set->lock));
+			return (EXIT_FAILURE);
+		}
+		set->items = aux;
+		memset(&(set->items[set->items_size]), 0, (size - set->items_size) * sizeof(struct nc_poll_set_item*));
+		set->items_size = size;
+	}
+
+	for (item = set->items[fd]; item != NULL; item = item->next) {
+		if (item->session == session) {
+			ERROR("%s: session %s is already in the poll set.", __func__, session->session_id);
+			pthread_mutex_unlock(&(set->lock));
+			return (EXIT_FAILURE);
+		}
+	}
+
+	/* the ready list never has to drop a session then */
+	if (set->ready_size == set->sessions_count) {
+		size = (set->ready_size == 0) ? NC_POLL_SET_EVENTS : 2 * set->ready_size;
+		aux = realloc(set->ready, size * sizeof(struct nc_session*));
+		if (aux == NULL) {
+			ERROR("Memory reallocation failed (%s:%d).", __FILE__, __LINE__);
+			pthread_mutex_unlock(&(set->lock));
+			return (EXIT_FAILURE);
+		}
+		set->ready = aux;
+		set->ready_size = size;
+	}
+
+	if (set->items[fd] == NULL) {
+		/* the first session on the file descriptor */
+		ev.events = EPOLLIN;
+		ev.data.fd = fd;
+		if (epoll_ctl(set->epfd, EPOLL_CTL_ADD, fd, &ev) == -1) {
+			ERROR("Adding file descriptor into epoll failed (%s).", strerror(errno));
+			pthread_mutex_unlock(&(set->lock));
+			return (EXIT_FAILURE);
+		}
+	}
+
+	if ((item = malloc(sizeof(struct nc_poll_set_item))) == NULL) {
+		ERROR("Memory allocation failed (%s:%d).", __FILE__, __LINE__);
+		if (set->items[fd] == NULL) {
+			epoll_ctl(set->epfd, EPOLL_CTL_DEL, fd, NULL);
+		}
+		pthread_mutex_unlock(&(set->lock));
+		return (EXIT_FAILURE);
+	}
+	item->session = session;
+	item->next = set->items[fd];
+	set->items[fd] = item;
+	set->sessions_count++;
+
+	/* the session can already have some data buffered */
+	set->ready[set->ready_count++] = session;
+
+	pthread_mutex_unlock(&(set->lock));
+	return (EXIT_SUCCESS);
+}
+
+API int nc_session_poll_set_remove(struct nc_session_poll_set* set, struct nc_session* session)
+{
+	struct nc_poll_set_item *item = NULL, *prev = NULL;
+	int fd, i;
+
+	if (set == NULL || session == NULL) {
+		ERROR("%s: Invalid parameters.", __func__);
+		return (EXIT_FAILURE);
+	}
+
+	pthread_mutex_lock(&(set->lock));
+
+	/* the session's file descriptor can be already closed, so find it */
+	for (fd = 0; fd < set->items_size; fd++) {
+		for (prev = NULL, item = set->items[fd]; item != NULL; prev = item, item = item->next) {
+			if (item->session == session) {
+				break;
+			}
+		}
+		if (item != NULL) {
+			break;
+		}
+	}
+	if (item == NULL) {
+		pthread_mutex_unlock(&(set->lock));
+		return (EXIT_FAILURE);
+	}
+
+	if (prev == NULL) {
+		set->items[fd] = item->next;
+	} else {
+		prev->next = item->next;
+	}
+	free(item);
+	set->sessions_count--;
+	if (set->items[fd] == NULL) {
+		/* it fails if the descriptor was already closed, but then it is removed from epoll anyway */
+		epoll_ctl(set->epfd, EPOLL_CTL_DEL, fd, NULL);
+	}
+
+	for (i = 0; i < set->ready_count; i++) {
+		if (set->ready[i] == session) {
+			set->ready[i] = set->ready[--set->ready_count];
+			break;
+		}
+	}
+
+	pthread_mutex_unlock(&(set->lock));
+	return (EXIT_SUCCESS);
+}
+
+API int nc_session_poll_set_wait(struct nc_session_poll_set* set, int timeout, struct nc_session** sessions, int count)
+{
+	struct epoll_event events[NC_POLL_SET_EVENTS];
+	struct nc_poll_set_item *item;
+	struct nc_session *session;
+	struct timespec deadline, now;
+	int i, j, n = 0, r, wait, buffered;
+
+	if (set == NULL || sessions == NULL || count <= 0) {
+		ERROR("%s: Invalid parameters.", __func__);
+		return (-1);
+	}
+
+	if (timeout > 0) {
+		clock_gettime(CLOCK_MONOTONIC, &deadline);
+		deadline.tv_sec += timeout / 1000;
+		deadline.tv_nsec += (timeout % 1000) * 1000000;
+		if (deadline.tv_nsec >= 1000000000) {
+			deadline.tv_sec++;
+			deadline.tv_nsec -= 1000000000;
+		}
+	}
+
+	/*
+	 * sessions returned by the previous calls can have another message already
+	 * buffered, they are forgotten only when their buffer is empty since epoll
+	 * reports only the data not read yet
+	 */
+	pthread_mutex_lock(&(set->lock));
+	for (i = 0; i < set->ready_count;) {
+		session = set->ready[i];
+		DBG_LOCK("mut_channel");
+		pthread_mutex_lock(session->mut_channel);
+		buffered = (session->rbuf_start != session->rbuf_end);
+		if (buffered && n < count && nc_session_rbuf_complete(session)) {
+			sessions[n++] = session;
+		}
+		DBG_UNLOCK("mut_channel");
+		pthread_mutex_unlock(session->mut_channel);
+
+		if (buffered) {
+			i++;
+		} else {
+			set->ready[i] = set->ready[--set->ready_count];
+		}
+	}
+	pthread_mutex_unlock(&(set->lock));
+
+	do {
+		if (n == count) {
+			/* no space left for the sessions reported by epoll */
+			break;
+		} else if (n > 0 || timeout == 0) {
+			wait = 0;
+		} else if (timeout < 0) {
+			wait = -1;
+		} else {
+			clock_gettime(CLOCK_MONOTONIC, &now);
+			wait = (deadline.tv_sec - now.tv_sec) * 1000 + (deadline.tv_nsec - now.tv_nsec) / 1000000;
+			if (wait < 0) {
+				wait = 0;
+			}
+		}
+
+		r = epoll_wait(set->epfd, events, (count - n < NC_POLL_SET_EVENTS) ? count - n : NC_POLL_SET_EVENTS, wait);
+		if (r == -1) {
+			if (errno == EINTR) {
+				continue;
+			}
+			ERROR("Waiting on epoll failed (%s).", strerror(errno));
+			return (-1);
+		}
+
+		pthread_mutex_lock(&(set->lock));
+		for (i = 0; i < r; i++) {
+			if (events[i].data.fd >= set->items_size) {
+				/* removed in the meantime */
+				continue;
+			}
+			for (item = set->items[events[i].data.fd]; item != NULL && n < count; item = item->next) {
+				for (j = 0; j < n; j++) {
+					if (sessions[j] == item->session) {
+						break;
+					}
+				}
+				if (j == n && nc_session_poll_set_check(item->session, events[i].events)) {
+					sessions[n++] = item->session;
+				}
+			}
+		}
+		pthread_mutex_unlock(&(set->lock));
+	} while (n == 0 && wait != 0);
+
+	/* remember the returned sessions for the next call next to the still buffered ones */
+	pthread_mutex_lock(&(set->lock));
+	for (j = 0; j < n; j++) {
+		for (i = 0; i < set->ready_count; i++) {
+			if (set->ready[i] == sessions[j]) {
+				break;
+			}
+		}
+		/* the array is full only if the session was removed from the set in the meantime */
+		if (i == set->ready_count && set->ready_count < set->ready_size) {
+			set->ready[set->ready_count++] = sessions[j];
+		}
+	}
+	pthread_mutex_unlock(&(set->lock));
+
+	return (n);
+}
+
 API const nc_msgid nc_session_send_rpc(struct nc_session* session, nc_rpc *rpc)
 {
 	int ret;
@@ -345,6 +345,82 @@ int nc_session_send_notif(struct nc_session* session, const nc_ntf* ntf);
  */
 NC_MSG_TYPE nc_session_recv_rpc(struct nc_session* session, int timeout, nc_rpc** rpc);
 
+/**
+ * @ingroup session
+ * @brief Set of NETCONF sessions to wait for incoming messages on all of them
+ * at once.
+ *
+ * It allows a server to serve many sessions from a single thread instead of
+ * calling nc_session_recv_rpc() on each of them with a small timeout.
+ */
+struct nc_session_poll_set;
+
+/**
+ * @ingroup session
+ * @brief Create an empty set of sessions to wait on.
+ *
+ * @return Created set, NULL on error.
+ */
+struct nc_session_poll_set* nc_session_poll_set_new(void);
+
+/**
+ * @ingroup session
+ * @brief Free the set of sessions. The sessions themselves are not affected.
+ *
+ * @param[in] set Set to free.
+ */
+void nc_session_poll_set_free(struct nc_session_poll_set* set);
+
+/**
+ * @ingroup session
+ * @brief Add the NETCONF session into the set.
+ *
+ * Sessions sharing the same transport (more NETCONF sessions on the SSH
+ * channels of a single SSH session) can be added too.
+ *
+ * @param[in] set Set to add the session into.
+ * @param[in] session NETCONF session after the successful handshake.
+ * @return 0 on success, non-zero on error.
+ */
+int nc_session_poll_set_add(struct nc_session_poll_set* set, struct nc_session* session);
+
+/**
+ * @ingroup session
+ * @brief Remove the NETCONF session from the set.
+ *
+ * The session must be removed before it is freed by nc_session_free().
+ *
+ * @param[in] set Set to remove the session from.
+ * @param[in] session NETCONF session to remove.
+ * @return 0 on success, non-zero if the session is not in the set.
+ */
+int nc_session_poll_set_remove(struct nc_session_poll_set* set, struct nc_session* session);
+
+/**
+ * @ingroup session
+ * @brief Wait for the sessions with a complete message ready to be received.
+ *
+ * The data available on the sessions' transports are read into the sessions'
+ * internal buffers and only the sessions with a complete message are returned,
+ * so the subsequent nc_session_recv_rpc() call does not block. Sessions that
+ * got closed or failed are returned too and their nc_session_recv_rpc() call
+ * reports the problem. TLS sessions are returned as soon as the beginning of
+ * the message is available.
+ *
+ * The caller is supposed to receive the message from all the returned
+ * sessions before the next call. A session can have more messages already
+ * buffered, it is returned again by the next call in such a case.
+ *
+ * @param[in] set Set of sessions to wait on.
+ * @param[in] timeout Timeout in milliseconds, -1 for infinite timeout, 0 for
+ * non-blocking.
+ * @param[out] sessions Array to store the ready sessions into.
+ * @param[in] count Size of the sessions array.
+ * @return Number of sessions stored into the sessions array, 0 on timeout
+ * and -1 on error.
+ */
+int nc_session_poll_set_wait(struct nc_session_poll_set* set, int timeout, struct nc_session** sessions, int count);
+
 /**
  * @ingroup reply
  * @brief Receive \<rpc-reply\> response from the specified NETCONF session.
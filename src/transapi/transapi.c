@@ -374,13 +374,13 @@ static int transapi_apply_callbacks_recursive(const struct transapi_callbacks_in
 }
 
 /* will be called by library after change in running datastore */
-int transapi_running_changed(struct ncds_ds* ds, xmlDocPtr old_doc, xmlDocPtr new_doc, NC_EDIT_ERROPT_TYPE erropt, struct nc_err **error)
+int transapi_running_changed(struct ncds_ds* ds, xmlDocPtr old_doc, xmlDocPtr new_doc, const struct edit_record* record, NC_EDIT_ERROPT_TYPE erropt, struct nc_err **error)
 {
 	struct xmldiff_tree* diff = NULL, *iter;
 	struct transapi_callbacks_info info;
 	int ret = 0;
 
-	if (xmldiff_diff(&diff, old_doc, new_doc, ds->ext_model_tree) == XMLDIFF_ERR) { /* failed to create diff list */
+	if (xmldiff_diff(&diff, old_doc, new_doc, ds->ext_model_tree, record) == XMLDIFF_ERR) { /* failed to create diff list */
 		ERROR("Model \"%s\" transAPI: failed to create the tree of differences.", ds->data_model->name);
 		xmldiff_free(diff);
 		return EXIT_FAILURE;
@@ -391,22 +391,19 @@ int transapi_running_changed(struct ncds_ds* ds, xmlDocPtr old_doc, xmlDocPtr ne
 			info.old = old_doc;
 			info.new = new_doc;
 			info.model = ds->ext_model;
-			info.keys = get_keynode_list(info.model);
+			info.keys = ds->ext_model_keys;
 			info.order = ds->transapis->tapi->clbks_order;
 			info.transapis = ds->transapis;
 
 			for (iter = diff; iter != NULL; iter = iter->next) {
 				ret += transapi_apply_callbacks_recursive(&info, iter, erropt, error);
 				/* callbacks actually can also change datastore's data model by adding augment */
-				if (info.model != ds->ext_model) {
-					/* the model is changed, we are not going to use it anymore, but
-					 * keys created from the released model are invalid and freeing
-					 * it can cause segmentation fault, so fix it
+				if (info.model != ds->ext_model || info.keys != ds->ext_model_keys) {
+					/* the model is changed, keys compiled from the released
+					 * model are invalid, so use the current ones
 					 */
-					if (info.keys || info.keys->nodesetval) {
-						info.keys->nodesetval->nodeNr = 0;
-					}
 					info.model = ds->ext_model;
+					info.keys = ds->ext_model_keys;
 				}
 			}
 
@@ -418,11 +415,9 @@ int transapi_running_changed(struct ncds_ds* ds, xmlDocPtr old_doc, xmlDocPtr ne
 					}
 				}
 
-				keyListFree(info.keys);
 				xmldiff_free(diff);
 				return EXIT_FAILURE;
 			}
-			keyListFree(info.keys);
 		}
 	} else {
 		VERB("Model \"%s\" transAPI: nothing changed.", ds->data_model->name);
@@ -59,6 +59,8 @@ typedef enum
 
 #define PRIORITY_NONE -1
 
+struct edit_record;
+
 /**
  * @ingroup transapi
  * @brief Top level function of transaction API. Finds differences between old_doc and new_doc and calls specified callbacks.
@@ -66,10 +68,12 @@ typedef enum
  * @param[in] ds NETCONF datastore structure for access transAPI connected with this datastore
  * @param[in] old_doc Content of configuration datastore before change.
  * @param[in] new_doc Content of configuration datastore after change.
+ * @param[in] record Record of the edit-config which made the change, NULL to
+ * compare the whole documents.
  * @param[in] libxml2 Specify if the module uses libxml2 API
  *
  * @return EXIT_SUCESS or EXIT_FAILURE
  */
-int transapi_running_changed(struct ncds_ds* ds, xmlDocPtr old_doc, xmlDocPtr new_doc, NC_EDIT_ERROPT_TYPE erropt, struct nc_err **error);
+int transapi_running_changed(struct ncds_ds* ds, xmlDocPtr old_doc, xmlDocPtr new_doc, const struct edit_record* record, NC_EDIT_ERROPT_TYPE erropt, struct nc_err **error);
 
 #endif /* NC_TRANSAPI_INTERNAL_H_ */
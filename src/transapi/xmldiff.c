@@ -6,12 +6,14 @@
 
 #include <libxml/tree.h>
 #include <libxml/parser.h>
+#include <libxml/hash.h>
 
 #include "netconf_internal.h"
 #include "xmldiff.h"
 #include "../transapi.h"
 #include "yinparser.h"
 #include "transapi_internal.h"
+#include "../datastore/edit_config.h"
 
 /* adds a priority into priority buffer structure */
 static void xmldiff_add_priority(int prio, struct xmldiff_prio** prios)
@@ -392,6 +394,56 @@ static int node_cmp(xmlNodePtr node1, xmlNodePtr node2)
 	return(ret);
 }
 
+/*
+ * @brief Get the key tuple identifying the list instance. Every key value is
+ * prefixed by its length, so the tuples of different instances cannot be
+ * equal by accident, a missing key is marked as "-".
+ *
+ * @param node	List instance.
+ * @param model	Model of the list.
+ *
+ * @return Key tuple to be freed by the caller, NULL on error.
+ */
+static xmlChar* list_node_keys(xmlNodePtr node, struct model_tree * model)
+{
+	int i;
+	char len[16];
+	xmlNodePtr node_tmp;
+	xmlChar* tmp_str, *keys;
+	xmlBufferPtr buf;
+
+	if ((buf = xmlBufferCreate()) == NULL) {
+		ERROR("Memory allocation failed (%s:%d - %s).", __FILE__, __LINE__, strerror(errno));
+		return (NULL);
+	}
+
+	for (i = 0; i < model->keys_count; i++) { /* For every specified key */
+		for (node_tmp = node->children; node_tmp != NULL; node_tmp = node_tmp->next) {
+			if (xmlStrEqual(node_tmp->name, BAD_CAST model->keys[i])) { /* Find matching leaf */
+				break;
+			}
+		}
+		if (node_tmp == NULL) {
+			xmlBufferCCat(buf, "-");
+			continue;
+		}
+		tmp_str = xmlNodeGetContent(node_tmp);
+		snprintf(len, sizeof len, "%d:", xmlStrlen(tmp_str));
+		xmlBufferCCat(buf, len);
+		if (tmp_str != NULL) {
+			xmlBufferCat(buf, tmp_str);
+		}
+		xmlFree(tmp_str);
+	}
+
+	if ((keys = xmlStrdup(xmlBufferContent(buf) != NULL ? xmlBufferContent(buf) : BAD_CAST "")) == NULL) {
+		ERROR("Memory allocation failed (%s:%d - %s).", __FILE__, __LINE__, strerror(errno));
+	}
+	xmlBufferFree(buf);
+
+	return (keys);
+}
+
 /*
  * @brief Return EXIT_SUCCESS if node1 and node2 have same name, are in the same namespace and
  * have the same key values.
@@ -403,55 +455,15 @@ static int node_cmp(xmlNodePtr node1, xmlNodePtr node2)
  */
 static int list_node_cmp(xmlNodePtr node1, xmlNodePtr node2, struct model_tree * model)
 {
-	int i, ret = EXIT_FAILURE;
-	xmlNodePtr node_tmp;
-	xmlChar * tmp_str, *node1_keys, *node2_keys, *new_keys;
+	int ret = EXIT_FAILURE;
+	xmlChar *node1_keys, *node2_keys;
 
 	if (node_cmp(node1, node2) == EXIT_SUCCESS) {
-		/* For every old node create string holding the concatenated key values */
-		node1_keys = BAD_CAST strdup ("");
-		node2_keys = BAD_CAST strdup ("");
-		for (i=0; i<model->keys_count; i++) { /* For every specified key */
-			node_tmp = node1->children;
-			while (node_tmp) {
-				if (xmlStrEqual(node_tmp->name, BAD_CAST model->keys[i])) { /* Find matching leaf in old document */
-					tmp_str = xmlNodeGetContent (node_tmp);
-					new_keys  = realloc (node1_keys, sizeof(char) * (strlen((const char*)node1_keys)+strlen((const char*)tmp_str)+1));
-					if (new_keys == NULL) {
-						ERROR("Memory allocation failed (%s:%d - %s).", __FILE__, __LINE__, strerror(errno));
-						ret = EXIT_FAILURE;
-						goto cleanup;
-					}
-					node1_keys = new_keys;
-					strcat((char*)node1_keys, (char*)tmp_str); /* Concatenate key value */
-					xmlFree(tmp_str);
-					break;
-				}
-				node_tmp = node_tmp->next;
-			}
-			node_tmp = node2->children;
-			while (node_tmp) {
-				if (xmlStrEqual(node_tmp->name, BAD_CAST model->keys[i])) { /* Find matching leaf in old document */
-					tmp_str = xmlNodeGetContent (node_tmp);
-					new_keys = realloc (node2_keys, sizeof(char) * (strlen((const char*)node2_keys)+strlen((const char*)tmp_str)+1));
-					if (new_keys == NULL) {
-						ERROR("Memory allocation failed (%s:%d - %s).", __FILE__, __LINE__, strerror(errno));
-						ret = EXIT_FAILURE;
-						goto cleanup;
-					}
-					node2_keys = new_keys;
-					strcat ((char*)node2_keys, (char*)tmp_str); /* Concatenate key value */
-					xmlFree (tmp_str);
-					break;
-				}
-				node_tmp = node_tmp->next;
-			}
-		}
-		if (xmlStrEqual(node1_keys, node2_keys)) {
+		node1_keys = list_node_keys(node1, model);
+		node2_keys = list_node_keys(node2, model);
+		if (node1_keys != NULL && node2_keys != NULL && xmlStrEqual(node1_keys, node2_keys)) {
 			ret = EXIT_SUCCESS;
 		}
-
-cleanup:
 		xmlFree(node1_keys);
 		xmlFree(node2_keys);
 	}
@@ -459,7 +471,39 @@ cleanup:
 	return(ret);
 }
 
-static XMLDIFF_OP xmldiff_list(struct xmldiff_tree** diff, char * path, xmlNodePtr old_tmp, xmlNodePtr new_tmp, struct model_tree * model);
+/*
+ * @brief Remember the node in the set of nodes (hash table keyed by the node
+ * address), the set is created with its first node.
+ */
+static int node_set_add(xmlHashTablePtr* set, xmlNodePtr node)
+{
+	char id[2 * sizeof(void*) + 3];
+
+	if (*set == NULL && (*set = xmlHashCreate(16)) == NULL) {
+		ERROR("Memory allocation failed (%s:%d - %s).", __FILE__, __LINE__, strerror(errno));
+		return (EXIT_FAILURE);
+	}
+
+	snprintf(id, sizeof id, "%p", (void*)node);
+	return (xmlHashAddEntry(*set, BAD_CAST id, node) == 0 ? EXIT_SUCCESS : EXIT_FAILURE);
+}
+
+/*
+ * @brief Check whether the node is in the set of nodes.
+ */
+static int node_set_has(xmlHashTablePtr set, xmlNodePtr node)
+{
+	char id[2 * sizeof(void*) + 3];
+
+	if (set == NULL) {
+		return (0);
+	}
+
+	snprintf(id, sizeof id, "%p", (void*)node);
+	return (xmlHashLookup(set, BAD_CAST id) != NULL);
+}
+
+static XMLDIFF_OP xmldiff_list(struct xmldiff_tree** diff, char * path, xmlNodePtr old_tmp, xmlNodePtr new_tmp, struct model_tree * model, const struct edit_record* record);
 static XMLDIFF_OP xmldiff_leaflist(struct xmldiff_tree** diff, char * path, xmlNodePtr old_tmp, xmlNodePtr new_tmp, struct model_tree * model);
 
 /**
@@ -471,8 +515,9 @@ static XMLDIFF_OP xmldiff_leaflist(struct xmldiff_tree** diff, char * path, xmlN
  * @param old_node	current node (or sibling) in the old configuration
  * @param new_node	current node (or sibling) in the new configuration
  * @param model	current node in the model
+ * @param record	record of the edit-config, subtrees not touched by it are skipped
  */
-static XMLDIFF_OP xmldiff_recursive(struct xmldiff_tree** diff, char * path, xmlNodePtr old_node, xmlNodePtr new_node, struct model_tree * model)
+static XMLDIFF_OP xmldiff_recursive(struct xmldiff_tree** diff, char * path, xmlNodePtr old_node, xmlNodePtr new_node, struct model_tree * model, const struct edit_record* record)
 {
 	char * next_path;
 	xmlNodePtr old_tmp, new_tmp;
@@ -529,6 +574,10 @@ static XMLDIFF_OP xmldiff_recursive(struct xmldiff_tree** diff, char * path, xml
 			ret_op = XMLDIFF_ADD;
 		} else if (new_tmp == NULL) {
 			ret_op = XMLDIFF_REM;
+		} else if (!edit_record_touched(record, old_tmp)) {
+			/* the edit did not get here, nothing changed */
+			ret_op = XMLDIFF_NONE;
+			break;
 		} else {
 			ret_op = XMLDIFF_NONE;
 		}
@@ -541,7 +590,7 @@ static XMLDIFF_OP xmldiff_recursive(struct xmldiff_tree** diff, char * path, xml
 				free(tmp_diff);
 				return (XMLDIFF_ERR);
 			}
-			tmp_op = xmldiff_recursive(tmp_diff, next_path, (old_tmp ? old_tmp->children : NULL), (new_tmp ? new_tmp->children : NULL), &model->children[i]);
+			tmp_op = xmldiff_recursive(tmp_diff, next_path, (old_tmp ? old_tmp->children : NULL), (new_tmp ? new_tmp->children : NULL), &model->children[i], record);
 			free(next_path);
 
 			if (tmp_op == XMLDIFF_ERR) {
@@ -582,7 +631,7 @@ static XMLDIFF_OP xmldiff_recursive(struct xmldiff_tree** diff, char * path, xml
 				return (XMLDIFF_ERR);
 			}
 			/* We are moving down the model only (not in the configuration) */
-			tmp_op = xmldiff_recursive(diff, next_path, old_node, new_node, &model->children[i]);
+			tmp_op = xmldiff_recursive(diff, next_path, old_node, new_node, &model->children[i], record);
 			free(next_path);
 
 			if (tmp_op == XMLDIFF_ERR) {
@@ -619,7 +668,7 @@ static XMLDIFF_OP xmldiff_recursive(struct xmldiff_tree** diff, char * path, xml
 
 	/* -- LIST -- */
 	case YIN_TYPE_LIST:
-		ret_op = xmldiff_list(diff, path, old_tmp, new_tmp, model);
+		ret_op = xmldiff_list(diff, path, old_tmp, new_tmp, model, record);
 		break;
 
 	/* -- LEAFLIST -- */
@@ -665,103 +714,70 @@ static XMLDIFF_OP xmldiff_recursive(struct xmldiff_tree** diff, char * path, xml
 	return ret_op;
 }
 
-static XMLDIFF_OP xmldiff_list(struct xmldiff_tree** diff, char * path, xmlNodePtr old_tmp, xmlNodePtr new_tmp, struct model_tree * model)
+static XMLDIFF_OP xmldiff_list(struct xmldiff_tree** diff, char * path, xmlNodePtr old_tmp, xmlNodePtr new_tmp, struct model_tree * model, const struct edit_record* record)
 {
 	XMLDIFF_OP item_ret_op, tmp_op, ret_op = XMLDIFF_NONE;
-	xmlNodePtr* list_added = NULL, *list_removed = NULL, *realloc_tmp;
-	xmlNodePtr list_old_tmp, list_new_tmp, list_old_inter, list_new_inter;
-	xmlChar* old_keys, *new_keys, *old_str, *new_str, *aux_str;
+	xmlHashTablePtr old_instances = NULL, new_instances = NULL, list_added = NULL, list_removed = NULL;
+	xmlNodePtr list_old_tmp, list_new_tmp;
+	xmlChar** new_keys = NULL, *old_keys;
 	struct xmldiff_tree** tmp_diff;
-	int i, list_added_cnt = 0, list_removed_cnt = 0;
+	int i, j, new_cnt = 0;
 	char* next_path;
 
 	/* Find matches according to the key elements, process all the elements inside recursively */
 	/* Not matching are _ADD or _REM */
 	/* Maching are _NONE or _CHAIN, according to the return values of the recursive calls */
 
+	/* Instances are bucketed by their key tuples (the first instance of
+	 * a tuple wins), so the lists are not compared pair by pair */
+	for (list_new_tmp = new_tmp; list_new_tmp != NULL; list_new_tmp = list_new_tmp->next) {
+		if (node_cmp(new_tmp, list_new_tmp) == EXIT_SUCCESS) {
+			new_cnt++;
+		}
+	}
+	if ((new_keys = calloc(new_cnt + 1, sizeof(xmlChar*))) == NULL ||
+			(old_instances = xmlHashCreate(new_cnt + 1)) == NULL || (new_instances = xmlHashCreate(new_cnt + 1)) == NULL) {
+		ERROR("Memory allocation failed (%s:%d - %s).", __FILE__, __LINE__, strerror(errno));
+		ret_op = XMLDIFF_ERR;
+		goto cleanup;
+	}
+
+	/* Hash the new nodes according to their key values */
+	for (list_new_tmp = new_tmp, j = 0; list_new_tmp != NULL; list_new_tmp = list_new_tmp->next) {
+		if (node_cmp(new_tmp, list_new_tmp)) {
+			continue;
+		}
+		if ((new_keys[j] = list_node_keys(list_new_tmp, model)) == NULL) {
+			ret_op = XMLDIFF_ERR;
+			goto cleanup;
+		}
+		xmlHashAddEntry(new_instances, new_keys[j++], list_new_tmp);
+	}
+
 	/* ---REM--- Go through the old nodes and search for matching nodes in the new document*/
-	list_old_tmp = old_tmp;
-	while (list_old_tmp) {
+	for (list_old_tmp = old_tmp; list_old_tmp != NULL; list_old_tmp = list_old_tmp->next) {
 		/* We have to make sure that this really is a list node we are checking now */
 		if (node_cmp(old_tmp, list_old_tmp)) {
-			list_old_tmp = list_old_tmp->next;
 			continue;
 		}
 
 		item_ret_op = XMLDIFF_NONE;
-		/* For every old node create string holding the concatenated key values */
-		old_keys = BAD_CAST strdup("");
-		for (i=0; i<model->keys_count; i++) { /* For every specified key */
-			list_old_inter = list_old_tmp->children;
-			while (list_old_inter) {
-				if (xmlStrEqual(list_old_inter->name, BAD_CAST model->keys[i])) { /* Find matching leaf in old document */
-					old_str = xmlNodeGetContent(list_old_inter);
-					aux_str  = realloc(old_keys, sizeof(xmlChar) * (xmlStrlen(old_keys)+xmlStrlen(old_str)+1));
-					if (aux_str == NULL) {
-						ERROR("Memory allocation failed (%s:%d - %s).", __FILE__, __LINE__, strerror(errno));
-						xmlFree(old_str);
-						xmlFree(old_keys);
-						return (XMLDIFF_ERR);
-					}
-					old_keys = aux_str;
-					strcat((char*)old_keys, (char*)old_str); /* Concatenate key value */
-					xmlFree(old_str);
-					break;
-				}
-				list_old_inter = list_old_inter->next;
-			}
-		}
-
-		/* Go through the new list */
-		list_new_tmp = new_tmp;
-		while (list_new_tmp) {
-			if (node_cmp(old_tmp, list_new_tmp)) {
-				list_new_tmp = list_new_tmp->next;
-				continue;
-			}
-
-			new_keys = BAD_CAST strdup("");
-			for (i = 0; i < model->keys_count; i++) {
-				list_new_inter = list_new_tmp->children;
-				while (list_new_inter) {
-					if (xmlStrEqual(list_new_inter->name, BAD_CAST model->keys[i])) {
-						new_str = xmlNodeGetContent(list_new_inter);
-						aux_str  = realloc(new_keys, sizeof(xmlChar) * (xmlStrlen(new_keys)+xmlStrlen(new_str)+1));
-						if (aux_str == NULL) {
-							ERROR("Memory allocation failed (%s:%d - %s).", __FILE__, __LINE__, strerror(errno));
-							xmlFree(new_keys);
-							xmlFree(new_str);
-							return (XMLDIFF_ERR);
-						}
-						new_keys = aux_str;
-						strcat((char*)new_keys, (char*)new_str);
-						xmlFree(new_str);
-						break;
-					}
-					list_new_inter = list_new_inter->next;
-				}
-			}
-			if (strcmp((const char*)old_keys, (const char*)new_keys) == 0) { /* Matching item found */
-				xmlFree(new_keys);
-				break;
-			}
-			xmlFree(new_keys);
-			list_new_tmp = list_new_tmp->next;
+		/* For every old node get the key values and find the new node with the same ones */
+		if ((old_keys = list_node_keys(list_old_tmp, model)) == NULL) {
+			ret_op = XMLDIFF_ERR;
+			goto cleanup;
 		}
+		list_new_tmp = xmlHashLookup(new_instances, old_keys);
+		xmlHashAddEntry(old_instances, old_keys, list_old_tmp);
 		xmlFree(old_keys);
 
 		if (list_new_tmp == NULL) { /* Item NOT found in the new document -> removed */
 			xmldiff_add_diff_recursive(diff, path, list_old_tmp, list_new_tmp, XMLDIFF_REM, XML_SIBLING, model);
 			ret_op = XMLDIFF_REM;
 			/* Remember that the node was removed */
-			if ((realloc_tmp = realloc(list_removed, ++list_removed_cnt * sizeof(xmlNodePtr))) == NULL) {
-				ERROR("Memory reallocation failed (%s:%d - %s).", __FILE__, __LINE__, strerror(errno));
-				free(list_removed);
-				return (XMLDIFF_ERR);
-			} else {
-				list_removed = realloc_tmp;
-				list_removed[list_removed_cnt-1] = list_old_tmp;
-			}
+			node_set_add(&list_removed, list_old_tmp);
+		} else if (!edit_record_touched(record, list_old_tmp)) {
+			/* Item not touched by the edit -> no changes inside */
 		} else { /* Item found -> check for changes recursively */
 			tmp_diff = malloc(sizeof(struct xmldiff_tree*));
 			*tmp_diff = NULL;
@@ -769,14 +785,16 @@ static XMLDIFF_OP xmldiff_list(struct xmldiff_tree** diff, char * path, xmlNodeP
 				if (asprintf(&next_path, "%s/%s:%s", path, model->children[i].ns_prefix, model->children[i].name) == -1) {
 					ERROR("asprintf() failed (%s:%d).", __FILE__, __LINE__);
 					free(tmp_diff);
-					return (XMLDIFF_ERR);
+					ret_op = XMLDIFF_ERR;
+					goto cleanup;
 				}
-				tmp_op = xmldiff_recursive(tmp_diff, next_path, list_old_tmp->children, list_new_tmp->children, &model->children[i]);
+				tmp_op = xmldiff_recursive(tmp_diff, next_path, list_old_tmp->children, list_new_tmp->children, &model->children[i], record);
 				free(next_path);
 
 				if (tmp_op == XMLDIFF_ERR) {
 					free(tmp_diff);
-					return (XMLDIFF_ERR);
+					ret_op = XMLDIFF_ERR;
+					goto cleanup;
 				} else {
 					item_ret_op |= tmp_op;
 				}
@@ -800,94 +818,22 @@ static XMLDIFF_OP xmldiff_list(struct xmldiff_tree** diff, char * path, xmlNodeP
 			}
 			free(tmp_diff);
 		}
-		list_old_tmp = list_old_tmp->next;
 	}
 
 	/* ---ADD--- Go through the new nodes and search for matching nodes in the old document */
-	list_new_tmp = new_tmp;
-	while (list_new_tmp) {
+	for (list_new_tmp = new_tmp, j = 0; list_new_tmp != NULL; list_new_tmp = list_new_tmp->next) {
 		if (node_cmp(new_tmp, list_new_tmp)) {
-			list_new_tmp = list_new_tmp->next;
 			continue;
 		}
 
-		item_ret_op = XMLDIFF_NONE;
-		/* For every new node create string holding the concatenated key values */
-		new_keys = BAD_CAST strdup ("");
-		for (i = 0; i < model->keys_count; i++) { /* For every specified key */
-			list_new_inter = list_new_tmp->children;
-			while (list_new_inter) {
-				if (xmlStrEqual(list_new_inter->name, BAD_CAST model->keys[i])) { /* Find matching leaf in the old document */
-					new_str = xmlNodeGetContent(list_new_inter);
-					aux_str = realloc(new_keys, sizeof(xmlChar*) * (xmlStrlen(new_keys)+xmlStrlen(new_str)+1));
-					if (aux_str == NULL) {
-						ERROR("Memory allocation failed (%s:%d - %s).", __FILE__, __LINE__, strerror(errno));
-						xmlFree(new_keys);
-						xmlFree(new_str);
-						return (XMLDIFF_ERR);
-					}
-					new_keys = aux_str;
-					strcat((char*)new_keys, (char*)new_str); /* Concatenate key value */
-					xmlFree(new_str);
-					break;
-				}
-				list_new_inter = list_new_inter->next;
-			}
-		}
-		/* Go through the new list */
-		list_old_tmp = old_tmp;
-		while (list_old_tmp) {
-			if (node_cmp(new_tmp, list_old_tmp)) {
-				list_old_tmp = list_old_tmp->next;
-				continue;
-			}
-
-			old_keys = BAD_CAST strdup ("");
-			for (i = 0; i < model->keys_count; i++) {
-				list_old_inter = list_old_tmp->children;
-				while (list_old_inter) {
-					if (xmlStrEqual(list_old_inter->name, BAD_CAST model->keys[i])) {
-						old_str = xmlNodeGetContent(list_old_inter);
-						aux_str = realloc(old_keys, sizeof(xmlChar) * (xmlStrlen(old_keys)+xmlStrlen(old_str)+1));
-						if (aux_str == NULL) {
-							ERROR("Memory allocation failed (%s:%d - %s).", __FILE__, __LINE__, strerror(errno));
-							xmlFree(old_keys);
-							xmlFree(old_str);
-							return (XMLDIFF_ERR);
-						}
-						old_keys = aux_str;
-						strcat((char*)old_keys, (char*)old_str);
-						xmlFree(old_str);
-						break;
-					}
-					list_old_inter = list_old_inter->next;
-				}
-			}
-			if (strcmp((const char*)old_keys, (const char*)new_keys) == 0) { /* Matching item found */
-				free(old_keys);
-				break;
-			}
-			xmlFree(old_keys);
-			list_old_tmp = list_old_tmp->next;
-		}
-		xmlFree(new_keys);
-
-		if (list_old_tmp == NULL) { /* Item NOT found in the old document -> added */
-			xmldiff_add_diff_recursive(diff, path, list_old_tmp, list_new_tmp, XMLDIFF_ADD, XML_SIBLING, model);
+		if (xmlHashLookup(old_instances, new_keys[j++]) == NULL) { /* Item NOT found in the old document -> added */
+			xmldiff_add_diff_recursive(diff, path, NULL, list_new_tmp, XMLDIFF_ADD, XML_SIBLING, model);
 			ret_op = XMLDIFF_ADD;
 			/* Remember that the node was added */
-			if ((realloc_tmp = realloc(list_added, ++list_added_cnt * sizeof(xmlNodePtr))) == NULL) {
-				ERROR("Memory reallocation failed (%s:%d - %s).", __FILE__, __LINE__, strerror(errno));
-				free(list_added);
-				return (XMLDIFF_ERR);
-			} else {
-				list_added = realloc_tmp;
-				list_added[list_added_cnt-1] = list_new_tmp;
-			}
+			node_set_add(&list_added, list_new_tmp);
 		} else {
 			/* We already checked for changes in these nodes */
 		}
-		list_new_tmp = list_new_tmp->next;
 	}
 
 	/* list is ordered by user */
@@ -909,23 +855,13 @@ static XMLDIFF_OP xmldiff_list(struct xmldiff_tree** diff, char * path, xmlNodeP
 			}
 
 			/* Wasn't the old node removed and that's why it isn't in the new config? */
-			for (i = 0; i < list_removed_cnt; ++i) {
-				if (list_old_tmp == list_removed[i]) {
-					break;
-				}
-			}
-			if (i != list_removed_cnt) {
+			if (node_set_has(list_removed, list_old_tmp)) {
 				list_old_tmp = list_old_tmp->next;
 				continue;
 			}
 
 			/* Wasn't the new node added and that's why it isn't in the old config? */
-			for (i = 0; i < list_added_cnt; ++i) {
-				if (list_new_tmp == list_added[i]) {
-					break;
-				}
-			}
-			if (i != list_added_cnt) {
+			if (node_set_has(list_added, list_new_tmp)) {
 				list_new_tmp = list_new_tmp->next;
 				continue;
 			}
@@ -941,8 +877,17 @@ static XMLDIFF_OP xmldiff_list(struct xmldiff_tree** diff, char * path, xmlNodeP
 		}
 	}
 
-	free(list_added);
-	free(list_removed);
+cleanup:
+	if (new_keys != NULL) {
+		for (j = 0; j < new_cnt; j++) {
+			xmlFree(new_keys[j]);
+		}
+		free(new_keys);
+	}
+	xmlHashFree(old_instances, NULL);
+	xmlHashFree(new_instances, NULL);
+	xmlHashFree(list_added, NULL);
+	xmlHashFree(list_removed, NULL);
 	return ret_op;
 }
 
@@ -950,90 +895,71 @@ static XMLDIFF_OP xmldiff_leaflist(struct xmldiff_tree** diff, char * path, xmlN
 {
 	XMLDIFF_OP ret_op = XMLDIFF_NONE;
 	char* list_name = strrchr(path, ':')+1;
-	xmlNodePtr* list_added = NULL, *list_removed = NULL, *realloc_tmp;
+	xmlHashTablePtr old_values = NULL, new_values = NULL, list_added = NULL, list_removed = NULL;
 	xmlNodePtr list_old_tmp, list_new_tmp;
-	xmlChar* new_str, *old_str;
-	int i, list_added_cnt = 0, list_removed_cnt = 0;
+	xmlChar** new_strs = NULL, *old_str;
+	int j, new_cnt = 0;
+
+	/* Items are bucketed by their values (the first item of a value wins),
+	 * so the leaf-lists are not compared pair by pair */
+	for (list_new_tmp = new_tmp; list_new_tmp != NULL; list_new_tmp = list_new_tmp->next) {
+		if (xmlStrEqual(BAD_CAST list_name, list_new_tmp->name)) {
+			new_cnt++;
+		}
+	}
+	if ((new_strs = calloc(new_cnt + 1, sizeof(xmlChar*))) == NULL ||
+			(old_values = xmlHashCreate(new_cnt + 1)) == NULL || (new_values = xmlHashCreate(new_cnt + 1)) == NULL) {
+		ERROR("Memory allocation failed (%s:%d - %s).", __FILE__, __LINE__, strerror(errno));
+		ret_op = XMLDIFF_ERR;
+		goto cleanup;
+	}
+
+	/* Hash the new nodes according to their values */
+	for (list_new_tmp = new_tmp, j = 0; list_new_tmp != NULL; list_new_tmp = list_new_tmp->next) {
+		if (!xmlStrEqual(BAD_CAST list_name, list_new_tmp->name)) {
+			continue;
+		}
+		if ((new_strs[j] = xmlNodeGetContent(list_new_tmp)) == NULL && (new_strs[j] = xmlStrdup(BAD_CAST "")) == NULL) {
+			ERROR("Memory allocation failed (%s:%d - %s).", __FILE__, __LINE__, strerror(errno));
+			ret_op = XMLDIFF_ERR;
+			goto cleanup;
+		}
+		xmlHashAddEntry(new_values, new_strs[j++], list_new_tmp);
+	}
 
 	/* Search for matches, only _ADD and _REM will be here */
 	/* For each in the old node find one from the new nodes or log as _REM */
-	list_old_tmp = old_tmp;
-	while (list_old_tmp) {
+	for (list_old_tmp = old_tmp; list_old_tmp != NULL; list_old_tmp = list_old_tmp->next) {
 		if (!xmlStrEqual(BAD_CAST list_name, list_old_tmp->name)) {
-			list_old_tmp = list_old_tmp->next;
 			continue;
 		}
-		old_str = xmlNodeGetContent(list_old_tmp);
-		list_new_tmp = new_tmp;
-		while (list_new_tmp) {
-			if (!xmlStrEqual(BAD_CAST list_name, list_new_tmp->name)) {
-				list_new_tmp = list_new_tmp->next;
-				continue;
-			}
-			new_str = xmlNodeGetContent(list_new_tmp);
-			if (xmlStrEqual(old_str, new_str)) {
-				xmlFree(new_str);
-				/* Equivalent found */
-				break;
-			}
-			xmlFree(new_str);
-			list_new_tmp = list_new_tmp->next;
+		if ((old_str = xmlNodeGetContent(list_old_tmp)) == NULL && (old_str = xmlStrdup(BAD_CAST "")) == NULL) {
+			ERROR("Memory allocation failed (%s:%d - %s).", __FILE__, __LINE__, strerror(errno));
+			ret_op = XMLDIFF_ERR;
+			goto cleanup;
 		}
+		list_new_tmp = xmlHashLookup(new_values, old_str);
+		xmlHashAddEntry(old_values, old_str, list_old_tmp);
 		xmlFree(old_str);
 		if (list_new_tmp == NULL) {
 			xmldiff_add_diff(diff, path, list_old_tmp, list_new_tmp, XMLDIFF_REM, XML_SIBLING);
 			ret_op = XMLDIFF_REM;
 			/* Remember that the node was removed */
-			if ((realloc_tmp = realloc(list_removed, ++list_removed_cnt * sizeof(xmlNodePtr))) == NULL) {
-				ERROR("Memory reallocation failed (%s:%d - %s).", __FILE__, __LINE__, strerror(errno));
-				free(list_removed);
-				return (XMLDIFF_ERR);
-			} else {
-				list_removed = realloc_tmp;
-				list_removed[list_removed_cnt-1] = list_old_tmp;
-			}
+			node_set_add(&list_removed, list_old_tmp);
 		}
-		list_old_tmp = list_old_tmp->next;
 	}
 
 	/* For each in the new node find one from the old nodes or log as _ADD */
-	list_new_tmp = new_tmp;
-	while (list_new_tmp) {
+	for (list_new_tmp = new_tmp, j = 0; list_new_tmp != NULL; list_new_tmp = list_new_tmp->next) {
 		if (!xmlStrEqual(BAD_CAST list_name, list_new_tmp->name)) {
-			list_new_tmp = list_new_tmp->next;
 			continue;
 		}
-		new_str = xmlNodeGetContent(list_new_tmp);
-		list_old_tmp = old_tmp;
-		while (list_old_tmp) {
-			if (!xmlStrEqual(BAD_CAST list_name, list_old_tmp->name)) {
-				list_old_tmp = list_old_tmp->next;
-				continue;
-			}
-			old_str = xmlNodeGetContent(list_old_tmp);
-			if (xmlStrEqual(old_str, new_str)) {
-				xmlFree(old_str);
-				/* Equivalent found */
-				break;
-			}
-			xmlFree(old_str);
-			list_old_tmp = list_old_tmp->next;
-		}
-		xmlFree(new_str);
-		if (list_old_tmp == NULL) {
-			xmldiff_add_diff(diff, path, list_old_tmp, list_new_tmp, XMLDIFF_ADD, XML_SIBLING);
+		if (xmlHashLookup(old_values, new_strs[j++]) == NULL) {
+			xmldiff_add_diff(diff, path, NULL, list_new_tmp, XMLDIFF_ADD, XML_SIBLING);
 			ret_op = XMLDIFF_ADD;
 			/* remeber that the node was added*/
-			if ((realloc_tmp = realloc(list_added, ++list_added_cnt * sizeof(xmlNodePtr))) == NULL) {
-				ERROR("Memory reallocation failed (%s:%d - %s).", __FILE__, __LINE__, strerror(errno));
-				free(list_added);
-				return (XMLDIFF_ERR);
-			} else {
-				list_added = realloc_tmp;
-				list_added[list_added_cnt-1] = list_new_tmp;
-			}
+			node_set_add(&list_added, list_new_tmp);
 		}
-		list_new_tmp = list_new_tmp->next;
 	}
 
 	/* leaf-list is ordered by user */
@@ -1055,23 +981,13 @@ static XMLDIFF_OP xmldiff_leaflist(struct xmldiff_tree** diff, char * path, xmlN
 			}
 
 			/* Wasn't the old node removed and that's why it isn't in the new config? */
-			for (i = 0; i < list_removed_cnt; ++i) {
-				if (list_old_tmp == list_removed[i]) {
-					break;
-				}
-			}
-			if (i != list_removed_cnt) {
+			if (node_set_has(list_removed, list_old_tmp)) {
 				list_old_tmp = list_old_tmp->next;
 				continue;
 			}
 
 			/* Wasn't the new node added and that's why it isn't in the old config? */
-			for (i = 0; i < list_added_cnt; ++i) {
-				if (list_new_tmp == list_added[i]) {
-					break;
-				}
-			}
-			if (i != list_added_cnt) {
+			if (node_set_has(list_added, list_new_tmp)) {
 				list_new_tmp = list_new_tmp->next;
 				continue;
 			}
@@ -1087,8 +1003,17 @@ static XMLDIFF_OP xmldiff_leaflist(struct xmldiff_tree** diff, char * path, xmlN
 		}
 	}
 
-	free(list_added);
-	free(list_removed);
+cleanup:
+	if (new_strs != NULL) {
+		for (j = 0; j < new_cnt; j++) {
+			xmlFree(new_strs[j]);
+		}
+		free(new_strs);
+	}
+	xmlHashFree(old_values, NULL);
+	xmlHashFree(new_values, NULL);
+	xmlHashFree(list_added, NULL);
+	xmlHashFree(list_removed, NULL);
 	return ret_op;
 }
 
@@ -1098,10 +1023,12 @@ static XMLDIFF_OP xmldiff_leaflist(struct xmldiff_tree** diff, char * path, xmlN
  * @param old		old version of XML document
  * @param new		new version of XML document
  * @param model	data model in YANG format
+ * @param record	record of the edit-config which made the new version, NULL to
+ *			compare everything
  *
  * @return xmldiff structure holding all differences between XML documents or NULL
  */
-XMLDIFF_OP xmldiff_diff(struct xmldiff_tree** diff, xmlDocPtr old, xmlDocPtr new, struct model_tree * model)
+XMLDIFF_OP xmldiff_diff(struct xmldiff_tree** diff, xmlDocPtr old, xmlDocPtr new, struct model_tree * model, const struct edit_record* record)
 {
 	char* path;
 	XMLDIFF_OP ret_op = XMLDIFF_NONE;
@@ -1117,7 +1044,7 @@ XMLDIFF_OP xmldiff_diff(struct xmldiff_tree** diff, xmlDocPtr old, xmlDocPtr new
 			ERROR("asprintf() failed (%s:%d).", __FILE__, __LINE__);
 			return (XMLDIFF_ERR);
 		}
-		ret_op = xmldiff_recursive(diff, path, old->children, new->children, &model->children[i]);
+		ret_op = xmldiff_recursive(diff, path, old->children, new->children, &model->children[i], record);
 		free(path);
 	}
 
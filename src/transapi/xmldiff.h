@@ -97,10 +97,12 @@ void xmldiff_free (struct xmldiff_tree* diff);
  * @param old		old version of XML document
  * @param new		new version of XML document
  * @param model	data model in YANG format
+ * @param record	record of the edit-config which made the new version, only the
+ *			subtrees touched by the edit are compared, NULL to compare everything
  *
  * @return xmldiff structure holding all differences between XML documents or NULL
  */
-XMLDIFF_OP xmldiff_diff (struct xmldiff_tree** diff, xmlDocPtr old, xmlDocPtr new, struct model_tree * model);
+XMLDIFF_OP xmldiff_diff (struct xmldiff_tree** diff, xmlDocPtr old, xmlDocPtr new, struct model_tree * model, const struct edit_record* record);
 
 /**
  * @ingroup transapi